@@ -0,0 +1,116 @@
+#include "BenchReport.h"
+#include <QtTest>
+#include <QDateTime>
+#include <QDirIterator>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QSysInfo>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+namespace DesktopApp {
+
+qint64 peakResidentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return qint64(counters.PeakWorkingSetSize);
+    }
+    return -1;
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return -1;
+    }
+#if defined(Q_OS_DARWIN)
+    return qint64(usage.ru_maxrss);        // bytes
+#else
+    return qint64(usage.ru_maxrss) * 1024; // kilobytes
+#endif
+#else
+    return -1;
+#endif
+}
+
+bool copyDirectory(const QString &from, const QString &to)
+{
+    QDirIterator it(from, QDir::Files, QDirIterator::Subdirectories);
+    while (it.hasNext()) {
+        const QString source = it.next();
+        const QString target = QDir(to).filePath(QDir(from).relativeFilePath(source));
+        if (!QDir().mkpath(QFileInfo(target).absolutePath()) || !QFile::copy(source, target)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+BenchReport::BenchReport(const QString &benchmark)
+    : m_benchmark(benchmark)
+{
+}
+
+void BenchReport::add(qint64 elapsedNs, int iterations, qint64 operations)
+{
+    QJsonObject result;
+    result["test"] = QString::fromLatin1(QTest::currentTestFunction());
+    result["row"] = QString::fromLatin1(QTest::currentDataTag());
+    result["iterations"] = iterations;
+    const double nsPerIteration = iterations > 0 ? double(elapsedNs) / iterations : 0.0;
+    result["nsPerIteration"] = nsPerIteration;
+    if (operations > 0 && nsPerIteration > 0) {
+        result["operations"] = operations;
+        result["opsPerSecond"] = operations * 1e9 / nsPerIteration;
+    }
+    result["peakRssBytes"] = peakResidentBytes();
+    m_results.append(result);
+}
+
+void BenchReport::annotate(const QString &key, const QJsonValue &value)
+{
+    if (m_results.isEmpty()) {
+        return;
+    }
+    QJsonObject result = m_results.last().toObject();
+    result[key] = value;
+    m_results[m_results.size() - 1] = result;
+}
+
+bool BenchReport::write() const
+{
+    QJsonObject root;
+    root["benchmark"] = m_benchmark;
+    root["timestamp"] = QDateTime::currentDateTimeUtc().toString(Qt::ISODate);
+    root["qtVersion"] = QString::fromLatin1(qVersion());
+    root["platform"] = QSysInfo::prettyProductName();
+    root["cpu"] = QSysInfo::currentCpuArchitecture();
+    root["corpora"] = m_corpora;
+    root["results"] = m_results;
+    root["peakRssBytes"] = peakResidentBytes();
+
+    QString path = qEnvironmentVariable("STORAGE_BENCH_OUTPUT");
+    if (path.isEmpty()) {
+        path = m_benchmark + ".json";
+    }
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot write benchmark report:" << path << file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Indented));
+    if (!file.commit()) {
+        qWarning() << "Cannot write benchmark report:" << path << file.errorString();
+        return false;
+    }
+    qDebug() << "Benchmark report written to" << path;
+    return true;
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+
+namespace DesktopApp {
+
+/**
+ * @brief Peak resident set size of this process in bytes, or -1 if unknown
+ */
+qint64 peakResidentBytes();
+
+/**
+ * @brief Copy the files below @p from into @p to, creating directories as needed
+ */
+bool copyDirectory(const QString &from, const QString &to);
+
+/**
+ * @brief Collects benchmark measurements and writes them as JSON
+ *
+ * QtTest has no JSON logger, so benchmarks time themselves alongside
+ * QBENCHMARK and record the result here. The file is meant to be diffed
+ * between releases.
+ */
+class BenchReport
+{
+public:
+    explicit BenchReport(const QString &benchmark);
+
+    /**
+     * @brief Describe the data set that rows named @p name ran against
+     */
+    void setCorpus(const QString &name, const QJsonObject &corpus) { m_corpora[name] = corpus; }
+
+    /**
+     * @brief Record one measurement of the current test function and data row
+     * @param elapsedNs Total time over all iterations
+     * @param operations Operations per iteration, for throughput; 0 to omit
+     */
+    void add(qint64 elapsedNs, int iterations, qint64 operations = 0);
+
+    /**
+     * @brief Attach an extra value, such as a memory figure, to the last measurement
+     */
+    void annotate(const QString &key, const QJsonValue &value);
+
+    /**
+     * @brief Write the report to $STORAGE_BENCH_OUTPUT, or <benchmark>.json in the working directory
+     */
+    bool write() const;
+
+private:
+    QString m_benchmark;
+    QJsonObject m_corpora;
+    QJsonArray m_results;
+};
+
+} // namespace DesktopApp
@@ -0,0 +1,175 @@
+#include "SyntheticCorpus.h"
+#include "data/ConversationRepository.h"
+#include "data/JsonStore.h"
+#include <QSignalSpy>
+#include <QStringList>
+#include <QtMath>
+#include <algorithm>
+
+namespace DesktopApp {
+
+namespace {
+
+int environmentInt(const char *name, int fallback)
+{
+    bool ok = false;
+    int value = qEnvironmentVariableIntValue(name, &ok);
+    return ok && value > 0 ? value : fallback;
+}
+
+CorpusSpec profile(const QString &name, int conversations, int messagesPerConversation)
+{
+    CorpusSpec spec;
+    spec.name = name;
+    spec.conversations = conversations;
+    spec.messagesPerConversation = messagesPerConversation;
+    return spec;
+}
+
+} // namespace
+
+QVector<CorpusSpec> CorpusSpec::profiles()
+{
+    if (!qEnvironmentVariableIsSet("STORAGE_BENCH_CONVERSATIONS")
+        && !qEnvironmentVariableIsSet("STORAGE_BENCH_MESSAGES")) {
+        return {
+            profile("small", 50, 40),      //   2k messages
+            profile("medium", 200, 100),   //  20k messages
+            profile("large", 1000, 200)    // 200k messages
+        };
+    }
+
+    CorpusSpec spec;
+    spec.conversations = environmentInt("STORAGE_BENCH_CONVERSATIONS", spec.conversations);
+    spec.messagesPerConversation = environmentInt("STORAGE_BENCH_MESSAGES", spec.messagesPerConversation);
+    spec.minWords = environmentInt("STORAGE_BENCH_MIN_WORDS", spec.minWords);
+    spec.meanWords = environmentInt("STORAGE_BENCH_MEAN_WORDS", spec.meanWords);
+    spec.maxWords = std::max(spec.minWords, environmentInt("STORAGE_BENCH_MAX_WORDS", spec.maxWords));
+    spec.seed = quint32(environmentInt("STORAGE_BENCH_SEED", int(spec.seed)));
+    return {spec};
+}
+
+QJsonObject CorpusSpec::toJson() const
+{
+    QJsonObject corpus;
+    corpus["conversations"] = conversations;
+    corpus["messagesPerConversation"] = messagesPerConversation;
+    corpus["minWords"] = minWords;
+    corpus["meanWords"] = meanWords;
+    corpus["maxWords"] = maxWords;
+    corpus["seed"] = qint64(seed);
+    return corpus;
+}
+
+SyntheticCorpus::SyntheticCorpus(const CorpusSpec &spec)
+    : m_spec(spec)
+    , m_random(spec.seed)
+    , m_epoch(QDateTime::currentDateTime().addDays(-90))
+{
+}
+
+Conversation SyntheticCorpus::conversation(int index)
+{
+    Conversation conversation(QString("Conversation %1: %2").arg(index).arg(text(4)));
+    conversation.createdAt = m_epoch.addSecs(qint64(index) * 600);
+    conversation.updatedAt = conversation.createdAt.addSecs(qint64(m_spec.messagesPerConversation) * 30);
+    conversation.pinned = index % 25 == 0;
+    conversation.archived = index % 10 == 9;
+    return conversation;
+}
+
+MessageList SyntheticCorpus::messages(const Conversation &conversation)
+{
+    MessageList messages;
+    messages.reserve(m_spec.messagesPerConversation);
+    for (int i = 0; i < m_spec.messagesPerConversation; ++i) {
+        // Exponential length distribution: -mean * ln(1 - u)
+        const double u = m_random.generateDouble();
+        const int words = std::clamp(int(-m_spec.meanWords * qLn(1.0 - u)), m_spec.minWords, m_spec.maxWords);
+
+        Message message(conversation.id, i % 2 ? MessageRole::Assistant : MessageRole::User, text(words));
+        message.createdAt = conversation.createdAt.addSecs(qint64(i) * 30);
+        messages.append(message);
+    }
+    return messages;
+}
+
+QStringList SyntheticCorpus::populate(ConversationRepository &store)
+{
+    QStringList ids;
+    ids.reserve(m_spec.conversations);
+
+    ConversationRepository::Batch batch(&store);
+    for (int i = 0; i < m_spec.conversations; ++i) {
+        const Conversation conv = conversation(i);
+        store.createConversation(conv);
+        for (const Message &message : messages(conv)) {
+            store.createMessage(message);
+        }
+        ids.append(conv.id);
+    }
+    batch.commit();
+    return ids;
+}
+
+QString SyntheticCorpus::text(int words)
+{
+    static const QStringList vocabulary = {
+        "storage", "message", "assistant", "conversation", "the", "quick", "brown",
+        "fox", "jumps", "over", "lazy", "dog", "latency", "journal", "shard",
+        "index", "query", "model", "token", "stream", "cache", "render", "thread",
+        "a", "of", "and", "to", "in", "is", "that", "for", "it", "with", "as"
+    };
+
+    QString result;
+    result.reserve(words * 7);
+    for (int w = 0; w < words; ++w) {
+        if (w > 0) {
+            result.append(w % 12 == 0 ? QStringLiteral(". ") : QStringLiteral(" "));
+        }
+        result.append(vocabulary.at(int(m_random.bounded(quint32(vocabulary.size())))));
+    }
+    return result;
+}
+
+bool saveSnapshot(JsonStore &store, qint64 *bytesWritten)
+{
+    // Large profiles take minutes to encode and sync
+    QSignalSpy saved(&store, &JsonStore::snapshotSaved);
+    store.checkpoint();
+    if (!saved.wait(600000)) {
+        return false;
+    }
+    if (bytesWritten) {
+        *bytesWritten = saved.first().at(1).toLongLong();
+    }
+    return true;
+}
+
+QString CorpusStores::path(const CorpusSpec &spec, const Finish &finish)
+{
+    auto it = m_stores.find(spec.name);
+    if (it != m_stores.end()) {
+        return it->second->path();
+    }
+
+    auto dir = std::make_unique<QTemporaryDir>();
+    {
+        JsonStore store;
+        if (!dir->isValid() || !store.initialize(dir->path())) {
+            return QString();
+        }
+        const QStringList ids = SyntheticCorpus(spec).populate(store);
+        if (!saveSnapshot(store)) {
+            return QString();
+        }
+        if (finish) {
+            finish(store, ids);
+        }
+    }
+    const QString path = dir->path();
+    m_stores[spec.name] = std::move(dir);
+    return path;
+}
+
+} // namespace DesktopApp
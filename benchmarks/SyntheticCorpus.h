@@ -0,0 +1,116 @@
+#pragma once
+
+#include <QJsonObject>
+#include <QRandomGenerator>
+#include <QString>
+#include <QTemporaryDir>
+#include <QVector>
+#include <functional>
+#include <map>
+#include <memory>
+#include "data/Models.h"
+
+namespace DesktopApp {
+
+class ConversationRepository;
+class JsonStore;
+
+/**
+ * @brief Shape of a generated benchmark corpus
+ *
+ * Message lengths follow an exponential distribution around meanWords,
+ * clamped to [minWords, maxWords], which gives the long tail of real chats:
+ * mostly short turns with the occasional long answer.
+ */
+struct CorpusSpec {
+    QString name = "custom";
+    int conversations = 100;
+    int messagesPerConversation = 100;
+    int minWords = 1;
+    int meanWords = 40;
+    int maxWords = 800;
+    quint32 seed = 1;
+
+    int totalMessages() const { return conversations * messagesPerConversation; }
+
+    /**
+     * @brief The generator settings, for BenchReport::setCorpus()
+     */
+    QJsonObject toJson() const;
+
+    /**
+     * @brief Built-in profiles, or a single profile from STORAGE_BENCH_* environment variables
+     *
+     * Recognized variables: STORAGE_BENCH_CONVERSATIONS, STORAGE_BENCH_MESSAGES
+     * (per conversation), STORAGE_BENCH_MIN_WORDS, STORAGE_BENCH_MEAN_WORDS,
+     * STORAGE_BENCH_MAX_WORDS and STORAGE_BENCH_SEED.
+     */
+    static QVector<CorpusSpec> profiles();
+};
+
+/**
+ * @brief Deterministic generator of conversations and messages for a CorpusSpec
+ */
+class SyntheticCorpus
+{
+public:
+    explicit SyntheticCorpus(const CorpusSpec &spec);
+
+    const CorpusSpec &spec() const { return m_spec; }
+
+    /**
+     * @brief Conversation number @p index, with timestamps spread over the last 90 days
+     */
+    Conversation conversation(int index);
+
+    /**
+     * @brief The messages of @p conversation, alternating user and assistant turns
+     */
+    MessageList messages(const Conversation &conversation);
+
+    /**
+     * @brief Write the whole corpus into @p store in one batch
+     * @return Ids of the created conversations
+     */
+    QStringList populate(ConversationRepository &store);
+
+private:
+    QString text(int words);
+
+    CorpusSpec m_spec;
+    QRandomGenerator m_random;
+    QDateTime m_epoch;
+};
+
+/**
+ * @brief Ask @p store for a checkpoint and wait until it is on disk
+ * @param bytesWritten Set to the size of the files the checkpoint wrote
+ */
+bool saveSnapshot(JsonStore &store, qint64 *bytesWritten = nullptr);
+
+/**
+ * @brief Checkpointed JsonStore directories of generated corpora, one per profile
+ *
+ * Generating a large corpus takes longer than most measurements, so each
+ * profile is written once and its directory reused until clear().
+ */
+class CorpusStores
+{
+public:
+    /**
+     * @brief Runs after the checkpoint, before the store is closed, e.g. to leave a journal tail
+     */
+    using Finish = std::function<void(JsonStore &store, const QStringList &conversationIds)>;
+
+    /**
+     * @brief Directory of the store holding @p spec, generated on first use; empty on failure
+     */
+    QString path(const CorpusSpec &spec, const Finish &finish = Finish());
+
+    void clear() { m_stores.clear(); }
+
+private:
+    std::map<QString, std::unique_ptr<QTemporaryDir>> m_stores;
+};
+
+} // namespace DesktopApp
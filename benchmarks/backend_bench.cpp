@@ -0,0 +1,273 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <map>
+#include <memory>
+#include "data/ConversationRepository.h"
+#include "data/ConversationStore.h"
+#include "data/JsonStore.h"
+#include "BenchReport.h"
+#include "SyntheticCorpus.h"
+
+using namespace DesktopApp;
+
+namespace {
+
+const int kMessagesPerConversation = 1000;
+const int kPageSize = 50;
+
+std::unique_ptr<ConversationRepository> createStore(const QString &backend)
+{
+    if (backend == "sqlite") {
+        return std::make_unique<ConversationStore>();
+    }
+    return std::make_unique<JsonStore>();
+}
+
+/**
+ * @brief 10k, 100k and 1M messages in conversations of kMessagesPerConversation
+ *
+ * Larger than CorpusSpec::profiles(), since the backends differ most at
+ * scale; STORAGE_BENCH_* variables still select a corpus of their own.
+ */
+QVector<CorpusSpec> backendProfiles()
+{
+    if (qEnvironmentVariableIsSet("STORAGE_BENCH_CONVERSATIONS") || qEnvironmentVariableIsSet("STORAGE_BENCH_MESSAGES")) {
+        return CorpusSpec::profiles();
+    }
+
+    QVector<CorpusSpec> profiles;
+    const QList<QPair<QString, int>> sizes = {{"10k", 10}, {"100k", 100}, {"1M", 1000}};
+    for (const auto &size : sizes) {
+        CorpusSpec spec;
+        spec.name = size.first;
+        spec.conversations = size.second;
+        spec.messagesPerConversation = kMessagesPerConversation;
+        profiles.append(spec);
+    }
+    return profiles;
+}
+
+} // namespace
+
+/**
+ * @brief Insert, load and range-query cost of the JSON and SQLite backends
+ *
+ * insert: one message at a time outside of any batch, as a chat writes
+ * them; generating the corpus is not timed, closing the store is.
+ *
+ * load: opening a store written earlier and reading every conversation;
+ * the JSON store is checkpointed first, so its journal is not replayed.
+ *
+ * range: paging one conversation from its newest message back to the oldest.
+ */
+class BackendBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    BackendBench();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void insert_data();
+    void insert();
+    void load_data();
+    void load();
+    void range_data();
+    void range();
+
+private:
+    /**
+     * @brief Data rows: every backend with every corpus profile
+     */
+    void addBackendRows();
+    CorpusSpec currentSpec() const;
+
+    /**
+     * @brief Directory of a @p backend store holding @p spec, generated once; empty on failure
+     */
+    QString storePath(const QString &backend, const CorpusSpec &spec);
+
+    QVector<CorpusSpec> m_profiles;
+    std::map<QString, std::unique_ptr<QTemporaryDir>> m_stores; // "<backend>/<profile>" -> directory
+    BenchReport m_report;
+};
+
+BackendBench::BackendBench()
+    : m_report("backend_bench")
+{
+}
+
+void BackendBench::initTestCase()
+{
+    m_profiles = backendProfiles();
+    for (const CorpusSpec &spec : std::as_const(m_profiles)) {
+        m_report.setCorpus(spec.name, spec.toJson());
+    }
+}
+
+void BackendBench::cleanupTestCase()
+{
+    m_stores.clear();
+    QVERIFY(m_report.write());
+}
+
+void BackendBench::addBackendRows()
+{
+    QTest::addColumn<QString>("backend");
+    QTest::addColumn<int>("profile");
+
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        const QString &name = m_profiles.at(i).name;
+        QTest::newRow(qPrintable(QString("json/%1").arg(name))) << QString("json") << i;
+        QTest::newRow(qPrintable(QString("sqlite/%1").arg(name))) << QString("sqlite") << i;
+    }
+}
+
+CorpusSpec BackendBench::currentSpec() const
+{
+    QFETCH(int, profile);
+    return m_profiles.at(profile);
+}
+
+QString BackendBench::storePath(const QString &backend, const CorpusSpec &spec)
+{
+    const QString key = QString("%1/%2").arg(backend, spec.name);
+    auto it = m_stores.find(key);
+    if (it != m_stores.end()) {
+        return it->second->path();
+    }
+
+    auto dir = std::make_unique<QTemporaryDir>();
+    {
+        std::unique_ptr<ConversationRepository> store = createStore(backend);
+        if (!dir->isValid() || !store->initialize(dir->path())) {
+            return QString();
+        }
+        SyntheticCorpus(spec).populate(*store);
+        auto *json = qobject_cast<JsonStore *>(store.get());
+        if (json && !saveSnapshot(*json)) {
+            return QString();
+        }
+    }
+    const QString path = dir->path();
+    m_stores[key] = std::move(dir);
+    return path;
+}
+
+void BackendBench::insert_data()
+{
+    addBackendRows();
+}
+
+void BackendBench::insert()
+{
+    QFETCH(QString, backend);
+    const CorpusSpec spec = currentSpec();
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    SyntheticCorpus corpus(spec);
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    QBENCHMARK_ONCE {
+        timer.start();
+        std::unique_ptr<ConversationRepository> store = createStore(backend);
+        QVERIFY(store->initialize(dir.path()));
+        elapsed += timer.nsecsElapsed();
+
+        for (int i = 0; i < spec.conversations; ++i) {
+            const Conversation conversation = corpus.conversation(i);
+            const MessageList messages = corpus.messages(conversation);
+            timer.start();
+            store->createConversation(conversation);
+            for (const Message &message : messages) {
+                store->createMessage(message);
+            }
+            elapsed += timer.nsecsElapsed();
+        }
+
+        // Destruction flushes what is still buffered, so it counts too
+        timer.start();
+        store.reset();
+        elapsed += timer.nsecsElapsed();
+    }
+    m_report.add(elapsed, 1, spec.totalMessages());
+}
+
+void BackendBench::load_data()
+{
+    addBackendRows();
+}
+
+void BackendBench::load()
+{
+    QFETCH(QString, backend);
+    const CorpusSpec spec = currentSpec();
+    const QString path = storePath(backend, spec);
+    QVERIFY(!path.isEmpty());
+
+    int loaded = 0;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    QBENCHMARK_ONCE {
+        timer.start();
+        std::unique_ptr<ConversationRepository> store = createStore(backend);
+        QVERIFY(store->initialize(path));
+        for (const Conversation &conversation : store->getAllConversations()) {
+            loaded += static_cast<int>(store->getMessagesForConversation(conversation.id).size());
+        }
+        elapsed = timer.nsecsElapsed();
+    }
+    m_report.add(elapsed, 1, loaded);
+    QCOMPARE(loaded, spec.totalMessages());
+}
+
+void BackendBench::range_data()
+{
+    addBackendRows();
+}
+
+void BackendBench::range()
+{
+    QFETCH(QString, backend);
+    const CorpusSpec spec = currentSpec();
+    const QString path = storePath(backend, spec);
+    QVERIFY(!path.isEmpty());
+
+    std::unique_ptr<ConversationRepository> store = createStore(backend);
+    QVERIFY(store->initialize(path));
+    const ConversationList conversations = store->getAllConversations();
+    QVERIFY(!conversations.isEmpty());
+    const QString conversationId = conversations.first().id;
+
+    // Scroll one conversation from the newest message back to the oldest
+    int paged = 0;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        paged = 0;
+        MessageCursor cursor;
+        MessagePage page;
+        do {
+            page = store->getMessagesBefore(conversationId, cursor, kPageSize);
+            paged += static_cast<int>(page.messages.size());
+            if (!page.messages.isEmpty()) {
+                cursor = MessageCursor(page.messages.first());
+            }
+        } while (page.hasMoreBefore);
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, paged);
+    QCOMPARE(paged, spec.messagesPerConversation);
+}
+
+QTEST_GUILESS_MAIN(BackendBench)
+#include "backend_bench.moc"
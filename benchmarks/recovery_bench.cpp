@@ -0,0 +1,174 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include "data/JsonStore.h"
+#include "data/Models.h"
+#include "BenchReport.h"
+#include "SyntheticCorpus.h"
+
+using namespace DesktopApp;
+
+namespace {
+
+const int kJournaledConversations = 20;   // conversations touched after the last checkpoint
+const int kJournaledMessages = 50;        // messages appended to each of them
+const int kFlipsPerFile = 4;              // bytes inverted in every damaged file
+const int kDamagedShardStride = 10;       // every n-th shard file is damaged
+
+/**
+ * @brief Invert a few bytes spread evenly over @p path
+ */
+bool corruptFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadWrite) || file.size() == 0) {
+        return false;
+    }
+    for (int i = 1; i <= kFlipsPerFile; ++i) {
+        char byte = 0;
+        const qint64 offset = file.size() * i / (kFlipsPerFile + 1);
+        if (!file.seek(offset) || !file.getChar(&byte) || !file.seek(offset) || !file.putChar(char(~byte))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+int corruptFiles(const QString &dir, const QString &pattern, int stride)
+{
+    int damaged = 0;
+    const QStringList files = QDir(dir).entryList({pattern}, QDir::Files, QDir::Name);
+    for (int i = 0; i < files.size(); i += stride) {
+        damaged += corruptFile(QDir(dir).filePath(files.at(i))) ? 1 : 0;
+    }
+    return damaged;
+}
+
+} // namespace
+
+/**
+ * @brief Time-to-usable of a JsonStore after crash damage
+ *
+ * Each row copies a checkpointed store with an unsaved journal tail,
+ * damages part of it and measures initialize() plus the first sidebar
+ * query. For a store in the gigabyte range select a corpus with the
+ * STORAGE_BENCH_* variables, e.g. 5000 conversations of 400 messages.
+ */
+class RecoveryBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    RecoveryBench();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void recover_data();
+    void recover();
+
+private:
+    /**
+     * @brief Store directory of @p spec as left by a crash, generated once
+     */
+    QString crashedStore(const CorpusSpec &spec);
+
+    QVector<CorpusSpec> m_profiles;
+    CorpusStores m_stores;
+    BenchReport m_report;
+};
+
+RecoveryBench::RecoveryBench()
+    : m_report("recovery_bench")
+{
+}
+
+void RecoveryBench::initTestCase()
+{
+    m_profiles = CorpusSpec::profiles();
+    for (const CorpusSpec &spec : std::as_const(m_profiles)) {
+        m_report.setCorpus(spec.name, spec.toJson());
+    }
+}
+
+void RecoveryBench::cleanupTestCase()
+{
+    m_stores.clear();
+    QVERIFY(m_report.write());
+}
+
+QString RecoveryBench::crashedStore(const CorpusSpec &spec)
+{
+    // Left in the journal only: the store goes away without another checkpoint
+    return m_stores.path(spec, [](JsonStore &store, const QStringList &ids) {
+        for (int i = 0; i < std::min(kJournaledConversations, int(ids.size())); ++i) {
+            for (int j = 0; j < kJournaledMessages; ++j) {
+                store.createMessage(Message(ids.at(i), MessageRole::User, QString("Unsaved message %1").arg(j)));
+            }
+        }
+    });
+}
+
+void RecoveryBench::recover_data()
+{
+    QTest::addColumn<int>("profile");
+    QTest::addColumn<QString>("damage");
+
+    const QStringList damages = {"none", "manifest", "shards", "journal", "all"};
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        for (const QString &damage : damages) {
+            QTest::newRow(qPrintable(QString("%1/%2").arg(m_profiles.at(i).name, damage))) << i << damage;
+        }
+    }
+}
+
+void RecoveryBench::recover()
+{
+    QFETCH(int, profile);
+    QFETCH(QString, damage);
+    const CorpusSpec spec = m_profiles.at(profile);
+    const QString crashed = crashedStore(spec);
+    QVERIFY(!crashed.isEmpty());
+
+    // Recovery rewrites the store, so every run damages a fresh copy
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    QVERIFY(copyDirectory(crashed, dir.path()));
+    const QDir storeDir(QDir(dir.path()).filePath("store"));
+    int damagedFiles = 0;
+    if (damage == "manifest" || damage == "all") {
+        damagedFiles += corruptFile(storeDir.filePath("manifest.cbor")) ? 1 : 0;
+    }
+    if (damage == "shards" || damage == "all") {
+        damagedFiles += corruptFiles(storeDir.filePath("shards"), "*.cbor", kDamagedShardStride);
+    }
+    if (damage == "journal" || damage == "all") {
+        damagedFiles += corruptFiles(QDir(dir.path()).filePath("journal"), "*", 1);
+    }
+
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    ConversationList recent;
+    JsonStore store;
+    QBENCHMARK_ONCE {
+        timer.start();
+        QVERIFY(store.initialize(dir.path()));
+        recent = store.getRecentConversations(100);
+        elapsed = timer.nsecsElapsed();
+    }
+    m_report.add(elapsed, 1, spec.conversations);
+    QVERIFY(!recent.isEmpty());
+
+    int messages = 0;
+    const ConversationList conversations = store.getAllConversations();
+    for (const Conversation &conversation : conversations) {
+        messages += store.getConversationMessageCount(conversation.id);
+    }
+    qDebug() << spec.name << damage << "(" << damagedFiles << "files damaged ):" << conversations.size() << "of"
+             << spec.conversations << "conversations," << messages << "of"
+             << spec.totalMessages() + kJournaledConversations * kJournaledMessages << "messages recovered";
+}
+
+QTEST_GUILESS_MAIN(RecoveryBench)
+#include "recovery_bench.moc"
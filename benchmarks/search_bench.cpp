@@ -0,0 +1,304 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QTemporaryDir>
+#include <map>
+#include <memory>
+#include "data/JsonStore.h"
+#include "data/Models.h"
+#include "services/SearchEngine.h"
+#include "BenchReport.h"
+#include "SyntheticCorpus.h"
+
+using namespace DesktopApp;
+
+namespace {
+
+const int kRelevantPerQuery = 10;      // messages planted with the query's rare term
+const int kDistractorsPerQuery = 30;   // messages planted repeating its common term
+const int kCommonRepeats = 6;
+const int kResultsConsidered = 10;     // recall@10
+
+// A word the corpus vocabulary uses everywhere, paired with one it never uses
+const QList<QPair<QString, QString>> kQueries = {
+    {"cache", "zephyr"},
+    {"thread", "obsidian"},
+    {"journal", "marigold"},
+    {"token", "quasar"},
+    {"stream", "tundra"}
+};
+
+QJsonObject describe(const CorpusSpec &spec)
+{
+    // The planted messages come on top of the generated corpus
+    QJsonObject corpus = spec.toJson();
+    corpus["relevantPerQuery"] = kRelevantPerQuery;
+    corpus["distractorsPerQuery"] = kDistractorsPerQuery;
+    return corpus;
+}
+
+QString filler(QRandomGenerator &random, int words)
+{
+    static const QStringList vocabulary = {
+        "storage", "message", "assistant", "conversation", "quick", "brown",
+        "fox", "jumps", "over", "lazy", "dog", "latency", "shard", "index",
+        "query", "model", "render"
+    };
+
+    QStringList result;
+    for (int w = 0; w < words; ++w) {
+        result.append(vocabulary.at(int(random.bounded(quint32(vocabulary.size())))));
+    }
+    return result.join(' ');
+}
+
+} // namespace
+
+/**
+ * @brief Search quality and cost
+ *
+ * search: recall and latency of BM25 against the term frequency scorer it
+ * replaced. Every query pairs a common word with a rare one. Besides the
+ * synthetic corpus, each query gets planted messages: relevant ones that
+ * mention both words once in a few sentences, and short distractors that
+ * repeat only the common word. Recall is the share of relevant messages
+ * among the first ten results; latency covers all queries against a ready
+ * index.
+ *
+ * rebuild: a full index rebuild with 1, 2, 4, ... threads up to one per
+ * core, to check that it scales with cores.
+ *
+ * open: startup with a persisted index, from openIndex() to the results of a
+ * first query; compare with rebuild, which is what startup used to cost.
+ */
+class SearchBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    SearchBench();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void search_data();
+    void search();
+
+    void rebuild_data();
+    void rebuild();
+
+    void open_data();
+    void open();
+
+private:
+    struct Fixture {
+        std::unique_ptr<QTemporaryDir> dir;
+        std::unique_ptr<JsonStore> store;
+        std::unique_ptr<SearchEngine> engine;
+        QHash<QString, QSet<QString>> relevant; // query -> planted relevant message ids
+    };
+
+    /**
+     * @brief Store and ready index for @p spec, generated once
+     */
+    Fixture *fixture(const CorpusSpec &spec);
+
+    QVector<CorpusSpec> m_profiles;
+    std::map<QString, Fixture> m_fixtures;
+    BenchReport m_report;
+};
+
+SearchBench::SearchBench()
+    : m_report("search_bench")
+{
+}
+
+void SearchBench::initTestCase()
+{
+    m_profiles = CorpusSpec::profiles();
+    for (const CorpusSpec &spec : std::as_const(m_profiles)) {
+        m_report.setCorpus(spec.name, describe(spec));
+    }
+}
+
+void SearchBench::cleanupTestCase()
+{
+    m_fixtures.clear();
+    QVERIFY(m_report.write());
+}
+
+SearchBench::Fixture *SearchBench::fixture(const CorpusSpec &spec)
+{
+    auto it = m_fixtures.find(spec.name);
+    if (it != m_fixtures.end()) {
+        return &it->second;
+    }
+
+    Fixture fixture;
+    fixture.dir = std::make_unique<QTemporaryDir>();
+    fixture.store = std::make_unique<JsonStore>();
+    if (!fixture.dir->isValid() || !fixture.store->initialize(fixture.dir->path())) {
+        return nullptr;
+    }
+    SyntheticCorpus(spec).populate(*fixture.store);
+
+    QRandomGenerator random(spec.seed);
+    {
+        ConversationRepository::Batch batch(fixture.store.get());
+        for (const auto &query : kQueries) {
+            Conversation conversation(QString("Planted: %1").arg(query.second));
+            fixture.store->createConversation(conversation);
+            QSet<QString> &relevant = fixture.relevant[query.first + ' ' + query.second];
+            for (int i = 0; i < kRelevantPerQuery; ++i) {
+                Message message(conversation.id, MessageRole::Assistant,
+                                QString("%1 %2. %3 %4. %5").arg(filler(random, 12), query.first, filler(random, 15),
+                                                                 query.second, filler(random, 10)));
+                fixture.store->createMessage(message);
+                relevant.insert(message.id);
+            }
+            for (int i = 0; i < kDistractorsPerQuery; ++i) {
+                QStringList words(kCommonRepeats, query.first);
+                words.append(filler(random, 3));
+                fixture.store->createMessage(Message(conversation.id, MessageRole::User, words.join(' ')));
+            }
+        }
+    }
+
+    fixture.engine = std::make_unique<SearchEngine>(fixture.store.get());
+    QSignalSpy rebuilt(fixture.engine.get(), &SearchEngine::indexRebuilt);
+    if (!fixture.engine->rebuildIndex() || !rebuilt.wait(600000)) {
+        return nullptr;
+    }
+    return &(m_fixtures[spec.name] = std::move(fixture));
+}
+
+void SearchBench::search_data()
+{
+    QTest::addColumn<int>("profile");
+    QTest::addColumn<QString>("ranking");
+
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        for (const QString &ranking : {QString("termFrequency"), QString("bm25")}) {
+            QTest::newRow(qPrintable(QString("%1/%2").arg(m_profiles.at(i).name, ranking))) << i << ranking;
+        }
+    }
+}
+
+void SearchBench::search()
+{
+    QFETCH(int, profile);
+    QFETCH(QString, ranking);
+    const CorpusSpec spec = m_profiles.at(profile);
+    Fixture *data = fixture(spec);
+    QVERIFY(data);
+    data->engine->setRanking(ranking == "bm25" ? SearchEngine::Ranking::Bm25 : SearchEngine::Ranking::TermFrequency);
+
+    QHash<QString, SearchResultList> results;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        for (auto it = data->relevant.cbegin(); it != data->relevant.cend(); ++it) {
+            results[it.key()] = data->engine->searchMessages(it.key(), kResultsConsidered);
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, data->relevant.size());
+
+    int found = 0;
+    int wanted = 0;
+    for (auto it = data->relevant.cbegin(); it != data->relevant.cend(); ++it) {
+        for (const SearchResult &result : results.value(it.key())) {
+            found += it->contains(result.messageId) ? 1 : 0;
+        }
+        wanted += std::min(kResultsConsidered, int(it->size()));
+    }
+    const double recall = wanted > 0 ? double(found) / wanted : 0.0;
+    m_report.annotate("recallAt10", recall);
+    qDebug() << spec.name << ranking << "recall@10:" << recall;
+}
+
+void SearchBench::rebuild_data()
+{
+    QTest::addColumn<int>("profile");
+    QTest::addColumn<int>("threads");
+
+    const int cores = QThread::idealThreadCount();
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        for (int threads = 1; threads < 2 * cores; threads *= 2) {
+            const int used = std::min(threads, cores);
+            QTest::newRow(qPrintable(QString("%1/%2").arg(m_profiles.at(i).name).arg(used))) << i << used;
+        }
+    }
+}
+
+void SearchBench::rebuild()
+{
+    QFETCH(int, profile);
+    QFETCH(int, threads);
+    const CorpusSpec spec = m_profiles.at(profile);
+    Fixture *data = fixture(spec);
+    QVERIFY(data);
+    data->engine->setMaxRebuildThreads(threads);
+
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QSignalSpy rebuilt(data->engine.get(), &SearchEngine::indexRebuilt);
+        timer.start();
+        QVERIFY(data->engine->rebuildIndex());
+        QVERIFY(rebuilt.wait(600000));
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, spec.totalMessages());
+    m_report.annotate("threads", threads);
+    data->engine->setMaxRebuildThreads(0);
+}
+
+void SearchBench::open_data()
+{
+    QTest::addColumn<int>("profile");
+
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        QTest::newRow(qPrintable(m_profiles.at(i).name)) << i;
+    }
+}
+
+void SearchBench::open()
+{
+    QFETCH(int, profile);
+    const CorpusSpec spec = m_profiles.at(profile);
+    Fixture *data = fixture(spec);
+    QVERIFY(data);
+
+    // Persisted once; whatever is still in memory is written out when the engine goes
+    const QString directory = data->dir->filePath("search");
+    {
+        SearchEngine writer(data->store.get());
+        QSignalSpy rebuilt(&writer, &SearchEngine::indexRebuilt);
+        QVERIFY(writer.openIndex(directory));
+        QVERIFY(rebuilt.wait(600000));
+    }
+
+    const QString query = kQueries.first().first + ' ' + kQueries.first().second;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        auto engine = std::make_unique<SearchEngine>(data->store.get());
+        QVERIFY(engine->openIndex(directory));
+        QVERIFY(engine->isIndexReady());
+        QVERIFY(!engine->searchMessages(query, kResultsConsidered).isEmpty());
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, spec.totalMessages());
+}
+
+QTEST_GUILESS_MAIN(SearchBench)
+#include "search_bench.moc"
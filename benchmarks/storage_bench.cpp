@@ -0,0 +1,441 @@
+#include <QtTest>
+#include <QElapsedTimer>
+#include <QJsonDocument>
+#include <QTemporaryDir>
+#include <limits>
+#include <memory>
+#include "data/JsonStore.h"
+#include "data/Models.h"
+#include "data/StorageCodec.h"
+#include "BenchReport.h"
+#include "SyntheticCorpus.h"
+
+using namespace DesktopApp;
+
+namespace {
+
+QByteArray encodeJson(const MessageList &messages)
+{
+    // Same shape as the original messages.json: object keyed by id, indented
+    QJsonObject obj;
+    for (const Message &message : messages) {
+        obj.insert(message.id, message.toJson());
+    }
+    return QJsonDocument(obj).toJson(QJsonDocument::Indented);
+}
+
+MessageList decodeJson(const QByteArray &data)
+{
+    const QJsonObject obj = QJsonDocument::fromJson(data).object();
+    MessageList messages;
+    messages.reserve(obj.size());
+    for (auto it = obj.constBegin(); it != obj.constEnd(); ++it) {
+        messages.append(Message::fromJson(it.value().toObject()));
+    }
+    return messages;
+}
+
+} // namespace
+
+/**
+ * @brief JsonStore load/save/query cost on synthetic corpora
+ *
+ * Besides the usual QtTest output, results are written as JSON (see
+ * BenchReport) together with the peak RSS after each test. Corpus size
+ * and message lengths come from CorpusSpec::profiles().
+ */
+class StorageBench : public QObject
+{
+    Q_OBJECT
+
+public:
+    StorageBench();
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void encode_data();
+    void encode();
+    void decode_data();
+    void decode();
+    void save_data();
+    void save();
+    void load_data();
+    void load();
+    void recentConversations_data();
+    void recentConversations();
+    void messagesForConversation_data();
+    void messagesForConversation();
+    void createMessages_data();
+    void createMessages();
+    void updateMessages_data();
+    void updateMessages();
+    void textMemory_data();
+    void textMemory();
+
+private:
+    /**
+     * @brief Data rows: one per corpus profile
+     */
+    void addProfileRows();
+    CorpusSpec currentSpec() const;
+
+    QVector<CorpusSpec> m_profiles;
+    CorpusStores m_stores;
+    BenchReport m_report;
+};
+
+StorageBench::StorageBench()
+    : m_report("storage_bench")
+{
+}
+
+void StorageBench::initTestCase()
+{
+    m_profiles = CorpusSpec::profiles();
+    for (const CorpusSpec &spec : std::as_const(m_profiles)) {
+        m_report.setCorpus(spec.name, spec.toJson());
+    }
+}
+
+void StorageBench::cleanupTestCase()
+{
+    m_stores.clear();
+    QVERIFY(m_report.write());
+}
+
+void StorageBench::addProfileRows()
+{
+    QTest::addColumn<int>("profile");
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        QTest::newRow(qPrintable(m_profiles.at(i).name)) << i;
+    }
+}
+
+CorpusSpec StorageBench::currentSpec() const
+{
+    QFETCH(int, profile);
+    return m_profiles.at(profile);
+}
+
+void StorageBench::encode_data()
+{
+    QTest::addColumn<QString>("format");
+    QTest::addColumn<int>("profile");
+
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        const QString &name = m_profiles.at(i).name;
+        QTest::newRow(qPrintable(QString("json/%1").arg(name))) << QString("json") << i;
+        QTest::newRow(qPrintable(QString("cbor/%1").arg(name))) << QString("cbor") << i;
+    }
+}
+
+void StorageBench::encode()
+{
+    QFETCH(QString, format);
+
+    // The whole corpus as one shard: the worst case for a single file
+    SyntheticCorpus corpus(currentSpec());
+    MessageList list;
+    for (int i = 0; i < corpus.spec().conversations; ++i) {
+        list.append(corpus.messages(corpus.conversation(i)));
+    }
+
+    QByteArray bytes;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        bytes = format == "json" ? encodeJson(list) : StorageCodec::encodeShard(list);
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, list.size());
+    qDebug() << format << list.size() << "messages:" << bytes.size() << "bytes";
+}
+
+void StorageBench::decode_data()
+{
+    encode_data();
+}
+
+void StorageBench::decode()
+{
+    QFETCH(QString, format);
+
+    SyntheticCorpus corpus(currentSpec());
+    MessageList list;
+    for (int i = 0; i < corpus.spec().conversations; ++i) {
+        list.append(corpus.messages(corpus.conversation(i)));
+    }
+    const bool json = format == "json";
+    const QByteArray bytes = json ? encodeJson(list) : StorageCodec::encodeShard(list);
+
+    MessageList decoded;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        decoded.clear();
+        if (json) {
+            decoded = decodeJson(bytes);
+        } else {
+            QVERIFY(StorageCodec::decodeShard(bytes, decoded));
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, list.size());
+    QCOMPARE(decoded.size(), list.size());
+}
+
+void StorageBench::save_data()
+{
+    addProfileRows();
+}
+
+void StorageBench::save()
+{
+    const CorpusSpec spec = currentSpec();
+    QTemporaryDir dir;
+    JsonStore store;
+    QVERIFY(dir.isValid());
+    QVERIFY(store.initialize(dir.path()));
+    SyntheticCorpus(spec).populate(store);
+
+    // Full snapshot: every shard and the manifest are dirty
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    qint64 bytesWritten = 0;
+    QBENCHMARK_ONCE {
+        timer.start();
+        QVERIFY(saveSnapshot(store, &bytesWritten));
+        elapsed = timer.nsecsElapsed();
+    }
+    m_report.add(elapsed, 1, spec.totalMessages());
+    qDebug() << spec.name << "snapshot:" << bytesWritten << "bytes";
+}
+
+void StorageBench::load_data()
+{
+    addProfileRows();
+}
+
+void StorageBench::load()
+{
+    const CorpusSpec spec = currentSpec();
+    const QString path = m_stores.path(spec);
+    QVERIFY(!path.isEmpty());
+
+    // Startup cost: manifest only, shards stay on disk until first access
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        JsonStore store;
+        QVERIFY(store.initialize(path));
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, spec.conversations);
+}
+
+void StorageBench::recentConversations_data()
+{
+    addProfileRows();
+}
+
+void StorageBench::recentConversations()
+{
+    const CorpusSpec spec = currentSpec();
+    JsonStore store;
+    QVERIFY(store.initialize(m_stores.path(spec)));
+
+    ConversationList recent;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        timer.start();
+        recent = store.getRecentConversations(100);
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations);
+    QVERIFY(!recent.isEmpty());
+}
+
+void StorageBench::messagesForConversation_data()
+{
+    QTest::addColumn<int>("profile");
+    QTest::addColumn<bool>("cold");
+    for (int i = 0; i < m_profiles.size(); ++i) {
+        const QString &name = m_profiles.at(i).name;
+        QTest::newRow(qPrintable(QString("cold/%1").arg(name))) << i << true;
+        QTest::newRow(qPrintable(QString("warm/%1").arg(name))) << i << false;
+    }
+}
+
+void StorageBench::messagesForConversation()
+{
+    QFETCH(bool, cold);
+    const CorpusSpec spec = currentSpec();
+    const QString path = m_stores.path(spec);
+
+    // Cold reads every conversation from a fresh store (shard loads); warm repeats them from memory
+    std::unique_ptr<JsonStore> store = std::make_unique<JsonStore>();
+    QVERIFY(store->initialize(path));
+    QStringList ids;
+    for (const Conversation &conversation : store->getAllConversations()) {
+        ids.append(conversation.id);
+    }
+    if (!cold) {
+        for (const QString &id : std::as_const(ids)) {
+            store->getMessagesForConversation(id);
+        }
+    }
+
+    qint64 read = 0;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        if (cold && iterations > 0) {
+            store = std::make_unique<JsonStore>();
+            QVERIFY(store->initialize(path));
+        }
+        read = 0;
+        timer.start();
+        for (const QString &id : std::as_const(ids)) {
+            read += store->getMessagesForConversation(id).size();
+        }
+        elapsed += timer.nsecsElapsed();
+        ++iterations;
+    }
+    m_report.add(elapsed, iterations, read);
+    QCOMPARE(read, qint64(spec.totalMessages()));
+}
+
+void StorageBench::createMessages_data()
+{
+    addProfileRows();
+}
+
+void StorageBench::createMessages()
+{
+    const CorpusSpec spec = currentSpec();
+    SyntheticCorpus corpus(spec);
+    QVector<Conversation> conversations;
+    QVector<MessageList> messages;
+    for (int i = 0; i < spec.conversations; ++i) {
+        conversations.append(corpus.conversation(i));
+        messages.append(corpus.messages(conversations.last()));
+    }
+
+    QTemporaryDir dir;
+    JsonStore store;
+    QVERIFY(dir.isValid());
+    QVERIFY(store.initialize(dir.path()));
+
+    // One call per record, as the UI does; batching is measured by the import path
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    QBENCHMARK_ONCE {
+        timer.start();
+        for (int i = 0; i < conversations.size(); ++i) {
+            store.createConversation(conversations.at(i));
+            for (const Message &message : std::as_const(messages[i])) {
+                store.createMessage(message);
+            }
+        }
+        elapsed = timer.nsecsElapsed();
+    }
+    m_report.add(elapsed, 1, spec.totalMessages() + spec.conversations);
+}
+
+void StorageBench::updateMessages_data()
+{
+    addProfileRows();
+}
+
+void StorageBench::updateMessages()
+{
+    const CorpusSpec spec = currentSpec();
+    QTemporaryDir dir;
+    JsonStore store;
+    QVERIFY(dir.isValid());
+    QVERIFY(store.initialize(dir.path()));
+    const QStringList ids = SyntheticCorpus(spec).populate(store);
+
+    QVector<Message> messages;
+    messages.reserve(spec.totalMessages());
+    for (const QString &id : ids) {
+        for (Message message : store.getMessagesForConversation(id)) {
+            message.text.append(QStringLiteral(" (edited)"));
+            messages.append(message);
+        }
+    }
+
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    QBENCHMARK_ONCE {
+        timer.start();
+        for (const Message &message : std::as_const(messages)) {
+            QVERIFY(store.updateMessage(message));
+        }
+        elapsed = timer.nsecsElapsed();
+    }
+    m_report.add(elapsed, 1, messages.size());
+}
+
+void StorageBench::textMemory_data()
+{
+    addProfileRows();
+    if (qEnvironmentVariableIsSet("STORAGE_BENCH_STORE")) {
+        QTest::newRow("store") << -1; // a copy of a real data directory
+    }
+}
+
+void StorageBench::textMemory()
+{
+    QFETCH(int, profile);
+    QTemporaryDir copy;
+    QString path;
+    if (profile < 0) {
+        QVERIFY(copy.isValid());
+        QVERIFY(copyDirectory(qEnvironmentVariable("STORAGE_BENCH_STORE"), copy.path()));
+        path = copy.path();
+    } else {
+        path = m_stores.path(m_profiles.at(profile));
+    }
+
+    // Load every conversation without decoding any text
+    JsonStore store;
+    store.setCacheBudget(std::numeric_limits<qint64>::max());
+    QVERIFY(store.initialize(path));
+    qint64 messages = 0;
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+    QBENCHMARK_ONCE {
+        timer.start();
+        for (const Conversation &conversation : store.getAllConversations()) {
+            messages += store.getConversationMessageCount(conversation.id);
+        }
+        elapsed = timer.nsecsElapsed();
+    }
+
+    const JsonStore::CacheStats stats = store.cacheStats();
+    m_report.add(elapsed, 1, messages);
+    m_report.annotate("residentBytes", stats.residentBytes);
+    m_report.annotate("textBytes", stats.textBytes);
+    m_report.annotate("utf16TextBytes", stats.utf16TextBytes);
+    qDebug() << messages << "messages:" << stats.textBytes << "bytes of UTF-8 text instead of"
+             << stats.utf16TextBytes << "as QString, saving" << stats.utf16TextBytes - stats.textBytes << "bytes";
+}
+
+QTEST_GUILESS_MAIN(StorageBench)
+#include "storage_bench.moc"
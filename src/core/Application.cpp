@@ -2,6 +2,7 @@
 #include "theme/ThemeManager.h"
 #include "theme/IconRegistry.h"
 #include "data/JsonStore.h"
+#include "data/ConversationStore.h"
 #include "services/SettingsStore.h"
 #include "services/FileVault.h"
 #include "services/SearchEngine.h"
@@ -18,6 +19,7 @@
 #include <QDir>
 #include <QDebug>
 #include <QCoreApplication>
+#include <QThreadPool>
 
 namespace DesktopApp {
 
@@ -31,6 +33,8 @@ Application::Application(QObject *parent)
 
 Application::~Application()
 {
+    // Background searches read the search engine and store snapshots; let them finish first
+    QThreadPool::globalInstance()->waitForDone();
     s_instance = nullptr;
 }
 
@@ -96,16 +100,20 @@ void Application::initializeServices()
 
     // Initialize file vault
     m_fileVault = std::make_unique<FileVault>(m_appDataDir + "/attachments", this);
+    if (!m_fileVault->initialize()) {
+        qWarning() << "Attachment vault unavailable:" << m_appDataDir + "/attachments";
+    }
 
-    // Initialize conversation store with JSON storage
-    m_conversationStore = std::make_unique<JsonStore>(this);
-    if (!m_conversationStore->initialize(m_appDataDir)) {
-        qCritical() << "Failed to initialize JSON store";
+    // Initialize conversation store with the configured backend
+    if (!initializeConversationStore()) {
         return;
     }
 
     // Initialize search engine (depends on conversation store)
     m_searchEngine = std::make_unique<SearchEngine>(m_conversationStore.get(), this);
+    m_searchEngine->setBm25Parameters(m_settingsStore->value("search/bm25K1", 1.2).toDouble(),
+                                      m_settingsStore->value("search/bm25B", 0.75).toDouble());
+    m_searchEngine->openIndex(m_appDataDir + "/search"); // mapped from disk; kept current from the store's signals afterwards
 
     // Initialize provider manager and register built-in providers
     m_providerManager = std::make_unique<ProviderManager>(this);
@@ -163,6 +171,40 @@ void Application::initializeServices()
     qDebug() << "All services initialized successfully";
 }
 
+bool Application::initializeConversationStore()
+{
+    const QString backend = m_settingsStore->value("storage/backend", "json").toString();
+    if (backend != "sqlite") {
+        auto jsonStore = std::make_unique<JsonStore>(this);
+        const qint64 cacheBudgetMB = m_settingsStore->value("storage/cacheBudgetMB", 256).toLongLong();
+        jsonStore->setCacheBudget(cacheBudgetMB * 1024 * 1024);
+        if (!jsonStore->initialize(m_appDataDir)) {
+            qCritical() << "Failed to initialize JSON store";
+            return false;
+        }
+        m_conversationStore = std::move(jsonStore);
+        return true;
+    }
+
+    auto sqlStore = std::make_unique<ConversationStore>(this);
+    if (!sqlStore->initialize(m_appDataDir)) {
+        qCritical() << "Failed to initialize SQLite store";
+        return false;
+    }
+
+    // First start on SQLite: copy over whatever the JSON store holds, once
+    if (!sqlStore->hasImported()) {
+        JsonStore jsonStore;
+        if (!jsonStore.initialize(m_appDataDir) || !sqlStore->importFrom(jsonStore)) {
+            qCritical() << "Failed to migrate JSON store to SQLite";
+            return false;
+        }
+    }
+
+    m_conversationStore = std::move(sqlStore);
+    return true;
+}
+
 void Application::onThemeChanged()
 {
     // Save theme preference
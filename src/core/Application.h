@@ -1,13 +1,12 @@
 #pragma once
 
-#include "data/JsonStore.h"
+#include "data/ConversationRepository.h"
 #include <memory>
 
 namespace DesktopApp {
 
 class ThemeManager;
 class IconRegistry;
-class JsonStore;
 class SettingsStore;
 class FileVault;
 class SearchEngine;
@@ -40,7 +39,7 @@ public:
     // Service getters
     ThemeManager* themeManager() const { return m_themeManager.get(); }
     IconRegistry* iconRegistry() const { return m_iconRegistry.get(); }
-    JsonStore *conversationStore() const { return m_conversationStore.get(); }
+    ConversationRepository *conversationStore() const { return m_conversationStore.get(); }
     SettingsStore* settingsStore() const { return m_settingsStore.get(); }
     FileVault* fileVault() const { return m_fileVault.get(); }
     SearchEngine* searchEngine() const { return m_searchEngine.get(); }
@@ -63,13 +62,14 @@ private slots:
 private:
     bool initializeDirectories();
     void initializeServices();
+    bool initializeConversationStore();
 
     static Application* s_instance;
 
     // Core services
     std::unique_ptr<ThemeManager> m_themeManager;
     std::unique_ptr<IconRegistry> m_iconRegistry;
-    std::unique_ptr<JsonStore> m_conversationStore;
+    std::unique_ptr<ConversationRepository> m_conversationStore;
     std::unique_ptr<SettingsStore> m_settingsStore;
     std::unique_ptr<FileVault> m_fileVault;
     std::unique_ptr<SearchEngine> m_searchEngine;
@@ -0,0 +1,305 @@
+#include "ColdTier.h"
+#include "StorageCodec.h"
+#include "StoreJournal.h"
+#include <QDir>
+#include <QFile>
+#include <QSaveFile>
+#include <QCborStreamWriter>
+#include <QCborStreamReader>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+namespace DesktopApp {
+
+namespace {
+
+const char *kSegmentPrefix = "segment-";
+const char *kSegmentSuffix = ".cold";
+
+// Footer: [CBOR index][uint32 little-endian index length]["DACT"]
+const char kFooterMagic[4] = {'D', 'A', 'C', 'T'};
+const int kFooterSize = 8;
+
+QByteArray encodeIndex(const QHash<QString, ColdTier::Entry> &entries)
+{
+    QByteArray bytes;
+    QCborStreamWriter writer(&bytes);
+    writer.startArray(quint64(entries.size()));
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        writer.startArray(4);
+        StorageCodec::writeId(writer, it.key());
+        writer.append(qint64(it->offset));
+        writer.append(qint64(it->length));
+        writer.append(qint64(it->rawSize));
+        writer.endArray();
+    }
+    writer.endArray();
+    return bytes;
+}
+
+bool decodeIndex(const QByteArray &bytes, int segment, QHash<QString, ColdTier::Entry> &entries)
+{
+    QCborStreamReader reader(bytes);
+    if (!reader.isArray() || !reader.enterContainer()) {
+        return false;
+    }
+
+    while (reader.hasNext()) {
+        if (!reader.isArray() || !reader.enterContainer()) {
+            return false;
+        }
+        const QString conversationId = StorageCodec::readId(reader);
+        ColdTier::Entry entry;
+        entry.segment = segment;
+        qint64 *fields[] = {&entry.offset, &entry.length, &entry.rawSize};
+        for (qint64 *field : fields) {
+            if (!reader.isInteger()) {
+                return false;
+            }
+            *field = reader.toInteger();
+            reader.next();
+        }
+        while (reader.hasNext()) {
+            reader.next();
+        }
+        if (!reader.leaveContainer() || conversationId.isEmpty()) {
+            return false;
+        }
+        entries.insert(conversationId, entry);
+    }
+    return reader.leaveContainer() && reader.lastError() == QCborError::NoError;
+}
+
+bool readSegmentIndex(const QString &path, int segment, QHash<QString, ColdTier::Entry> &entries)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || file.size() < kFooterSize) {
+        return false;
+    }
+
+    file.seek(file.size() - kFooterSize);
+    const QByteArray footer = file.read(kFooterSize);
+    if (footer.size() != kFooterSize || memcmp(footer.constData() + 4, kFooterMagic, 4) != 0) {
+        return false;
+    }
+
+    const qint64 indexLength = qFromLittleEndian<quint32>(footer.constData());
+    const qint64 indexOffset = file.size() - kFooterSize - indexLength;
+    if (indexOffset < 0 || !file.seek(indexOffset)) {
+        return false;
+    }
+    return decodeIndex(file.read(indexLength), segment, entries);
+}
+
+} // namespace
+
+bool ColdTier::open(const QString &directory, const std::function<bool(const QString &)> &isLive)
+{
+    m_directory = directory;
+    m_entries.clear();
+    m_segments.clear();
+    m_lastSegment = 0;
+    if (!QDir().mkpath(directory)) {
+        qCritical() << "Failed to create cold tier directory:" << directory;
+        return false;
+    }
+
+    QList<int> segments;
+    const QStringList files = QDir(directory).entryList({QString("%1*%2").arg(kSegmentPrefix, kSegmentSuffix)}, QDir::Files);
+    for (const QString &fileName : files) {
+        QString number = fileName.mid(int(strlen(kSegmentPrefix)));
+        number.chop(int(strlen(kSegmentSuffix)));
+        bool ok = false;
+        int segment = number.toInt(&ok);
+        if (ok) {
+            segments.append(segment);
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+
+    // Later segments supersede earlier ones for the same conversation
+    for (int segment : std::as_const(segments)) {
+        m_lastSegment = segment;
+
+        QHash<QString, Entry> entries;
+        if (!readSegmentIndex(segmentPath(segment), segment, entries)) {
+            // Left on disk untouched: it is not tracked, so it is never collected
+            qWarning() << "Ignoring unreadable cold segment:" << segmentPath(segment);
+            continue;
+        }
+        m_segments.insert(segment, Segment());
+        for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+            if (isLive(it.key())) {
+                m_entries.insert(it.key(), it.value());
+            }
+        }
+    }
+
+    for (const Entry &entry : std::as_const(m_entries)) {
+        ++m_segments[entry.segment].live;
+    }
+    return true;
+}
+
+bool ColdTier::read(const QString &conversationId, QByteArray &shardBytes) const
+{
+    auto it = m_entries.constFind(conversationId);
+    if (it == m_entries.constEnd()) {
+        return false;
+    }
+    if (!readEntry(segmentPath(it->segment), it.value(), shardBytes)) {
+        qWarning() << "Damaged cold shard for conversation" << conversationId;
+        return false;
+    }
+    return true;
+}
+
+bool ColdTier::readEntry(const QString &path, const Entry &entry, QByteArray &shardBytes)
+{
+    if (entry.length == 0) {
+        shardBytes.clear();
+        return true;
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || !file.seek(entry.offset)) {
+        qWarning() << "Cannot read cold segment:" << path << file.errorString();
+        return false;
+    }
+    const QByteArray compressed = file.read(entry.length);
+    shardBytes = qUncompress(compressed);
+    return compressed.size() == entry.length && shardBytes.size() == entry.rawSize;
+}
+
+bool ColdTier::findEntry(const QString &path, const QString &conversationId, Entry &entry)
+{
+    QHash<QString, Entry> entries;
+    if (!readSegmentIndex(path, -1, entries)) {
+        return false;
+    }
+    auto it = entries.constFind(conversationId);
+    if (it == entries.constEnd()) {
+        return false;
+    }
+    entry = it.value();
+    return true;
+}
+
+void ColdTier::addSegment(const FreezeResult &result, const QStringList &liveIds)
+{
+    m_lastSegment = std::max(m_lastSegment, result.segment);
+    Segment &segment = m_segments[result.segment];
+    for (const QString &conversationId : liveIds) {
+        auto entry = result.entries.constFind(conversationId);
+        if (entry == result.entries.constEnd()) {
+            continue;
+        }
+        remove(conversationId);
+        m_entries.insert(conversationId, entry.value());
+        ++segment.live;
+    }
+    m_diskReclaimed += result.hotBytesRemoved - result.coldBytesWritten;
+}
+
+void ColdTier::remove(const QString &conversationId)
+{
+    auto it = m_entries.find(conversationId);
+    if (it == m_entries.end()) {
+        return;
+    }
+    auto segment = m_segments.find(it->segment);
+    if (segment != m_segments.end()) {
+        --segment->live;
+    }
+    m_entries.erase(it);
+}
+
+QString ColdTier::segmentPath(int segment) const
+{
+    return QDir(m_directory).filePath(QString("%1%2%3")
+                                      .arg(kSegmentPrefix)
+                                      .arg(segment, 6, 10, QChar('0'))
+                                      .arg(kSegmentSuffix));
+}
+
+QStringList ColdTier::takeDeadSegments()
+{
+    QStringList paths;
+    for (auto it = m_segments.begin(); it != m_segments.end();) {
+        if (it->live <= 0) {
+            paths.append(segmentPath(it.key()));
+            it = m_segments.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    return paths;
+}
+
+ColdTier::Stats ColdTier::stats() const
+{
+    Stats stats;
+    stats.conversations = int(m_entries.size());
+    stats.segments = int(m_segments.size());
+    for (const Entry &entry : m_entries) {
+        stats.compressedBytes += entry.length;
+        stats.uncompressedBytes += entry.rawSize;
+    }
+    stats.diskReclaimed = m_diskReclaimed;
+    return stats;
+}
+
+bool ColdTier::writeSegment(const QString &path, int segment, const QVector<FreezeJob> &jobs, FreezeResult &result)
+{
+    result = FreezeResult();
+    result.segment = segment;
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot open cold segment for writing:" << path << file.errorString();
+        return false;
+    }
+
+    qint64 offset = 0;
+    for (const FreezeJob &job : jobs) {
+        Entry entry;
+        entry.segment = segment;
+        entry.offset = offset;
+
+        QFile shard(job.shardPath);
+        if (shard.exists()) {
+            if (!shard.open(QIODevice::ReadOnly)) {
+                qWarning() << "Cannot read shard to freeze:" << job.shardPath;
+                continue;
+            }
+            const QByteArray raw = shard.readAll();
+            const QByteArray compressed = qCompress(raw, 9); // written once, read rarely
+            if (file.write(compressed) != compressed.size()) {
+                file.cancelWriting();
+                return false;
+            }
+            entry.length = compressed.size();
+            entry.rawSize = raw.size();
+            offset += compressed.size();
+        }
+        result.entries.insert(job.conversationId, entry);
+        result.hotBytesRemoved += entry.rawSize;
+    }
+
+    const QByteArray index = encodeIndex(result.entries);
+    QByteArray footer(kFooterSize, Qt::Uninitialized);
+    qToLittleEndian<quint32>(quint32(index.size()), footer.data());
+    memcpy(footer.data() + 4, kFooterMagic, 4);
+    if (file.write(index) != index.size() || file.write(footer) != footer.size()
+        || !syncToDisk(file) || !file.commit()) {
+        qWarning() << "Failed to write cold segment:" << path << file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+    result.coldBytesWritten = offset + index.size() + kFooterSize;
+    return true;
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include <QMetaType>
+#include <functional>
+
+namespace DesktopApp {
+
+/**
+ * @brief Compressed, immutable archive segments for conversations nobody is using
+ *
+ * JsonStore moves the shards of archived and long-idle conversations here.
+ * A segment file holds one qCompress()ed shard per conversation followed by
+ * an index (CBOR) and a fixed footer, so a shard is read back with a single
+ * seek. Segments are never modified: a conversation that changes again gets
+ * a regular shard file, which always takes precedence, and a segment is
+ * deleted once none of its entries is live.
+ *
+ * The index lives on the store thread; segments are written on the
+ * persistence thread with writeSegment().
+ */
+class ColdTier
+{
+public:
+    /**
+     * @brief Location of one conversation's compressed shard
+     */
+    struct Entry {
+        int segment = -1;
+        qint64 offset = 0;
+        qint64 length = 0;   // compressed bytes; 0 for a conversation without messages
+        qint64 rawSize = 0;  // size of the shard it replaced
+    };
+
+    /**
+     * @brief Shard file to move into a new segment
+     */
+    struct FreezeJob {
+        QString conversationId;
+        QString shardPath;
+    };
+
+    /**
+     * @brief Outcome of writeSegment()
+     */
+    struct FreezeResult {
+        int segment = -1;
+        QHash<QString, Entry> entries;
+        qint64 hotBytesRemoved = 0;
+        qint64 coldBytesWritten = 0;
+    };
+
+    struct Stats {
+        int conversations = 0;
+        int segments = 0;
+        qint64 compressedBytes = 0;
+        qint64 uncompressedBytes = 0;
+        qint64 memoryReclaimed = 0;  // decoded messages evicted when freezing, estimated
+        qint64 diskReclaimed = 0;    // shard bytes minus their compressed size
+    };
+
+    /**
+     * @brief Scan the segments in @p directory
+     * @param isLive Whether a segment entry for a conversation is still current
+     */
+    bool open(const QString &directory, const std::function<bool(const QString &)> &isLive);
+
+    bool contains(const QString &conversationId) const { return m_entries.contains(conversationId); }
+    Entry entry(const QString &conversationId) const { return m_entries.value(conversationId); }
+    QStringList conversationIds() const { return m_entries.keys(); }
+
+    /**
+     * @brief Decompressed shard bytes of a cold conversation
+     */
+    bool read(const QString &conversationId, QByteArray &shardBytes) const;
+
+    /**
+     * @brief Register a segment written by writeSegment(); only @p liveIds become cold
+     */
+    void addSegment(const FreezeResult &result, const QStringList &liveIds);
+
+    /**
+     * @brief Forget a conversation, e.g. because it changed and is hot again
+     */
+    void remove(const QString &conversationId);
+
+    /**
+     * @brief Number for the next segment file
+     */
+    int allocateSegment() { return ++m_lastSegment; }
+    QString segmentPath(int segment) const;
+
+    /**
+     * @brief Paths of segments without live entries; they are forgotten here
+     */
+    QStringList takeDeadSegments();
+
+    Stats stats() const;
+
+    /**
+     * @brief Compress @p jobs into a new segment file
+     *
+     * The shard files stay; the owner deletes them once it reads the
+     * conversations from the segment, since until then they are the only
+     * copy it knows about.
+     */
+    static bool writeSegment(const QString &path, int segment, const QVector<FreezeJob> &jobs, FreezeResult &result);
+
+    /**
+     * @brief Decompressed shard bytes at @p entry of the segment file at @p path
+     *
+     * Segments are immutable, so this is safe from any thread while the file exists.
+     */
+    static bool readEntry(const QString &path, const Entry &entry, QByteArray &shardBytes);
+
+    /**
+     * @brief Look up a conversation in the index of the segment file at @p path
+     */
+    static bool findEntry(const QString &path, const QString &conversationId, Entry &entry);
+
+private:
+    struct Segment {
+        int live = 0;
+    };
+
+    QString m_directory;
+    QHash<QString, Entry> m_entries;  // live entries only
+    QHash<int, Segment> m_segments;
+    int m_lastSegment = 0;
+    qint64 m_diskReclaimed = 0;
+};
+
+} // namespace DesktopApp
+
+Q_DECLARE_METATYPE(DesktopApp::ColdTier::FreezeResult)
@@ -0,0 +1,197 @@
+#include "ConversationRepository.h"
+#include "StoreSnapshot.h"
+#include <QDebug>
+#include <utility>
+
+namespace DesktopApp {
+
+namespace {
+
+// Fold one change into a batch's id sets so each id keeps only its net effect
+
+void recordCreated(QSet<QString> &created, QSet<QString> &updated, QSet<QString> &deleted, const QString &id)
+{
+    if (deleted.remove(id)) {
+        updated.insert(id); // deleted and recreated within the batch
+    } else {
+        created.insert(id);
+    }
+}
+
+void recordUpdated(const QSet<QString> &created, QSet<QString> &updated, const QString &id)
+{
+    if (!created.contains(id)) {
+        updated.insert(id);
+    }
+}
+
+void recordDeleted(QSet<QString> &created, QSet<QString> &updated, QSet<QString> &deleted, const QString &id)
+{
+    if (created.remove(id)) {
+        return; // never visible outside the batch
+    }
+    updated.remove(id);
+    deleted.insert(id);
+}
+
+} // namespace
+
+bool ChangeSet::isEmpty() const
+{
+    return !hasConversationChanges()
+        && createdMessages.isEmpty() && updatedMessages.isEmpty() && deletedMessages.isEmpty();
+}
+
+bool ChangeSet::hasConversationChanges() const
+{
+    return !createdConversations.isEmpty() || !updatedConversations.isEmpty() || !deletedConversations.isEmpty();
+}
+
+ConversationRepository::Batch::Batch(ConversationRepository *repository)
+    : m_repository(repository)
+    , m_open(true)
+{
+    m_repository->beginBatch();
+}
+
+ConversationRepository::Batch::~Batch()
+{
+    commit();
+}
+
+bool ConversationRepository::Batch::commit()
+{
+    if (!m_open) {
+        return true;
+    }
+    m_open = false;
+    return m_repository->commitBatch();
+}
+
+ConversationRepository::ConversationRepository(QObject *parent)
+    : QObject(parent)
+{
+}
+
+ConversationRepository::~ConversationRepository() = default;
+
+void ConversationRepository::beginBatch()
+{
+    if (m_batchDepth++ == 0) {
+        batchStarted();
+    }
+}
+
+bool ConversationRepository::commitBatch()
+{
+    if (m_batchDepth == 0) {
+        qWarning() << "commitBatch() called without beginBatch()";
+        return false;
+    }
+    if (--m_batchDepth > 0) {
+        return true;
+    }
+    
+    bool ok = batchFinished();
+    ChangeSet changes = std::exchange(m_pendingChanges, ChangeSet());
+    if (ok && !changes.isEmpty()) {
+        emit changesCommitted(changes);
+    }
+    return ok;
+}
+
+bool ConversationRepository::appendDraftText(const QString &messageId, const QString &text)
+{
+    Message message = getMessage(messageId);
+    if (!message.isValid()) {
+        return false;
+    }
+    message.text += text;
+    return updateMessage(message);
+}
+
+bool ConversationRepository::finishDraft(const Message &message)
+{
+    return updateMessage(message);
+}
+
+std::shared_ptr<const StoreSnapshot> ConversationRepository::snapshot() const
+{
+    auto snapshot = std::make_shared<StoreSnapshot>();
+    QHash<QString, Conversation> conversations;
+    for (const Conversation &conversation : getAllConversations()) {
+        conversations.insert(conversation.id, conversation);
+        
+        StoreSnapshot::Shard shard;
+        const MessageList messages = getMessagesForConversation(conversation.id);
+        shard.messages.reserve(messages.size());
+        shard.index.reserve(messages.size());
+        for (const Message &message : messages) {
+            shard.messages.insert(message);
+            shard.index.append({message.createdAt, Id::fromString(message.id)});
+        }
+        snapshot->addShard(conversation.id, shard);
+    }
+    snapshot->setConversations(conversations);
+    return snapshot;
+}
+
+void ConversationRepository::notifyConversationCreated(const QString &conversationId)
+{
+    if (!isBatching()) {
+        emit conversationCreated(conversationId);
+        return;
+    }
+    recordCreated(m_pendingChanges.createdConversations, m_pendingChanges.updatedConversations,
+                  m_pendingChanges.deletedConversations, conversationId);
+}
+
+void ConversationRepository::notifyConversationUpdated(const QString &conversationId)
+{
+    if (!isBatching()) {
+        emit conversationUpdated(conversationId);
+        return;
+    }
+    recordUpdated(m_pendingChanges.createdConversations, m_pendingChanges.updatedConversations, conversationId);
+}
+
+void ConversationRepository::notifyConversationDeleted(const QString &conversationId)
+{
+    if (!isBatching()) {
+        emit conversationDeleted(conversationId);
+        return;
+    }
+    recordDeleted(m_pendingChanges.createdConversations, m_pendingChanges.updatedConversations,
+                  m_pendingChanges.deletedConversations, conversationId);
+}
+
+void ConversationRepository::notifyMessageCreated(const QString &messageId)
+{
+    if (!isBatching()) {
+        emit messageCreated(messageId);
+        return;
+    }
+    recordCreated(m_pendingChanges.createdMessages, m_pendingChanges.updatedMessages,
+                  m_pendingChanges.deletedMessages, messageId);
+}
+
+void ConversationRepository::notifyMessageUpdated(const QString &messageId)
+{
+    if (!isBatching()) {
+        emit messageUpdated(messageId);
+        return;
+    }
+    recordUpdated(m_pendingChanges.createdMessages, m_pendingChanges.updatedMessages, messageId);
+}
+
+void ConversationRepository::notifyMessageDeleted(const QString &messageId)
+{
+    if (!isBatching()) {
+        emit messageDeleted(messageId);
+        return;
+    }
+    recordDeleted(m_pendingChanges.createdMessages, m_pendingChanges.updatedMessages,
+                  m_pendingChanges.deletedMessages, messageId);
+}
+
+} // namespace DesktopApp
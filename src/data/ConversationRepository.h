@@ -0,0 +1,184 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QSet>
+#include <QMetaType>
+#include "Models.h"
+#include <memory>
+
+namespace DesktopApp {
+
+class StoreSnapshot;
+
+/**
+ * @brief Ids touched by a committed batch, net of changes that cancel out
+ *
+ * An id appears in at most one set per kind: created-then-updated is
+ * reported as created, created-then-deleted not at all.
+ */
+struct ChangeSet {
+    QSet<QString> createdConversations;
+    QSet<QString> updatedConversations;
+    QSet<QString> deletedConversations;
+    QSet<QString> createdMessages;
+    QSet<QString> updatedMessages;
+    QSet<QString> deletedMessages;
+
+    bool isEmpty() const;
+    bool hasConversationChanges() const;
+};
+
+/**
+ * @brief Storage backend interface for conversations and messages
+ *
+ * Implemented by JsonStore (journaled CBOR files) and ConversationStore
+ * (SQLite). The backend is chosen with the "storage/backend" setting.
+ *
+ * Mutations made between beginBatch() and commitBatch() are persisted as one
+ * unit and reported by a single changesCommitted() signal instead of the
+ * per-record signals.
+ */
+class ConversationRepository : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Scope guard around beginBatch()/commitBatch(); commits on destruction
+     */
+    class Batch
+    {
+    public:
+        explicit Batch(ConversationRepository *repository);
+        ~Batch();
+
+        Batch(const Batch &) = delete;
+        Batch &operator=(const Batch &) = delete;
+
+        /**
+         * @brief Commit now instead of at scope exit
+         */
+        bool commit();
+
+    private:
+        ConversationRepository *m_repository;
+        bool m_open;
+    };
+
+    explicit ConversationRepository(QObject *parent = nullptr);
+    ~ConversationRepository() override;
+
+    /**
+     * @brief Start collecting mutations into a batch; batches nest
+     */
+    void beginBatch();
+
+    /**
+     * @brief Close the innermost batch; the outermost persists and notifies once
+     * @return false if the backend failed to persist the batch
+     */
+    bool commitBatch();
+
+    bool isBatching() const { return m_batchDepth > 0; }
+
+    /**
+     * @brief Open or create the store under @p dataDir
+     */
+    virtual bool initialize(const QString &dataDir) = 0;
+
+    // Conversation operations
+    virtual bool createConversation(const Conversation &conversation) = 0;
+    virtual bool updateConversation(const Conversation &conversation) = 0;
+    virtual bool deleteConversation(const QString &conversationId) = 0;
+    virtual Conversation getConversation(const QString &conversationId) const = 0;
+    virtual ConversationList getAllConversations() const = 0;
+    virtual ConversationList getRecentConversations(int limit = 100) const = 0;
+    virtual ConversationList getPinnedConversations(int limit = 100) const = 0;
+    virtual ConversationList getArchivedConversations(int limit = 100) const = 0;
+    virtual ConversationList getTrashConversations(int limit = 100) const = 0;
+
+    // Message operations
+    virtual bool createMessage(const Message &message) = 0;
+    virtual bool updateMessage(const Message &message) = 0;
+    virtual bool deleteMessage(const QString &messageId) = 0;
+    virtual Message getMessage(const QString &messageId) const = 0;
+    virtual MessageList getMessagesForConversation(const QString &conversationId) const = 0;
+    virtual int getConversationMessageCount(const QString &conversationId) const = 0;
+
+    /**
+     * @brief Message counts and text sizes, kept current as records change
+     *
+     * Reading them costs O(1) and loads no messages, so they can be polled
+     * from the GUI thread.
+     */
+    virtual StorageStats getStorageStats() const = 0;
+    virtual ConversationStats getConversationStats(const QString &conversationId) const = 0;
+
+    /**
+     * @brief Keyset pagination over a conversation's messages (oldest first)
+     * @param cursor Page boundary, exclusive; an invalid cursor starts from the
+     *        newest (before) or oldest (after) message
+     * @param limit Maximum messages in the page; <= 0 means no limit
+     */
+    virtual MessagePage getMessagesBefore(const QString &conversationId, const MessageCursor &cursor, int limit) const = 0;
+    virtual MessagePage getMessagesAfter(const QString &conversationId, const MessageCursor &cursor, int limit) const = 0;
+
+    /**
+     * @brief Streaming drafts: an assistant message whose text arrives chunk by chunk
+     *
+     * appendDraftText() adds @p text to the end of an existing message. Readers
+     * see it immediately, but the backend may persist it only at intervals and
+     * emits no per-chunk signal. finishDraft() stores the final message, ends
+     * the draft and notifies like updateMessage(). The default implementations
+     * write every chunk through updateMessage().
+     */
+    virtual bool appendDraftText(const QString &messageId, const QString &text);
+    virtual bool finishDraft(const Message &message);
+
+    /**
+     * @brief Immutable view of the current contents for readers on other threads
+     *
+     * Call on the store's thread; the result may then be read from any thread
+     * while this store keeps taking writes. The default implementation copies
+     * every conversation and message up front; backends override it with
+     * something cheaper.
+     */
+    virtual std::shared_ptr<const StoreSnapshot> snapshot() const;
+
+signals:
+    void conversationCreated(const QString &conversationId);
+    void conversationUpdated(const QString &conversationId);
+    void conversationDeleted(const QString &conversationId);
+    void messageCreated(const QString &messageId);
+    void messageUpdated(const QString &messageId);
+    void messageDeleted(const QString &messageId);
+
+    /**
+     * @brief Emitted once per committed batch, in place of the per-record signals
+     */
+    void changesCommitted(const DesktopApp::ChangeSet &changes);
+
+protected:
+    /**
+     * @brief Backend hooks around the outermost batch
+     */
+    virtual void batchStarted() {}
+    virtual bool batchFinished() { return true; }
+
+    // Backends report each applied mutation here; outside a batch the signal is emitted directly
+    void notifyConversationCreated(const QString &conversationId);
+    void notifyConversationUpdated(const QString &conversationId);
+    void notifyConversationDeleted(const QString &conversationId);
+    void notifyMessageCreated(const QString &messageId);
+    void notifyMessageUpdated(const QString &messageId);
+    void notifyMessageDeleted(const QString &messageId);
+
+private:
+    int m_batchDepth = 0;
+    ChangeSet m_pendingChanges;
+};
+
+} // namespace DesktopApp
+
+Q_DECLARE_METATYPE(DesktopApp::ChangeSet)
@@ -1,24 +1,212 @@
 #include "ConversationStore.h"
+#include "StoreSnapshot.h"
 #include <QSqlQuery>
 #include <QSqlError>
 #include <QVariant>
 #include <QJsonDocument>
+#include <QDir>
 #include <QDebug>
 #include <QSqlRecord>
+#include <QTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <limits>
+#include <memory>
 
 namespace DesktopApp {
 
-ConversationStore::ConversationStore(QSqlDatabase &database, QObject *parent)
-    : QObject(parent)
-    , m_database(database)
+namespace {
+
+const int kDraftFlushIntervalMs = 2000;        // Streaming drafts are written at most this often
+const qsizetype kDraftFlushChars = 16 * 1024;  // ...or once this much text is unsaved
+
+// Fixed column lists so rows are read by position
+const char *kConversationColumns =
+    "id, title, created_at, updated_at, pinned, archived, provider_id, model_name, metadata, deleted, sort_order";
+const char *kMessageColumns =
+    "id, conversation_id, role, text, created_at, metadata, parent_id, is_streaming, delivery_state";
+
+// Keyset predicates relative to a (created_at, id) cursor; rowid breaks timestamp ties in
+// insertion order. Bind values: created_at, created_at, id. A cursor whose message is gone
+// pages around its whole timestamp group.
+const char *kBeforeCursor =
+    "(created_at < ? OR (created_at = ? AND rowid < COALESCE((SELECT rowid FROM messages WHERE id = ?), -1)))";
+const char *kAtOrAfterCursor =
+    "(created_at > ? OR (created_at = ? AND rowid >= COALESCE((SELECT rowid FROM messages WHERE id = ?), -1)))";
+const char *kAfterCursor =
+    "(created_at > ? OR (created_at = ? AND rowid > COALESCE((SELECT rowid FROM messages WHERE id = ?), 9223372036854775807)))";
+const char *kAtOrBeforeCursor =
+    "(created_at < ? OR (created_at = ? AND rowid <= COALESCE((SELECT rowid FROM messages WHERE id = ?), 9223372036854775807)))";
+
+QJsonObject parseMetadata(const QByteArray &json)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(json, &error);
+    return error.error == QJsonParseError::NoError ? doc.object() : QJsonObject();
+}
+
+QByteArray metadataToJson(const QJsonObject &metadata)
+{
+    return QJsonDocument(metadata).toJson(QJsonDocument::Compact);
+}
+
+Conversation readConversation(const QSqlQuery &query)
+{
+    Conversation conv;
+    conv.id = query.value(0).toString();
+    conv.title = query.value(1).toString();
+    conv.createdAt = QDateTime::fromString(query.value(2).toString(), Qt::ISODate);
+    conv.updatedAt = QDateTime::fromString(query.value(3).toString(), Qt::ISODate);
+    conv.pinned = query.value(4).toBool();
+    conv.archived = query.value(5).toBool();
+    conv.providerId = query.value(6).toString();
+    conv.modelName = query.value(7).toString();
+    conv.metadata = parseMetadata(query.value(8).toByteArray());
+    conv.deleted = query.value(9).toBool();
+    conv.sortOrder = query.value(10).toInt();
+    return conv;
+}
+
+Message readMessage(const QSqlQuery &query)
+{
+    Message msg;
+    msg.id = query.value(0).toString();
+    msg.conversationId = query.value(1).toString();
+    msg.role = messageRoleFromString(query.value(2).toString());
+    msg.text = query.value(3).toString();
+    msg.createdAt = QDateTime::fromString(query.value(4).toString(), Qt::ISODate);
+    msg.metadata = parseMetadata(query.value(5).toByteArray());
+    msg.parentId = query.value(6).toString();
+    msg.isStreaming = query.value(7).toBool();
+    msg.deliveryState = messageDeliveryStateFromString(query.value(8).toString());
+    return msg;
+}
+
+/**
+ * @brief Connection of one snapshot, in a read transaction for as long as the snapshot lives
+ *
+ * In WAL mode the transaction keeps reading the database as it was at begin()
+ * while the store goes on writing; checkpoints only wait to get past it.
+ * SQLite hands its connection between threads, so readers on any thread
+ * take turns on it under the mutex.
+ */
+class SnapshotConnection
+{
+public:
+    explicit SnapshotConnection(const QString &databasePath)
+        : m_connectionName(QString("ConversationStore-snapshot-%1").arg(reinterpret_cast<quintptr>(this)))
+    {
+        m_database = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+        m_database.setDatabaseName(databasePath);
+    }
+
+    ~SnapshotConnection()
+    {
+        m_messages = QSqlQuery();
+        if (m_database.isOpen()) {
+            m_database.rollback();
+            m_database.close();
+        }
+        m_database = QSqlDatabase();
+        QSqlDatabase::removeDatabase(m_connectionName);
+    }
+
+    // The first read of the transaction fixes what it sees
+    bool begin(ConversationList &conversations)
+    {
+        if (!m_database.open() || !m_database.transaction()) {
+            qWarning() << "Failed to open snapshot connection:" << m_database.lastError().text();
+            return false;
+        }
+        QSqlQuery query(m_database);
+        if (!query.exec(QString("SELECT %1 FROM conversations ORDER BY updated_at DESC").arg(kConversationColumns))) {
+            qWarning() << "Failed to read conversations for snapshot:" << query.lastError().text();
+            return false;
+        }
+        while (query.next()) {
+            Conversation conv = readConversation(query);
+            if (conv.isValid()) {
+                conversations.append(conv);
+            }
+        }
+        m_messages = QSqlQuery(m_database);
+        return m_messages.prepare(QString("SELECT %1 FROM messages WHERE conversation_id = ? ORDER BY created_at ASC, rowid ASC")
+                                  .arg(kMessageColumns));
+    }
+
+    MessageList messages(const QString &conversationId)
+    {
+        QMutexLocker locker(&m_mutex);
+        MessageList messages;
+        m_messages.bindValue(0, conversationId);
+        if (!m_messages.exec()) {
+            qWarning() << "Snapshot query failed:" << m_messages.lastError().text();
+            return messages;
+        }
+        while (m_messages.next()) {
+            messages.append(readMessage(m_messages));
+        }
+        m_messages.finish();
+        return messages;
+    }
+
+private:
+    QMutex m_mutex;
+    QString m_connectionName;
+    QSqlDatabase m_database;
+    QSqlQuery m_messages;
+};
+
+QVariantList cursorValues(const MessageCursor &cursor)
+{
+    const QString createdAt = cursor.createdAt.toString(Qt::ISODate);
+    return {createdAt, createdAt, cursor.messageId};
+}
+
+} // namespace
+
+ConversationStore::ConversationStore(QObject *parent)
+    : ConversationRepository(parent)
+    , m_connectionName(QString("ConversationStore-%1").arg(reinterpret_cast<quintptr>(this)))
+    , m_draftTimer(new QTimer(this))
     , m_currentVersion(0)
 {
+    m_draftTimer->setSingleShot(true);
+    m_draftTimer->setInterval(kDraftFlushIntervalMs);
+    connect(m_draftTimer, &QTimer::timeout, this, &ConversationStore::flushDrafts);
 }
 
-bool ConversationStore::initialize()
+ConversationStore::~ConversationStore()
 {
-    if (!m_database.isOpen()) {
-        qCritical() << "Database is not open";
+    if (m_database.isOpen()) {
+        flushDrafts();
+    }
+    
+    // Statements and the handle must be gone before the connection can be removed
+    m_statements.clear();
+    if (m_database.isOpen()) {
+        m_database.close();
+    }
+    m_database = QSqlDatabase();
+    QSqlDatabase::removeDatabase(m_connectionName);
+}
+
+bool ConversationStore::initialize(const QString &dataDir)
+{
+    if (!QDir().mkpath(dataDir)) {
+        qCritical() << "Failed to create data directory:" << dataDir;
+        return false;
+    }
+    
+    m_database = QSqlDatabase::addDatabase("QSQLITE", m_connectionName);
+    m_database.setDatabaseName(QDir(dataDir).filePath("conversations.db"));
+    if (!m_database.open()) {
+        qCritical() << "Failed to open database:" << m_database.lastError().text();
+        return false;
+    }
+    
+    if (!configureConnection()) {
         return false;
     }
     
@@ -38,6 +226,30 @@ bool ConversationStore::initialize()
     return true;
 }
 
+bool ConversationStore::configureConnection()
+{
+    // WAL lets readers proceed during writes and turns most commits into a sequential append;
+    // NORMAL sync is durable across application crashes in WAL mode
+    QSqlQuery pragma(m_database);
+    if (!pragma.exec("PRAGMA journal_mode=WAL") || !pragma.next()
+        || pragma.value(0).toString().compare("wal", Qt::CaseInsensitive) != 0) {
+        qWarning() << "SQLite WAL mode unavailable, using the default journal";
+    }
+    
+    const QStringList settings = {
+        "PRAGMA synchronous=NORMAL",
+        "PRAGMA foreign_keys=ON",
+        "PRAGMA temp_store=MEMORY"
+    };
+    for (const QString &sql : settings) {
+        if (!pragma.exec(sql)) {
+            qCritical() << "Failed to configure database:" << sql << pragma.lastError().text();
+            return false;
+        }
+    }
+    return true;
+}
+
 bool ConversationStore::createTables()
 {
     // Check current schema version
@@ -114,6 +326,14 @@ bool ConversationStore::runMigrations()
             qDebug() << "Running migration_005_add_soft_delete_and_sort";
             success = migration_005_add_soft_delete_and_sort();
             break;
+        case 5:
+            qDebug() << "Running migration_006_add_delivery_state_and_meta";
+            success = migration_006_add_delivery_state_and_meta();
+            break;
+        case 6:
+            qDebug() << "Running migration_007_add_storage_stats";
+            success = migration_007_add_storage_stats();
+            break;
         default:
             qCritical() << "Unknown migration version:" << m_currentVersion;
             return false;
@@ -353,443 +573,661 @@ bool ConversationStore::migration_005_add_soft_delete_and_sort()
     return true;
 }
 
-// Conversation operations
-bool ConversationStore::createConversation(const Conversation &conversation)
+
+bool ConversationStore::migration_006_add_delivery_state_and_meta()
 {
-    QSqlQuery query(m_database);
+    qDebug() << "Running migration 006: Add delivery state and store metadata";
     
-    // Try the full INSERT first (11 columns)
-    qDebug() << "Attempting full INSERT with 11 columns";
-    query.prepare(R"(
-        INSERT INTO conversations (id, title, created_at, updated_at, pinned, archived, provider_id, model_name, metadata, deleted, sort_order)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
-    )");
+    QSqlQuery alter(m_database);
+    alter.prepare("ALTER TABLE messages ADD COLUMN delivery_state TEXT DEFAULT 'sent'");
+    if (!alter.exec()) {
+        qCritical() << "Migration 006: delivery_state column error:" << alter.lastError().text();
+        return false;
+    }
     
-    query.addBindValue(conversation.id);
-    query.addBindValue(conversation.title);
-    query.addBindValue(conversation.createdAt.toString(Qt::ISODate));
-    query.addBindValue(conversation.updatedAt.toString(Qt::ISODate));
-    query.addBindValue(conversation.pinned ? 1 : 0);
-    query.addBindValue(conversation.archived ? 1 : 0);
-    query.addBindValue(conversation.providerId);
-    query.addBindValue(conversation.modelName);
-    query.addBindValue(QJsonDocument(conversation.metadata).toJson(QJsonDocument::Compact));
-    query.addBindValue(conversation.deleted ? 1 : 0);
-    query.addBindValue(conversation.sortOrder);
-    
-    if (query.exec()) {
-        qDebug() << "Full INSERT succeeded";
-        emit conversationCreated(conversation.id);
-        return true;
-    }
-    
-    qWarning() << "Full INSERT failed:" << query.lastError().text();
-    
-    // Fall back to legacy INSERT (9 columns)
-    qDebug() << "Attempting legacy INSERT with 9 columns";
-    query.clear();
-    query.prepare(R"(
-        INSERT INTO conversations (id, title, created_at, updated_at, pinned, archived, provider_id, model_name, metadata)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+    QSqlQuery createMeta(m_database);
+    createMeta.prepare(R"(
+        CREATE TABLE store_meta (
+            key TEXT PRIMARY KEY,
+            value TEXT
+        )
     )");
+    if (!createMeta.exec()) {
+        qCritical() << "Failed to create store_meta table:" << createMeta.lastError().text();
+        return false;
+    }
     
-    query.addBindValue(conversation.id);
-    query.addBindValue(conversation.title);
-    query.addBindValue(conversation.createdAt.toString(Qt::ISODate));
-    query.addBindValue(conversation.updatedAt.toString(Qt::ISODate));
-    query.addBindValue(conversation.pinned ? 1 : 0);
-    query.addBindValue(conversation.archived ? 1 : 0);
-    query.addBindValue(conversation.providerId);
-    query.addBindValue(conversation.modelName);
-    query.addBindValue(QJsonDocument(conversation.metadata).toJson(QJsonDocument::Compact));
+    // Sidebar lists filter on these flags before ordering by recency
+    QSqlQuery createIndex(m_database);
+    createIndex.prepare("CREATE INDEX idx_conversations_lists ON conversations(deleted, archived, pinned, updated_at DESC)");
+    if (!createIndex.exec()) {
+        qWarning() << "Failed to create conversation list index:" << createIndex.lastError().text();
+    }
     
-    if (!query.exec()) {
-        qWarning() << "Failed to create conversation:" << query.lastError().text();
-        qWarning() << "Query:" << query.lastQuery();
+    return true;
+}
+
+bool ConversationStore::migration_007_add_storage_stats()
+{
+    qDebug() << "Running migration 007: Add storage statistics";
+    
+    // Counters kept by triggers, so reading them is a primary key lookup instead of a scan.
+    // Text sizes are UTF-8 bytes; the cascade from a deleted conversation fires the message triggers.
+    const QStringList statements = {
+        R"(CREATE TABLE conversation_stats (
+            conversation_id TEXT PRIMARY KEY,
+            message_count INTEGER NOT NULL DEFAULT 0,
+            text_bytes INTEGER NOT NULL DEFAULT 0
+        ))",
+        R"(CREATE TABLE storage_totals (
+            id INTEGER PRIMARY KEY CHECK (id = 0),
+            conversation_count INTEGER NOT NULL DEFAULT 0,
+            message_count INTEGER NOT NULL DEFAULT 0,
+            text_bytes INTEGER NOT NULL DEFAULT 0
+        ))",
+        R"(INSERT INTO conversation_stats (conversation_id, message_count, text_bytes)
+            SELECT c.id, COUNT(m.id), COALESCE(SUM(LENGTH(CAST(m.text AS BLOB))), 0)
+            FROM conversations c LEFT JOIN messages m ON m.conversation_id = c.id
+            GROUP BY c.id)",
+        R"(INSERT INTO storage_totals (id, conversation_count, message_count, text_bytes)
+            SELECT 0, (SELECT COUNT(*) FROM conversations), COALESCE(SUM(message_count), 0), COALESCE(SUM(text_bytes), 0)
+            FROM conversation_stats)",
+        R"(CREATE TRIGGER conversations_stats_insert AFTER INSERT ON conversations BEGIN
+            INSERT OR IGNORE INTO conversation_stats (conversation_id) VALUES (NEW.id);
+            UPDATE storage_totals SET conversation_count = conversation_count + 1;
+        END)",
+        R"(CREATE TRIGGER conversations_stats_delete AFTER DELETE ON conversations BEGIN
+            DELETE FROM conversation_stats WHERE conversation_id = OLD.id;
+            UPDATE storage_totals SET conversation_count = conversation_count - 1;
+        END)",
+        R"(CREATE TRIGGER messages_stats_insert AFTER INSERT ON messages BEGIN
+            UPDATE conversation_stats SET message_count = message_count + 1,
+                text_bytes = text_bytes + LENGTH(CAST(NEW.text AS BLOB))
+            WHERE conversation_id = NEW.conversation_id;
+            UPDATE storage_totals SET message_count = message_count + 1,
+                text_bytes = text_bytes + LENGTH(CAST(NEW.text AS BLOB));
+        END)",
+        R"(CREATE TRIGGER messages_stats_delete AFTER DELETE ON messages BEGIN
+            UPDATE conversation_stats SET message_count = message_count - 1,
+                text_bytes = text_bytes - LENGTH(CAST(OLD.text AS BLOB))
+            WHERE conversation_id = OLD.conversation_id;
+            UPDATE storage_totals SET message_count = message_count - 1,
+                text_bytes = text_bytes - LENGTH(CAST(OLD.text AS BLOB));
+        END)",
+        R"(CREATE TRIGGER messages_stats_update AFTER UPDATE OF conversation_id, text ON messages BEGIN
+            UPDATE conversation_stats SET message_count = message_count - 1,
+                text_bytes = text_bytes - LENGTH(CAST(OLD.text AS BLOB))
+            WHERE conversation_id = OLD.conversation_id;
+            UPDATE conversation_stats SET message_count = message_count + 1,
+                text_bytes = text_bytes + LENGTH(CAST(NEW.text AS BLOB))
+            WHERE conversation_id = NEW.conversation_id;
+            UPDATE storage_totals
+                SET text_bytes = text_bytes - LENGTH(CAST(OLD.text AS BLOB)) + LENGTH(CAST(NEW.text AS BLOB));
+        END)"
+    };
+    
+    // All or nothing, so a failed run can simply be repeated
+    if (!m_database.transaction()) {
+        qCritical() << "Migration 007: cannot start transaction:" << m_database.lastError().text();
+        return false;
+    }
+    for (const QString &sql : statements) {
+        QSqlQuery query(m_database);
+        if (!query.exec(sql)) {
+            qCritical() << "Migration 007 failed:" << query.lastError().text();
+            m_database.rollback();
+            return false;
+        }
+    }
+    return m_database.commit();
+}
+
+bool ConversationStore::hasImported() const
+{
+    QSqlQuery &query = cachedQuery("SELECT value FROM store_meta WHERE key = 'imported_at'");
+    bool imported = executeQuery(query) && query.next();
+    query.finish();
+    return imported;
+}
+
+bool ConversationStore::importFrom(const ConversationRepository &source)
+{
+    const ConversationList conversations = source.getAllConversations();
+    qDebug() << "Importing" << conversations.size() << "conversations into SQLite";
+    
+    if (!m_database.transaction()) {
+        qCritical() << "Failed to start import transaction:" << m_database.lastError().text();
+        return false;
+    }
+    
+    int messageCount = 0;
+    bool ok = true;
+    for (const Conversation &conversation : conversations) {
+        ok = writeConversation(conversation);
+        const MessageList messages = ok ? source.getMessagesForConversation(conversation.id) : MessageList();
+        for (const Message &message : messages) {
+            ok = ok && writeMessage(message);
+        }
+        if (!ok) {
+            break;
+        }
+        messageCount += messages.size();
+    }
+    
+    if (ok) {
+        QSqlQuery &mark = cachedQuery("INSERT OR REPLACE INTO store_meta (key, value) VALUES ('imported_at', ?)");
+        ok = executeQuery(mark, {QDateTime::currentDateTime().toString(Qt::ISODate)});
+    }
+    
+    if (!ok || !m_database.commit()) {
+        qCritical() << "Import failed, rolling back:" << m_database.lastError().text();
+        m_database.rollback();
+        return false;
+    }
+    
+    qDebug() << "Imported" << conversations.size() << "conversations and" << messageCount << "messages";
+    return true;
+}
+
+void ConversationStore::batchStarted()
+{
+    // A single transaction makes the batch atomic and pays for one WAL commit
+    if (!m_database.transaction()) {
+        qWarning() << "Failed to start batch transaction:" << m_database.lastError().text();
+    }
+}
+
+bool ConversationStore::batchFinished()
+{
+    if (!m_database.commit()) {
+        qCritical() << "Failed to commit batch, rolling back:" << m_database.lastError().text();
+        m_database.rollback();
+        return false;
+    }
+    return true;
+}
+
+// Conversation operations
+bool ConversationStore::writeConversation(const Conversation &conversation)
+{
+    // Upsert rather than REPLACE: a replaced row would cascade-delete its messages
+    QSqlQuery &query = cachedQuery(R"(
+        INSERT INTO conversations (id, title, created_at, updated_at, pinned, archived, provider_id, model_name, metadata, deleted, sort_order)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?)
+        ON CONFLICT(id) DO UPDATE SET
+            title = excluded.title, created_at = excluded.created_at, updated_at = excluded.updated_at,
+            pinned = excluded.pinned, archived = excluded.archived, provider_id = excluded.provider_id,
+            model_name = excluded.model_name, metadata = excluded.metadata, deleted = excluded.deleted,
+            sort_order = excluded.sort_order
+    )");
+    
+    return executeQuery(query, {
+        conversation.id,
+        conversation.title,
+        conversation.createdAt.toString(Qt::ISODate),
+        conversation.updatedAt.toString(Qt::ISODate),
+        conversation.pinned ? 1 : 0,
+        conversation.archived ? 1 : 0,
+        conversation.providerId,
+        conversation.modelName,
+        metadataToJson(conversation.metadata),
+        conversation.deleted ? 1 : 0,
+        conversation.sortOrder
+    });
+}
+
+bool ConversationStore::createConversation(const Conversation &conversation)
+{
+    if (!writeConversation(conversation)) {
+        qWarning() << "Failed to create conversation:" << conversation.id;
         return false;
     }
     
-    qDebug() << "Legacy INSERT succeeded";
-    emit conversationCreated(conversation.id);
+    notifyConversationCreated(conversation.id);
     return true;
 }
 
 bool ConversationStore::updateConversation(const Conversation &conversation)
 {
-    QSqlQuery query(m_database);
-    query.prepare(R"(
+    QSqlQuery &query = cachedQuery(R"(
         UPDATE conversations 
         SET title = ?, updated_at = ?, pinned = ?, archived = ?, provider_id = ?, model_name = ?, metadata = ?, deleted = ?, sort_order = ?
         WHERE id = ?
     )");
     
-    query.addBindValue(conversation.title);
-    query.addBindValue(conversation.updatedAt.toString(Qt::ISODate));
-    query.addBindValue(conversation.pinned ? 1 : 0);
-    query.addBindValue(conversation.archived ? 1 : 0);
-    query.addBindValue(conversation.providerId);
-    query.addBindValue(conversation.modelName);
-    query.addBindValue(QJsonDocument(conversation.metadata).toJson(QJsonDocument::Compact));
-    query.addBindValue(conversation.deleted ? 1 : 0);
-    query.addBindValue(conversation.sortOrder);
-    query.addBindValue(conversation.id);
-    
-    if (!query.exec()) {
-        qWarning() << "Failed to update conversation:" << query.lastError().text();
+    bool ok = executeQuery(query, {
+        conversation.title,
+        conversation.updatedAt.toString(Qt::ISODate),
+        conversation.pinned ? 1 : 0,
+        conversation.archived ? 1 : 0,
+        conversation.providerId,
+        conversation.modelName,
+        metadataToJson(conversation.metadata),
+        conversation.deleted ? 1 : 0,
+        conversation.sortOrder,
+        conversation.id
+    });
+    if (!ok || query.numRowsAffected() == 0) {
         return false;
     }
     
-    emit conversationUpdated(conversation.id);
+    notifyConversationUpdated(conversation.id);
     return true;
 }
 
 bool ConversationStore::deleteConversation(const QString &conversationId)
 {
-    QSqlQuery query(m_database);
-    query.prepare("DELETE FROM conversations WHERE id = ?");
-    query.addBindValue(conversationId);
-    
-    if (!query.exec()) {
-        qWarning() << "Failed to delete conversation:" << query.lastError().text();
+    // Messages go with it through ON DELETE CASCADE
+    QSqlQuery &query = cachedQuery("DELETE FROM conversations WHERE id = ?");
+    if (!executeQuery(query, {conversationId}) || query.numRowsAffected() == 0) {
         return false;
     }
+    m_drafts.removeIf([&conversationId](QHash<QString, Draft>::iterator draft) {
+        return draft->conversationId == conversationId;
+    });
     
-    emit conversationDeleted(conversationId);
+    notifyConversationDeleted(conversationId);
     return true;
 }
 
 Conversation ConversationStore::getConversation(const QString &conversationId) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM conversations WHERE id = ?");
-    query.addBindValue(conversationId);
-    
-    if (!query.exec() || !query.next()) {
+    QSqlQuery &query = cachedQuery(QString("SELECT %1 FROM conversations WHERE id = ?").arg(kConversationColumns));
+    if (!executeQuery(query, {conversationId}) || !query.next()) {
+        query.finish();
         return Conversation(); // Invalid conversation
     }
     
-    Conversation conv;
-    conv.id = query.value("id").toString();
-    conv.title = query.value("title").toString();
-    conv.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-    conv.updatedAt = QDateTime::fromString(query.value("updated_at").toString(), Qt::ISODate);
-    conv.pinned = query.value("pinned").toBool();
-    conv.archived = query.value("archived").toBool();
-    QSqlRecord rec = query.record();
-    int delIdx = rec.indexOf("deleted");
-    int sortIdx = rec.indexOf("sort_order");
-    conv.deleted = delIdx >= 0 ? query.value(delIdx).toBool() : false;
-    conv.sortOrder = sortIdx >= 0 ? query.value(sortIdx).toInt() : 0;
-    conv.providerId = query.value("provider_id").toString();
-    conv.modelName = query.value("model_name").toString();
-    
-    QJsonParseError error;
-    QJsonDocument doc = QJsonDocument::fromJson(query.value("metadata").toByteArray(), &error);
-    if (error.error == QJsonParseError::NoError) {
-        conv.metadata = doc.object();
-    }
-    
+    Conversation conv = readConversation(query);
+    query.finish();
     return conv;
 }
 
-ConversationList ConversationStore::getAllConversations() const
+ConversationList ConversationStore::selectConversations(const QString &where, const QString &orderBy, int limit) const
 {
-    return getRecentConversations(1000); // Get all with a reasonable limit
-}
-
-ConversationList ConversationStore::getRecentConversations(int limit) const
-{
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM conversations WHERE archived = 0 AND (deleted IS NULL OR deleted = 0) ORDER BY pinned DESC, sort_order ASC, updated_at DESC LIMIT ?");
-    query.addBindValue(limit);
+    QSqlQuery &query = cachedQuery(QString("SELECT %1 FROM conversations WHERE %2 ORDER BY %3 LIMIT ?")
+                                   .arg(kConversationColumns, where, orderBy));
     
     ConversationList conversations;
-    
-    if (!query.exec()) {
-        qWarning() << "Failed to get recent conversations:" << query.lastError().text();
+    if (!executeQuery(query, {limit > 0 ? limit : -1})) {
         return conversations;
     }
     
     while (query.next()) {
-        Conversation conv;
-        conv.id = query.value("id").toString();
-        conv.title = query.value("title").toString();
-        conv.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-        conv.updatedAt = QDateTime::fromString(query.value("updated_at").toString(), Qt::ISODate);
-    conv.pinned = query.value("pinned").toBool();
-    conv.archived = query.value("archived").toBool();
-    QSqlRecord r = query.record();
-    int deletedIdx = r.indexOf("deleted");
-    if (deletedIdx>=0) conv.deleted = query.value(deletedIdx).toBool();
-    int sortIdx = r.indexOf("sort_order");
-    if (sortIdx>=0) conv.sortOrder = query.value(sortIdx).toInt();
-        conv.providerId = query.value("provider_id").toString();
-        conv.modelName = query.value("model_name").toString();
-        
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(query.value("metadata").toByteArray(), &error);
-        if (error.error == QJsonParseError::NoError) {
-            conv.metadata = doc.object();
+        Conversation conv = readConversation(query);
+        if (conv.isValid()) {
+            conversations.append(conv);
         }
-        
-        conversations.append(conv);
     }
-    
+    query.finish();
     return conversations;
 }
 
+ConversationList ConversationStore::getAllConversations() const
+{
+    return selectConversations("1", "updated_at DESC", -1);
+}
+
+ConversationList ConversationStore::getRecentConversations(int limit) const
+{
+    return selectConversations("archived = 0 AND (deleted IS NULL OR deleted = 0)", "pinned DESC, updated_at DESC", limit);
+}
+
 ConversationList ConversationStore::getPinnedConversations(int limit) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM conversations WHERE pinned = 1 AND (deleted IS NULL OR deleted = 0) ORDER BY sort_order ASC, updated_at DESC LIMIT ?");
-    query.addBindValue(limit);
-    ConversationList list;
-    if (query.exec()) {
-        while (query.next()) {
-            Conversation conv;
-            conv.id = query.value("id").toString();
-            conv.title = query.value("title").toString();
-            conv.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-            conv.updatedAt = QDateTime::fromString(query.value("updated_at").toString(), Qt::ISODate);
-            conv.pinned = true;
-            conv.archived = query.value("archived").toBool();
-            QSqlRecord r = query.record();
-            int delIdx = r.indexOf("deleted"); if (delIdx>=0) conv.deleted = query.value(delIdx).toBool();
-            int sortIdx = r.indexOf("sort_order"); if (sortIdx>=0) conv.sortOrder = query.value(sortIdx).toInt();
-            list.append(conv);
-        }
-    }
-    return list;
+    return selectConversations("pinned = 1 AND (deleted IS NULL OR deleted = 0)", "sort_order ASC, updated_at DESC", limit);
 }
 
 ConversationList ConversationStore::getArchivedConversations(int limit) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM conversations WHERE archived = 1 AND (deleted IS NULL OR deleted = 0) ORDER BY updated_at DESC LIMIT ?");
-    query.addBindValue(limit);
-    ConversationList list;
-    if (query.exec()) {
-        while (query.next()) {
-            Conversation conv;
-            conv.id = query.value("id").toString();
-            conv.title = query.value("title").toString();
-            conv.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-            conv.updatedAt = QDateTime::fromString(query.value("updated_at").toString(), Qt::ISODate);
-            conv.pinned = query.value("pinned").toBool();
-            conv.archived = true;
-            QSqlRecord r = query.record();
-            int delIdx = r.indexOf("deleted"); if (delIdx>=0) conv.deleted = query.value(delIdx).toBool();
-            int sortIdx = r.indexOf("sort_order"); if (sortIdx>=0) conv.sortOrder = query.value(sortIdx).toInt();
-            list.append(conv);
-        }
-    }
-    return list;
+    return selectConversations("archived = 1 AND (deleted IS NULL OR deleted = 0)", "updated_at DESC", limit);
 }
 
 ConversationList ConversationStore::getTrashConversations(int limit) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM conversations WHERE deleted = 1 ORDER BY updated_at DESC LIMIT ?");
-    query.addBindValue(limit);
-    ConversationList list;
-    if (query.exec()) {
-        while (query.next()) {
-            Conversation conv;
-            conv.id = query.value("id").toString();
-            conv.title = query.value("title").toString();
-            conv.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-            conv.updatedAt = QDateTime::fromString(query.value("updated_at").toString(), Qt::ISODate);
-            conv.pinned = query.value("pinned").toBool();
-            conv.archived = query.value("archived").toBool();
-            conv.deleted = true;
-            QSqlRecord r = query.record();
-            int sortIdx = r.indexOf("sort_order"); if (sortIdx>=0) conv.sortOrder = query.value(sortIdx).toInt();
-            list.append(conv);
-        }
-    }
-    return list;
+    return selectConversations("deleted = 1", "updated_at DESC", limit);
 }
 
 // Message operations
-bool ConversationStore::createMessage(const Message &message)
+bool ConversationStore::writeMessage(const Message &message)
 {
-    QSqlQuery query(m_database);
-    query.prepare(R"(
-        INSERT INTO messages (id, conversation_id, role, text, created_at, metadata, parent_id, is_streaming)
-        VALUES (?, ?, ?, ?, ?, ?, ?, ?)
+    QSqlQuery &query = cachedQuery(R"(
+        INSERT INTO messages (id, conversation_id, role, text, created_at, metadata, parent_id, is_streaming, delivery_state)
+        VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)
+        ON CONFLICT(id) DO UPDATE SET
+            conversation_id = excluded.conversation_id, role = excluded.role, text = excluded.text,
+            created_at = excluded.created_at, metadata = excluded.metadata, parent_id = excluded.parent_id,
+            is_streaming = excluded.is_streaming, delivery_state = excluded.delivery_state
     )");
     
-    query.addBindValue(message.id);
-    query.addBindValue(message.conversationId);
-    query.addBindValue(messageRoleToString(message.role));
-    query.addBindValue(message.text);
-    query.addBindValue(message.createdAt.toString(Qt::ISODate));
-    query.addBindValue(QJsonDocument(message.metadata).toJson(QJsonDocument::Compact));
-    query.addBindValue(message.parentId);
-    query.addBindValue(message.isStreaming ? 1 : 0);
-    
-    if (!query.exec()) {
-        qWarning() << "Failed to create message:" << query.lastError().text();
+    return executeQuery(query, {
+        message.id,
+        message.conversationId,
+        messageRoleToString(message.role),
+        message.text,
+        message.createdAt.toString(Qt::ISODate),
+        metadataToJson(message.metadata),
+        message.parentId,
+        message.isStreaming ? 1 : 0,
+        messageDeliveryStateToString(message.deliveryState)
+    });
+}
+
+bool ConversationStore::createMessage(const Message &message)
+{
+    if (!writeMessage(message)) {
+        qWarning() << "Failed to create message:" << message.id;
         return false;
     }
     
-    emit messageCreated(message.id);
+    notifyMessageCreated(message.id);
     return true;
 }
 
 bool ConversationStore::updateMessage(const Message &message)
 {
-    QSqlQuery query(m_database);
-    query.prepare(R"(
+    QSqlQuery &query = cachedQuery(R"(
         UPDATE messages
-        SET text = ?, metadata = ?, parent_id = ?, is_streaming = ?
+        SET role = ?, text = ?, metadata = ?, parent_id = ?, is_streaming = ?, delivery_state = ?
         WHERE id = ?
     )");
-    query.addBindValue(message.text);
-    query.addBindValue(QJsonDocument(message.metadata).toJson(QJsonDocument::Compact));
-    query.addBindValue(message.parentId);
-    query.addBindValue(message.isStreaming ? 1 : 0);
-    query.addBindValue(message.id);
-    if (!query.exec()) {
-        qWarning() << "Failed to update message:" << query.lastError().text();
+    bool ok = executeQuery(query, {
+        messageRoleToString(message.role),
+        message.text,
+        metadataToJson(message.metadata),
+        message.parentId,
+        message.isStreaming ? 1 : 0,
+        messageDeliveryStateToString(message.deliveryState),
+        message.id
+    });
+    if (!ok || query.numRowsAffected() == 0) {
         return false;
     }
-    emit messageUpdated(message.id);
+    
+    // The message as given replaces any draft of it
+    m_drafts.remove(message.id);
+    notifyMessageUpdated(message.id);
     return true;
 }
 
 bool ConversationStore::deleteMessage(const QString &messageId)
 {
-    QSqlQuery query(m_database);
-    query.prepare("DELETE FROM messages WHERE id = ?");
-    query.addBindValue(messageId);
-    if (!query.exec()) {
-        qWarning() << "Failed to delete message:" << query.lastError().text();
+    QSqlQuery &query = cachedQuery("DELETE FROM messages WHERE id = ?");
+    if (!executeQuery(query, {messageId}) || query.numRowsAffected() == 0) {
         return false;
     }
-    emit messageDeleted(messageId);
+    
+    m_drafts.remove(messageId);
+    notifyMessageDeleted(messageId);
     return true;
 }
 
 MessageList ConversationStore::getMessagesForConversation(const QString &conversationId) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM messages WHERE conversation_id = ? ORDER BY created_at ASC");
-    query.addBindValue(conversationId);
+    QSqlQuery &query = cachedQuery(QString("SELECT %1 FROM messages WHERE conversation_id = ? ORDER BY created_at ASC, rowid ASC")
+                                   .arg(kMessageColumns));
     
     MessageList messages;
-    
-    if (!query.exec()) {
-        qWarning() << "Failed to get messages for conversation:" << query.lastError().text();
+    if (!executeQuery(query, {conversationId})) {
         return messages;
     }
     
     while (query.next()) {
-        Message msg;
-        msg.id = query.value("id").toString();
-        msg.conversationId = query.value("conversation_id").toString();
-        msg.role = messageRoleFromString(query.value("role").toString());
-        msg.text = query.value("text").toString();
-        msg.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-        msg.parentId = query.value("parent_id").toString();
-        msg.isStreaming = query.value("is_streaming").toBool();
-        
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(query.value("metadata").toByteArray(), &error);
-        if (error.error == QJsonParseError::NoError) {
-            msg.metadata = doc.object();
+        messages.append(withDraft(readMessage(query)));
+    }
+    query.finish();
+    return messages;
+}
+
+bool ConversationStore::appendDraftText(const QString &messageId, const QString &text)
+{
+    // The first chunk reads the message; later ones only append in memory
+    auto draft = m_drafts.find(messageId);
+    if (draft == m_drafts.end()) {
+        const Message message = getMessage(messageId);
+        if (!message.isValid()) {
+            return false;
         }
-        
-        messages.append(msg);
+        Draft created;
+        created.conversationId = message.conversationId;
+        created.text = message.text;
+        created.saved = message.text.size();
+        created.sinceFlush.start();
+        draft = m_drafts.insert(messageId, created);
     }
     
-    return messages;
+    draft->text += text;
+    if (draft->text.size() - draft->saved >= kDraftFlushChars || draft->sinceFlush.elapsed() >= kDraftFlushIntervalMs) {
+        flushDraft(messageId);
+    } else if (!m_draftTimer->isActive()) {
+        m_draftTimer->start();
+    }
+    return true;
+}
+
+bool ConversationStore::finishDraft(const Message &message)
+{
+    // The final message supersedes whatever of the draft was written
+    m_drafts.remove(message.id);
+    return updateMessage(message);
+}
+
+Message ConversationStore::withDraft(Message message) const
+{
+    auto draft = m_drafts.constFind(message.id);
+    if (draft != m_drafts.constEnd()) {
+        message.text = draft->text;
+    }
+    return message;
+}
+
+void ConversationStore::flushDraft(const QString &messageId) const
+{
+    auto draft = m_drafts.find(messageId);
+    if (draft == m_drafts.end() || draft->saved == draft->text.size()) {
+        return;
+    }
+    
+    // Rewrites the row, which costs the text so far; at intervals that stays linear in the reply
+    QSqlQuery &query = cachedQuery("UPDATE messages SET text = ? WHERE id = ?");
+    if (executeQuery(query, {draft->text, messageId})) {
+        draft->saved = draft->text.size();
+    }
+    draft->sinceFlush.restart();
+}
+
+void ConversationStore::flushDrafts() const
+{
+    const QStringList messageIds = m_drafts.keys();
+    for (const QString &messageId : messageIds) {
+        flushDraft(messageId);
+    }
+}
+
+std::shared_ptr<const StoreSnapshot> ConversationStore::snapshot() const
+{
+    // A batch in progress is visible on this connection only
+    if (isBatching()) {
+        return ConversationRepository::snapshot();
+    }
+    
+    // The snapshot's connection sees only what was written
+    flushDrafts();
+    
+    auto connection = std::make_shared<SnapshotConnection>(m_database.databaseName());
+    ConversationList conversations;
+    if (!connection->begin(conversations)) {
+        return ConversationRepository::snapshot();
+    }
+    
+    QHash<QString, Conversation> byId;
+    byId.reserve(conversations.size());
+    for (const Conversation &conversation : std::as_const(conversations)) {
+        byId.insert(conversation.id, conversation);
+    }
+    auto snapshot = std::make_shared<StoreSnapshot>();
+    snapshot->setConversations(byId);
+    snapshot->setLoader([connection](const QString &conversationId) {
+        return connection->messages(conversationId);
+    });
+    return snapshot;
 }
 
 Message ConversationStore::getMessage(const QString &messageId) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT * FROM messages WHERE id = ? LIMIT 1");
-    query.addBindValue(messageId);
-    if (!query.exec() || !query.next()) {
+    QSqlQuery &query = cachedQuery(QString("SELECT %1 FROM messages WHERE id = ?").arg(kMessageColumns));
+    if (!executeQuery(query, {messageId}) || !query.next()) {
+        query.finish();
         return Message();
     }
-    Message msg;
-    msg.id = query.value("id").toString();
-    msg.conversationId = query.value("conversation_id").toString();
-    msg.role = messageRoleFromString(query.value("role").toString());
-    msg.text = query.value("text").toString();
-    msg.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-    msg.parentId = query.value("parent_id").toString();
-    msg.isStreaming = query.value("is_streaming").toBool();
-    QJsonParseError error;
-    auto doc = QJsonDocument::fromJson(query.value("metadata").toByteArray(), &error);
-    if (error.error == QJsonParseError::NoError) {
-        msg.metadata = doc.object();
-    }
+    
+    Message msg = withDraft(readMessage(query));
+    query.finish();
     return msg;
 }
 
 MessageList ConversationStore::getRecentMessages(const QString &conversationId, int limit) const
 {
-    MessageList messages;
-    QSqlQuery query(m_database);
-    query.prepare(R"(
-        SELECT * FROM messages
-        WHERE conversation_id = ?
-        ORDER BY datetime(created_at) DESC
-        LIMIT ?
-    )");
-    query.addBindValue(conversationId);
-    query.addBindValue(limit);
-    if (!query.exec()) {
-        qWarning() << "Failed to get recent messages:" << query.lastError().text();
-        return messages;
+    return getMessagesBefore(conversationId, MessageCursor(), limit).messages;
+}
+
+MessagePage ConversationStore::getMessagesBefore(const QString &conversationId, const MessageCursor &cursor, int limit) const
+{
+    // Walk backwards from the cursor; one extra row tells whether older pages exist
+    QString sql = QString("SELECT %1 FROM messages WHERE conversation_id = ?").arg(kMessageColumns);
+    QVariantList values = {conversationId};
+    if (cursor.isValid()) {
+        sql += QString(" AND ") + kBeforeCursor;
+        values += cursorValues(cursor);
+    }
+    sql += " ORDER BY created_at DESC, rowid DESC LIMIT ?";
+    values.append(limit > 0 ? limit + 1 : -1);
+    
+    MessagePage page;
+    page.totalCount = getConversationMessageCount(conversationId);
+    
+    QSqlQuery &query = cachedQuery(sql);
+    if (!executeQuery(query, values)) {
+        return page;
     }
     while (query.next()) {
-        Message msg;
-        msg.id = query.value("id").toString();
-        msg.conversationId = query.value("conversation_id").toString();
-        msg.role = messageRoleFromString(query.value("role").toString());
-        msg.text = query.value("text").toString();
-        msg.createdAt = QDateTime::fromString(query.value("created_at").toString(), Qt::ISODate);
-        QJsonParseError parseError;
-        QJsonDocument metaDoc = QJsonDocument::fromJson(query.value("metadata").toByteArray(), &parseError);
-        if (parseError.error == QJsonParseError::NoError && metaDoc.isObject()) {
-            msg.metadata = metaDoc.object();
-        }
-        msg.parentId = query.value("parent_id").toString();
-        msg.isStreaming = query.value("is_streaming").toBool();
-        messages.append(msg);
+        page.messages.append(withDraft(readMessage(query)));
     }
-    // Return in chronological order (oldest first)
-    std::reverse(messages.begin(), messages.end());
-    return messages;
+    query.finish();
+    
+    if (limit > 0 && page.messages.size() > limit) {
+        page.messages.removeLast();
+        page.hasMoreBefore = true;
+    }
+    std::reverse(page.messages.begin(), page.messages.end());
+    page.hasMoreAfter = cursor.isValid() && hasMessages(conversationId, kAtOrAfterCursor, cursor);
+    return page;
 }
 
-// Utility methods
-int ConversationStore::getConversationMessageCount(const QString &conversationId) const
+MessagePage ConversationStore::getMessagesAfter(const QString &conversationId, const MessageCursor &cursor, int limit) const
 {
-    QSqlQuery query(m_database);
-    query.prepare("SELECT COUNT(*) FROM messages WHERE conversation_id = ?");
-    query.addBindValue(conversationId);
+    QString sql = QString("SELECT %1 FROM messages WHERE conversation_id = ?").arg(kMessageColumns);
+    QVariantList values = {conversationId};
+    if (cursor.isValid()) {
+        sql += QString(" AND ") + kAfterCursor;
+        values += cursorValues(cursor);
+    }
+    sql += " ORDER BY created_at ASC, rowid ASC LIMIT ?";
+    values.append(limit > 0 ? limit + 1 : -1);
+    
+    MessagePage page;
+    page.totalCount = getConversationMessageCount(conversationId);
     
-    if (query.exec() && query.next()) {
-        return query.value(0).toInt();
+    QSqlQuery &query = cachedQuery(sql);
+    if (!executeQuery(query, values)) {
+        return page;
+    }
+    while (query.next()) {
+        page.messages.append(withDraft(readMessage(query)));
     }
+    query.finish();
     
-    return 0;
+    if (limit > 0 && page.messages.size() > limit) {
+        page.messages.removeLast();
+        page.hasMoreAfter = true;
+    }
+    page.hasMoreBefore = cursor.isValid() && hasMessages(conversationId, kAtOrBeforeCursor, cursor);
+    return page;
+}
+
+bool ConversationStore::hasMessages(const QString &conversationId, const QString &predicate, const MessageCursor &cursor) const
+{
+    QSqlQuery &query = cachedQuery(QString("SELECT 1 FROM messages WHERE conversation_id = ? AND %1 LIMIT 1").arg(predicate));
+    QVariantList values = {conversationId};
+    values += cursorValues(cursor);
+    bool found = executeQuery(query, values) && query.next();
+    query.finish();
+    return found;
+}
+
+// Utility methods
+int ConversationStore::getConversationMessageCount(const QString &conversationId) const
+{
+    // Kept by the triggers of migration 007, so pages do not count their conversation
+    return getConversationStats(conversationId).messageCount;
 }
 
-QSqlQuery ConversationStore::prepareQuery(const QString &queryString) const
+StorageStats ConversationStore::getStorageStats() const
 {
-    QSqlQuery query(m_database);
-    query.prepare(queryString);
-    return query;
+    QSqlQuery &query = cachedQuery("SELECT conversation_count, message_count, text_bytes FROM storage_totals WHERE id = 0");
+    StorageStats stats;
+    if (executeQuery(query) && query.next()) {
+        stats.conversationCount = query.value(0).toInt();
+        stats.messageCount = query.value(1).toInt();
+        stats.textBytes = query.value(2).toLongLong();
+    }
+    query.finish();
+    return stats;
 }
 
-bool ConversationStore::executeQuery(QSqlQuery &query) const
+ConversationStats ConversationStore::getConversationStats(const QString &conversationId) const
 {
+    QSqlQuery &query = cachedQuery("SELECT message_count, text_bytes FROM conversation_stats WHERE conversation_id = ?");
+    ConversationStats stats;
+    if (executeQuery(query, {conversationId}) && query.next()) {
+        stats.messageCount = query.value(0).toInt();
+        stats.textBytes = query.value(1).toLongLong();
+    }
+    query.finish();
+    return stats;
+}
+
+qint64 ConversationStore::getTotalStorageSize() const
+{
+    QSqlQuery &query = cachedQuery("SELECT page_count * page_size FROM pragma_page_count(), pragma_page_size()");
+    qint64 size = 0;
+    if (executeQuery(query) && query.next()) {
+        size = query.value(0).toLongLong();
+    }
+    query.finish();
+    return size;
+}
+
+QSqlQuery &ConversationStore::cachedQuery(const QString &queryString) const
+{
+    auto it = m_statements.find(queryString);
+    if (it == m_statements.end()) {
+        QSqlQuery query(m_database);
+        if (!query.prepare(queryString)) {
+            qWarning() << "Failed to prepare query:" << query.lastError().text();
+            qWarning() << "Query:" << queryString;
+        }
+        it = m_statements.insert(queryString, query);
+    }
+    return it.value();
+}
+
+bool ConversationStore::executeQuery(QSqlQuery &query, const QVariantList &values) const
+{
+    for (int i = 0; i < values.size(); ++i) {
+        query.bindValue(i, values.at(i));
+    }
+    
     if (!query.exec()) {
         qWarning() << "Query execution failed:" << query.lastError().text();
         qWarning() << "Query:" << query.lastQuery();
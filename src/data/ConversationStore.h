@@ -1,48 +1,88 @@
 #pragma once
 
 #include <QObject>
+#include <QHash>
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QVariantList>
+#include <QElapsedTimer>
 #include "Models.h"
+#include "ConversationRepository.h"
+
+class QTimer;
 
 namespace DesktopApp {
 
 /**
- * @brief Database store for conversations, messages, and related data
+ * @brief SQLite store for conversations, messages, and related data
+ *
+ * Selected with the "storage/backend" = "sqlite" setting. The database runs
+ * in WAL mode and every statement is prepared once and reused.
  */
-class ConversationStore : public QObject
+class ConversationStore : public ConversationRepository
 {
     Q_OBJECT
 
 public:
-    explicit ConversationStore(QSqlDatabase &database, QObject *parent = nullptr);
+    explicit ConversationStore(QObject *parent = nullptr);
+    ~ConversationStore() override;
     
     /**
-     * @brief Initialize database tables and run migrations
+     * @brief Open <dataDir>/conversations.db, create tables and run migrations
      */
-    bool initialize();
+    bool initialize(const QString &dataDir) override;
+    
+    /**
+     * @brief One-shot bulk copy of every conversation and message from another backend
+     *
+     * Runs in a single transaction without emitting change signals, and
+     * records completion so it is not repeated.
+     */
+    bool importFrom(const ConversationRepository &source);
+    bool hasImported() const;
     
     // Conversation operations
-    bool createConversation(const Conversation &conversation);
-    bool updateConversation(const Conversation &conversation);
-    bool deleteConversation(const QString &conversationId);
-    Conversation getConversation(const QString &conversationId) const;
-    ConversationList getAllConversations() const;
-    ConversationList getRecentConversations(int limit = 50) const;
-    ConversationList getPinnedConversations(int limit = 200) const;
-    ConversationList getArchivedConversations(int limit = 200) const;
-    ConversationList getTrashConversations(int limit = 200) const; // deleted
-    ConversationList getPinnedConversations() const;
+    bool createConversation(const Conversation &conversation) override;
+    bool updateConversation(const Conversation &conversation) override;
+    bool deleteConversation(const QString &conversationId) override;
+    Conversation getConversation(const QString &conversationId) const override;
+    ConversationList getAllConversations() const override;
+    ConversationList getRecentConversations(int limit = 100) const override;
+    ConversationList getPinnedConversations(int limit = 100) const override;
+    ConversationList getArchivedConversations(int limit = 100) const override;
+    ConversationList getTrashConversations(int limit = 100) const override; // deleted
     ConversationList searchConversations(const QString &query) const;
     
     // Message operations
-    bool createMessage(const Message &message);
-    bool updateMessage(const Message &message);
-    bool deleteMessage(const QString &messageId);
-    Message getMessage(const QString &messageId) const;
-    MessageList getMessagesForConversation(const QString &conversationId) const;
+    bool createMessage(const Message &message) override;
+    bool updateMessage(const Message &message) override;
+    bool deleteMessage(const QString &messageId) override;
+    Message getMessage(const QString &messageId) const override;
+    MessageList getMessagesForConversation(const QString &conversationId) const override;
     MessageList getRecentMessages(const QString &conversationId, int limit = 100) const;
+    MessagePage getMessagesBefore(const QString &conversationId, const MessageCursor &cursor, int limit) const override;
+    MessagePage getMessagesAfter(const QString &conversationId, const MessageCursor &cursor, int limit) const override;
+    
+    /**
+     * @brief Streaming drafts are held in memory and written at intervals
+     *
+     * Reads of the message include the appended text at once; the row is
+     * rewritten every couple of seconds, or sooner once much text is unsaved,
+     * without a signal. finishDraft() writes the final message and notifies.
+     */
+    bool appendDraftText(const QString &messageId, const QString &text) override;
+    bool finishDraft(const Message &message) override;
+    
+    /**
+     * @brief Lists the conversations now; their messages are read when first asked for
+     *
+     * The snapshot reads through a connection of its own, held in a read
+     * transaction while it lives, so later writes stay out of it. Taken
+     * during a batch, it copies everything up front instead, since the
+     * batch is not committed yet.
+     */
+    std::shared_ptr<const StoreSnapshot> snapshot() const override;
     
     // Attachment operations
     bool createAttachment(const Attachment &attachment);
@@ -66,23 +106,44 @@ public:
     PromptList getPromptsInCategory(const QString &category) const;
     
     // Statistics and utilities
-    int getConversationMessageCount(const QString &conversationId) const;
-    qint64 getTotalStorageSize() const;
+    int getConversationMessageCount(const QString &conversationId) const override;
+    StorageStats getStorageStats() const override;   // maintained by triggers, see migration 007
+    ConversationStats getConversationStats(const QString &conversationId) const override;
+    qint64 getTotalStorageSize() const;              // database file, from the page count
     bool cleanupOldData(int daysToKeep = 365);
 
-signals:
-    void conversationCreated(const QString &conversationId);
-    void conversationUpdated(const QString &conversationId);
-    void conversationDeleted(const QString &conversationId);
-    void messageCreated(const QString &messageId);
-    void messageUpdated(const QString &messageId);
-    void messageDeleted(const QString &messageId);
+protected:
+    void batchStarted() override;
+    bool batchFinished() override;
 
 private:
+    bool configureConnection();
     bool createTables();
     bool runMigrations();
-    QSqlQuery prepareQuery(const QString &queryString) const;
-    bool executeQuery(QSqlQuery &query) const;
+    
+    /**
+     * @brief Prepared statement for @p queryString, prepared on first use and cached
+     */
+    QSqlQuery &cachedQuery(const QString &queryString) const;
+    bool executeQuery(QSqlQuery &query, const QVariantList &values = QVariantList()) const;
+    ConversationList selectConversations(const QString &where, const QString &orderBy, int limit) const;
+    bool hasMessages(const QString &conversationId, const QString &predicate, const MessageCursor &cursor) const;
+    bool writeConversation(const Conversation &conversation);
+    bool writeMessage(const Message &message);
+    
+    /**
+     * @brief Text of an in-flight message, of which the database holds the first saved characters
+     */
+    struct Draft {
+        QString conversationId;
+        QString text;
+        qsizetype saved = 0;
+        QElapsedTimer sinceFlush;
+    };
+    
+    Message withDraft(Message message) const;
+    void flushDraft(const QString &messageId) const;
+    void flushDrafts() const;
     
     // Migration helpers
     bool migration_001_initial_schema();
@@ -90,10 +151,16 @@ private:
     bool migration_003_add_prompts();
     bool migration_004_add_attachments();
     bool migration_005_add_soft_delete_and_sort();
+    bool migration_006_add_delivery_state_and_meta();
+    bool migration_007_add_storage_stats();
     
-    QSqlDatabase &m_database;
+    QString m_connectionName;
+    QSqlDatabase m_database;
+    mutable QHash<QString, QSqlQuery> m_statements;
+    mutable QHash<QString, Draft> m_drafts;          // messageId -> streaming draft; flushed by snapshot() too
+    QTimer *m_draftTimer;                            // writes drafts whose stream stalled
     int m_currentVersion;
-    static const int LATEST_VERSION = 5;
+    static const int LATEST_VERSION = 7;
 };
 
 } // namespace DesktopApp
@@ -0,0 +1,140 @@
+#include "Crc32c.h"
+#include <QtEndian>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define DESKTOPAPP_CRC32C_SSE42
+#include <nmmintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define DESKTOPAPP_CRC32C_ARM
+#include <arm_acle.h>
+#endif
+
+namespace DesktopApp {
+
+namespace {
+
+const quint32 kPolynomial = 0x82F63B78; // Castagnoli, reflected
+
+using Crc32cFunction = quint32 (*)(quint32, const uchar *, qsizetype);
+
+struct Tables {
+    quint32 table[8][256];
+
+    Tables()
+    {
+        for (quint32 i = 0; i < 256; ++i) {
+            quint32 crc = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                crc = (crc & 1) ? (crc >> 1) ^ kPolynomial : crc >> 1;
+            }
+            table[0][i] = crc;
+        }
+        for (int k = 1; k < 8; ++k) {
+            for (int i = 0; i < 256; ++i) {
+                table[k][i] = (table[k - 1][i] >> 8) ^ table[0][table[k - 1][i] & 0xff];
+            }
+        }
+    }
+};
+
+// Slicing-by-8: eight table lookups per 8-byte word
+quint32 crc32cSoftware(quint32 crc, const uchar *data, qsizetype size)
+{
+    static const Tables tables;
+    const auto &t = tables.table;
+
+    while (size >= 8) {
+        const quint32 low = qFromLittleEndian<quint32>(data) ^ crc;
+        const quint32 high = qFromLittleEndian<quint32>(data + 4);
+        crc = t[7][low & 0xff] ^ t[6][(low >> 8) & 0xff] ^ t[5][(low >> 16) & 0xff] ^ t[4][low >> 24]
+            ^ t[3][high & 0xff] ^ t[2][(high >> 8) & 0xff] ^ t[1][(high >> 16) & 0xff] ^ t[0][high >> 24];
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = t[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(DESKTOPAPP_CRC32C_SSE42)
+
+#if defined(__GNUC__)
+__attribute__((target("sse4.2")))
+#endif
+quint32 crc32cHardware(quint32 crc, const uchar *data, qsizetype size)
+{
+    quint64 crc64 = crc;
+    while (size >= 8) {
+        quint64 word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = quint32(crc64);
+    while (size-- > 0) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+
+bool hasHardwareCrc32c()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 20)) != 0;
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#elif defined(DESKTOPAPP_CRC32C_ARM)
+
+quint32 crc32cHardware(quint32 crc, const uchar *data, qsizetype size)
+{
+    while (size >= 8) {
+        quint64 word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+        data += 8;
+        size -= 8;
+    }
+    while (size-- > 0) {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+
+bool hasHardwareCrc32c()
+{
+    return true; // compiled for a CPU with the CRC extension
+}
+
+#endif
+
+Crc32cFunction selectImplementation()
+{
+#if defined(DESKTOPAPP_CRC32C_SSE42) || defined(DESKTOPAPP_CRC32C_ARM)
+    if (hasHardwareCrc32c()) {
+        return crc32cHardware;
+    }
+#endif
+    return crc32cSoftware;
+}
+
+} // namespace
+
+quint32 crc32c(const char *data, qsizetype size, quint32 crc)
+{
+    static const Crc32cFunction implementation = selectImplementation();
+    return ~implementation(~crc, reinterpret_cast<const uchar *>(data), size);
+}
+
+} // namespace DesktopApp
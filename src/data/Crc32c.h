@@ -0,0 +1,21 @@
+#pragma once
+
+#include <QByteArray>
+
+namespace DesktopApp {
+
+/**
+ * @brief CRC-32C (Castagnoli) of @p size bytes at @p data
+ *
+ * Uses the SSE4.2 or ARMv8 CRC instructions when the CPU has them and a
+ * table-driven implementation otherwise. Chainable: passing the checksum
+ * of a prefix as @p crc continues it over the following bytes.
+ */
+quint32 crc32c(const char *data, qsizetype size, quint32 crc = 0);
+
+inline quint32 crc32c(const QByteArray &data, quint32 crc = 0)
+{
+    return crc32c(data.constData(), data.size(), crc);
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,109 @@
+#include "Id.h"
+#include <QtEndian>
+
+namespace DesktopApp {
+
+namespace {
+
+// Namespace of the name-based ids given to text that is not a UUID
+const QUuid kTextIdNamespace("{6f1c9a52-3d0e-4b8a-9c41-2e7d5b8f0a13}");
+
+int hexValue(QChar c)
+{
+    const char16_t u = c.unicode();
+    if (u >= '0' && u <= '9') {
+        return u - '0';
+    }
+    if (u >= 'a' && u <= 'f') {
+        return u - 'a' + 10;
+    }
+    return -1; // upper case is valid UUID text but not canonical; QUuid parses it
+}
+
+/**
+ * @brief Fast path for the canonical form: 36 lower-case characters, dashes at 8, 13, 18 and 23
+ */
+bool parseCanonical(QStringView text, quint64 &high, quint64 &low)
+{
+    if (text.size() != 36) {
+        return false;
+    }
+    quint64 words[2] = {0, 0};
+    int digits = 0;
+    for (qsizetype i = 0; i < text.size(); ++i) {
+        if (i == 8 || i == 13 || i == 18 || i == 23) {
+            if (text[i] != QLatin1Char('-')) {
+                return false;
+            }
+            continue;
+        }
+        const int value = hexValue(text[i]);
+        if (value < 0) {
+            return false;
+        }
+        quint64 &word = words[digits / 16];
+        word = (word << 4) | quint64(value);
+        ++digits;
+    }
+    high = words[0];
+    low = words[1];
+    return true;
+}
+
+} // namespace
+
+Id Id::fromString(QStringView text, bool *canonical)
+{
+    Id id;
+    const bool exact = parseCanonical(text, id.m_high, id.m_low);
+    if (canonical) {
+        *canonical = exact;
+    }
+    if (exact) {
+        return id;
+    }
+
+    const QUuid uuid = QUuid::fromString(text);
+    if (!uuid.isNull()) {
+        return fromUuid(uuid);
+    }
+    if (text.isEmpty()) {
+        return Id();
+    }
+    return fromUuid(QUuid::createUuidV5(kTextIdNamespace, text.toString()));
+}
+
+Id Id::fromUuid(const QUuid &uuid)
+{
+    return fromRfc4122(uuid.toRfc4122());
+}
+
+Id Id::fromRfc4122(QByteArrayView bytes)
+{
+    Id id;
+    if (bytes.size() == 16) {
+        id.m_high = qFromBigEndian<quint64>(bytes.data());
+        id.m_low = qFromBigEndian<quint64>(bytes.data() + 8);
+    }
+    return id;
+}
+
+QString Id::toString() const
+{
+    return toUuid().toString(QUuid::WithoutBraces);
+}
+
+QUuid Id::toUuid() const
+{
+    return QUuid::fromRfc4122(toRfc4122());
+}
+
+QByteArray Id::toRfc4122() const
+{
+    QByteArray bytes(16, Qt::Uninitialized);
+    qToBigEndian<quint64>(m_high, bytes.data());
+    qToBigEndian<quint64>(m_low, bytes.data() + 8);
+    return bytes;
+}
+
+} // namespace DesktopApp
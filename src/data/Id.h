@@ -0,0 +1,61 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHashFunctions>
+#include <QString>
+#include <QStringView>
+#include <QUuid>
+
+namespace DesktopApp {
+
+/**
+ * @brief 128-bit record identifier used as a key inside the store
+ *
+ * Models and signals carry ids as UUID text; the store converts them at
+ * its boundary so its maps compare and hash two integers instead of a
+ * 36-character string. Any QUuid text form is accepted. Other text, as
+ * left by older versions or imports, maps to a name-based UUID, so equal
+ * text always gives the same Id; such ids do not convert back to their
+ * text, and callers that need it keep the original string.
+ */
+class Id
+{
+public:
+    Id() = default;
+
+    /**
+     * @brief Parse @p text; sets @p canonical when toString() gives back exactly @p text
+     */
+    static Id fromString(QStringView text, bool *canonical = nullptr);
+    static Id fromUuid(const QUuid &uuid);
+    static Id fromRfc4122(QByteArrayView bytes);
+
+    bool isNull() const { return m_high == 0 && m_low == 0; }
+
+    /**
+     * @brief Lower-case UUID text without braces, as generated for new records
+     */
+    QString toString() const;
+    QUuid toUuid() const;
+    QByteArray toRfc4122() const;
+
+    friend bool operator==(const Id &a, const Id &b) { return a.m_high == b.m_high && a.m_low == b.m_low; }
+    friend bool operator!=(const Id &a, const Id &b) { return !(a == b); }
+    friend bool operator<(const Id &a, const Id &b)
+    {
+        return a.m_high != b.m_high ? a.m_high < b.m_high : a.m_low < b.m_low;
+    }
+
+    // Random UUIDs are uniformly distributed already; fold and mix in the seed
+    friend size_t qHash(const Id &id, size_t seed = 0) noexcept
+    {
+        return QT_PREPEND_NAMESPACE(qHash)(id.m_high ^ (id.m_low * 0x9E3779B97F4A7C15ULL), seed);
+    }
+
+private:
+    quint64 m_high = 0;
+    quint64 m_low = 0;
+};
+
+} // namespace DesktopApp
@@ -1,336 +1,1411 @@
 #include "JsonStore.h"
+#include "StorageCodec.h"
 #include <QFile>
+#include <QFileInfo>
+#include <QThread>
 #include <QJsonParseError>
+#include <QCryptographicHash>
+#include <QRegularExpression>
 #include <QDebug>
+#include <algorithm>
+#include <limits>
+#include <memory>
+#include <utility>
 
 namespace DesktopApp {
 
+namespace {
+
+const int kCheckpointIntervalMs = 5 * 60 * 1000;          // Periodic compaction while the journal is non-empty
+const qint64 kCheckpointJournalBytes = 8 * 1024 * 1024;  // Compact early once the journal grows past this
+const int kColdAfterDays = 90;                            // Untouched this long, a conversation goes to the cold tier
+const int kColdScanDelayMs = 60 * 1000;                   // First freeze pass after startup
+const int kColdScanIntervalMs = 30 * 60 * 1000;           // Later freeze passes
+const qint64 kDefaultCacheBudget = 256LL * 1024 * 1024;   // Loaded conversations kept in memory
+const int kDraftFlushIntervalMs = 2000;                   // Streaming drafts are journaled at most this often
+const qsizetype kDraftFlushChars = 16 * 1024;             // ...or once this much text is unsaved
+
+bool readFile(const QString &path, QByteArray &out)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    
+    out = file.readAll();
+    return true;
+}
+
+// Keep the bytes of a damaged file at @p path, or beside an earlier copy, before it is rewritten
+bool keepDamagedCopy(const QString &path, const QByteArray &data)
+{
+    QString target = path;
+    for (int n = 1; QFile::exists(target); ++n) {
+        target = QString("%1.%2").arg(path).arg(n);
+    }
+    QFile file(target);
+    return file.open(QIODevice::WriteOnly) && file.write(data) == data.size();
+}
+
+bool readJsonFile(const QString &path, QJsonObject &out)
+{
+    QByteArray data;
+    if (!readFile(path, data)) {
+        return false;
+    }
+    
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(data, &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        qWarning() << "Failed to parse" << path << ":" << error.errorString();
+        return false;
+    }
+    
+    out = doc.object();
+    return true;
+}
+
+} // namespace
+
 JsonStore::JsonStore(QObject *parent)
-    : QObject(parent)
-    , m_autoSaveTimer(new QTimer(this))
+    : ConversationRepository(parent)
+    , m_persistenceThread(new QThread(this))
+    , m_worker(new PersistenceWorker())
+    , m_checkpointTimer(new QTimer(this))
+    , m_coldScanTimer(new QTimer(this))
+    , m_draftTimer(new QTimer(this))
 {
-    m_autoSaveTimer->setSingleShot(true);
-    m_autoSaveTimer->setInterval(1000); // Auto-save after 1 second of inactivity
-    connect(m_autoSaveTimer, &QTimer::timeout, this, &JsonStore::saveData);
+    m_cacheStats.budgetBytes = kDefaultCacheBudget;
+    m_checkpointTimer->setSingleShot(true);
+    connect(m_checkpointTimer, &QTimer::timeout, this, &JsonStore::checkpoint);
+    m_draftTimer->setSingleShot(true);
+    m_draftTimer->setInterval(kDraftFlushIntervalMs);
+    connect(m_draftTimer, &QTimer::timeout, this, &JsonStore::flushDrafts);
+    connect(m_coldScanTimer, &QTimer::timeout, this, [this]() {
+        m_coldScanTimer->setInterval(kColdScanIntervalMs);
+        checkpoint();
+    });
+    
+    // The worker has no parent so it can live on the persistence thread
+    m_worker->moveToThread(m_persistenceThread);
+    m_persistenceThread->setObjectName("JsonStorePersistence");
+    connect(m_worker, &PersistenceWorker::checkpointFinished, this, &JsonStore::onCheckpointFinished);
+    connect(m_worker, &PersistenceWorker::conversationsFrozen, this, &JsonStore::onConversationsFrozen);
 }
 
 JsonStore::~JsonStore()
 {
-    if (m_loaded) {
-        saveData();
-    }
+    // Everything else is already in the journal; let queued writes and a running checkpoint finish
+    flushDrafts();
+    m_worker->shutdown();
+    m_persistenceThread->quit();
+    m_persistenceThread->wait();
+    delete m_worker;
 }
 
 bool JsonStore::initialize(const QString &dataDir)
 {
     m_dataDir = dataDir;
-    m_conversationsFile = QDir(dataDir).filePath("conversations.json");
-    m_messagesFile = QDir(dataDir).filePath("messages.json");
+    QDir storeDir(QDir(dataDir).filePath("store"));
+    m_manifestFile = storeDir.filePath("manifest.cbor");
+    m_shardDir = storeDir.filePath("shards");
     
-    // Ensure data directory exists
+    // Ensure data directories exist
     QDir dir;
-    if (!dir.mkpath(dataDir)) {
+    if (!dir.mkpath(dataDir) || !dir.mkpath(m_shardDir)) {
         qCritical() << "Failed to create data directory:" << dataDir;
         return false;
     }
     
-    loadData();
+    const QString jsonManifest = storeDir.filePath("manifest.json");
+    if (QFile::exists(m_manifestFile)) {
+        if (!loadManifest()) {
+            return false;
+        }
+    } else if (QFile::exists(jsonManifest)) {
+        if (!migrateJsonShards(jsonManifest)) {
+            return false;
+        }
+    } else if (!migrateLegacyFiles()) {
+        return false;
+    }
+    rebuildConversationViews();
+    for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+        cacheShard(it.key(), it.value()); // everything a migration loaded
+    }
+    
+    // A shard file, when present, is newer than any cold copy of the conversation.
+    // After a damaged manifest every cold conversation is a candidate for recovery.
+    if (!m_coldTier.open(storeDir.filePath("cold"), [this](const QString &conversationId) {
+            return (m_recovering || m_conversations.contains(conversationId))
+                && !QFile::exists(shardPath(conversationId));
+        })) {
+        return false;
+    }
+    if (m_recovering) {
+        recoverConversations();
+    }
+    
+    // Bring the snapshot up to date with everything logged since the last checkpoint
+    int replayed = m_worker->openJournal(QDir(dataDir).filePath("journal"),
+                                         [this](const StoreJournal::Record &record) { applyRecord(record); });
+    if (replayed < 0) {
+        qCritical() << "Failed to open store journal in:" << dataDir;
+        return false;
+    }
+    m_unsavedRecords = replayed;
+    countMissingStats();
+    
+    m_persistenceThread->start();
     m_loaded = true;
-    qDebug() << "JsonStore initialized with" << m_conversations.size() << "conversations and" << m_messages.size() << "messages";
+    trimCache();
+    if (m_recovering) {
+        m_recovering = false;
+        m_checkpointTimer->start(0); // persist the repaired manifest
+    } else {
+        scheduleCheckpoint();
+    }
+    m_coldScanTimer->start(kColdScanDelayMs);
+    qDebug() << "JsonStore initialized with" << m_conversations.size() << "conversations ("
+             << m_shards.size() << "shards loaded)";
     return true;
 }
 
-void JsonStore::loadData()
+bool JsonStore::loadManifest()
 {
-    // Load conversations
-    QFile convFile(m_conversationsFile);
-    if (convFile.open(QIODevice::ReadOnly)) {
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(convFile.readAll(), &error);
-        if (error.error == QJsonParseError::NoError && doc.isObject()) {
-            m_conversations = doc.object();
-        }
-        convFile.close();
+    QByteArray data;
+    ConversationList conversations;
+    QHash<QString, ConversationStats> stats;
+    if (!readFile(m_manifestFile, data)) {
+        qCritical() << "Failed to load store manifest:" << m_manifestFile;
+        return false;
     }
     
-    // Load messages
-    QFile msgFile(m_messagesFile);
-    if (msgFile.open(QIODevice::ReadOnly)) {
-        QJsonParseError error;
-        QJsonDocument doc = QJsonDocument::fromJson(msgFile.readAll(), &error);
-        if (error.error == QJsonParseError::NoError && doc.isObject()) {
-            m_messages = doc.object();
-        }
-        msgFile.close();
+    // A damaged manifest keeps every record that is intact; the rest is rebuilt from the shards
+    if (!StorageCodec::decodeManifest(data, conversations, &stats)) {
+        qWarning() << "Damaged store manifest, recovering from shards:" << m_manifestFile
+                   << "(" << conversations.size() << "conversations intact )";
+        m_recovering = true;
+        m_manifestDirty = true;
+    }
+    
+    m_conversations.reserve(conversations.size());
+    for (const Conversation &conversation : std::as_const(conversations)) {
+        m_conversations.insert(conversation.id, conversation);
     }
+    for (auto it = stats.constBegin(); it != stats.constEnd(); ++it) {
+        m_storageStats.messageCount += it->messageCount;
+        m_storageStats.textBytes += it->textBytes;
+    }
+    m_conversationStats = stats;
+    return true;
 }
 
-void JsonStore::saveData()
+void JsonStore::recoverConversations()
 {
-    // Save conversations
-    QFile convFile(m_conversationsFile);
-    if (convFile.open(QIODevice::WriteOnly)) {
-        QJsonDocument doc(m_conversations);
-        convFile.write(doc.toJson());
-        convFile.close();
+    // Shards of conversations the manifest still knows need no decoding
+    QSet<QString> knownShards;
+    for (auto it = m_conversations.constBegin(); it != m_conversations.constEnd(); ++it) {
+        knownShards.insert(QFileInfo(shardPath(it.key())).fileName());
     }
     
-    // Save messages
-    QFile msgFile(m_messagesFile);
-    if (msgFile.open(QIODevice::WriteOnly)) {
-        QJsonDocument doc(m_messages);
-        msgFile.write(doc.toJson());
-        msgFile.close();
+    int recovered = 0;
+    auto recover = [this, &recovered](const QByteArray &data) {
+        MessageList messages;
+        StorageCodec::decodeShard(data, messages);
+        if (messages.isEmpty() || m_conversations.contains(messages.first().conversationId)) {
+            return;
+        }
+        
+        // Only the messages survive; the journal may still bring back the original metadata
+        Conversation conversation;
+        conversation.id = messages.first().conversationId;
+        conversation.title = "Recovered conversation";
+        conversation.createdAt = messages.first().createdAt;
+        conversation.updatedAt = messages.first().createdAt;
+        for (const Message &message : std::as_const(messages)) {
+            conversation.createdAt = std::min(conversation.createdAt, message.createdAt);
+            conversation.updatedAt = std::max(conversation.updatedAt, message.createdAt);
+        }
+        putConversation(conversation);
+        ++recovered;
+    };
+    
+    const QStringList files = QDir(m_shardDir).entryList({"*.cbor"}, QDir::Files);
+    for (const QString &fileName : files) {
+        QByteArray data;
+        if (!knownShards.contains(fileName) && readFile(QDir(m_shardDir).filePath(fileName), data)) {
+            recover(data);
+        }
     }
+    for (const QString &conversationId : m_coldTier.conversationIds()) {
+        QByteArray data;
+        if (!m_conversations.contains(conversationId) && m_coldTier.read(conversationId, data)) {
+            recover(data);
+        }
+        if (!m_conversations.contains(conversationId)) {
+            m_coldTier.remove(conversationId);
+        }
+    }
+    
+    qWarning() << "Recovered" << recovered << "conversations missing from the manifest";
 }
 
-void JsonStore::scheduleAutoSave()
+void JsonStore::countMissingStats()
 {
-    if (m_loaded) {
-        m_autoSaveTimer->start();
+    // Manifests written before stats were kept, migrations and recovered conversations;
+    // decoded once without filling the cache, then kept current incrementally
+    int counted = 0;
+    for (auto it = m_conversations.constBegin(); it != m_conversations.constEnd(); ++it) {
+        if (m_conversationStats.contains(it.key())) {
+            continue;
+        }
+        
+        auto loaded = m_shards.constFind(it.key());
+        if (loaded != m_shards.constEnd()) {
+            recordStats(it.key(), statsOf(loaded.value()));
+            continue;
+        }
+        
+        ConversationStats stats;
+        QByteArray data;
+        MessageList messages;
+        const bool cold = m_coldTier.contains(it.key());
+        if ((cold ? m_coldTier.read(it.key(), data) : readFile(shardPath(it.key()), data))
+            && !data.isEmpty()) {
+            StorageCodec::decodeShard(data, messages);
+        }
+        stats.messageCount = int(messages.size());
+        for (const Message &message : std::as_const(messages)) {
+            stats.textBytes += message.text.toUtf8().size();
+        }
+        recordStats(it.key(), stats);
+        ++counted;
+    }
+    
+    if (counted > 0) {
+        qDebug() << "Counted messages of" << counted << "conversations without stored stats";
     }
 }
 
-// Conversation operations
-bool JsonStore::createConversation(const Conversation &conversation)
+bool JsonStore::migrateLegacyFiles()
 {
-    QJsonObject convObj = conversation.toJson();
-    m_conversations[conversation.id] = convObj;
-    scheduleAutoSave();
-    emit conversationCreated(conversation.id);
+    // Single-file layout used before sharding: conversations.json + messages.json
+    const QString legacyConversations = QDir(m_dataDir).filePath("conversations.json");
+    const QString legacyMessages = QDir(m_dataDir).filePath("messages.json");
+    if (!QFile::exists(legacyConversations) && !QFile::exists(legacyMessages)) {
+        return true;
+    }
+    
+    qDebug() << "Migrating legacy JSON store to per-conversation shards";
+    QJsonObject conversations;
+    QJsonObject messages;
+    readJsonFile(legacyConversations, conversations);
+    readJsonFile(legacyMessages, messages);
+    
+    for (auto it = conversations.constBegin(); it != conversations.constEnd(); ++it) {
+        m_conversations.insert(it.key(), Conversation::fromJson(it.value().toObject()));
+    }
+    for (auto it = messages.constBegin(); it != messages.constEnd(); ++it) {
+        Message message = Message::fromJson(it.value().toObject());
+        m_shards[message.conversationId].messages.insert(message);
+        m_messageShards.insert(Id::fromString(message.id), message.conversationId);
+    }
+    
+    if (!writeMigratedStore()) {
+        qCritical() << "Failed to write migrated store; legacy files left untouched";
+        return false;
+    }
+    
+    // Keep the originals around rather than deleting user data
+    QFile::rename(legacyConversations, legacyConversations + ".migrated");
+    QFile::rename(legacyMessages, legacyMessages + ".migrated");
+    qDebug() << "Migrated" << m_conversations.size() << "conversations into" << m_shards.size() << "shards";
     return true;
 }
 
-bool JsonStore::updateConversation(const Conversation &conversation)
+bool JsonStore::migrateJsonShards(const QString &jsonManifest)
 {
-    if (!m_conversations.contains(conversation.id)) {
+    // Sharded layout with a JSON manifest and one JSON file per conversation
+    qDebug() << "Converting JSON store shards to the binary format";
+    QJsonObject manifest;
+    if (!readJsonFile(jsonManifest, manifest)) {
+        qCritical() << "Failed to load store manifest:" << jsonManifest;
+        return false;
+    }
+    const QJsonObject conversations = manifest.value("conversations").toObject();
+    
+    QStringList jsonShards;
+    for (auto it = conversations.constBegin(); it != conversations.constEnd(); ++it) {
+        m_conversations.insert(it.key(), Conversation::fromJson(it.value().toObject()));
+        
+        const QString path = shardPath(it.key(), "json");
+        QJsonObject messages;
+        if (readJsonFile(path, messages)) {
+            jsonShards.append(path);
+        }
+        Shard &loaded = m_shards[it.key()];
+        for (auto msgIt = messages.constBegin(); msgIt != messages.constEnd(); ++msgIt) {
+            const Message message = Message::fromJson(msgIt.value().toObject());
+            loaded.messages.insert(message);
+            m_messageShards.insert(Id::fromString(message.id), it.key());
+        }
+    }
+    
+    if (!writeMigratedStore()) {
+        qCritical() << "Failed to write migrated store; JSON files left untouched";
         return false;
     }
     
-    QJsonObject convObj = conversation.toJson();
-    m_conversations[conversation.id] = convObj;
-    scheduleAutoSave();
-    emit conversationUpdated(conversation.id);
+    // The binary copy is durable now; the JSON one would only go stale
+    for (const QString &path : std::as_const(jsonShards)) {
+        QFile::remove(path);
+    }
+    QFile::rename(jsonManifest, jsonManifest + ".migrated");
+    qDebug() << "Converted" << jsonShards.size() << "JSON shards";
     return true;
 }
 
-bool JsonStore::deleteConversation(const QString &conversationId)
+bool JsonStore::writeMigratedStore()
 {
-    if (!m_conversations.contains(conversationId)) {
-        return false;
+    PersistenceWorker::Snapshot job;
+    job.manifestFile = m_manifestFile;
+    job.writeManifest = true;
+    job.conversations = m_conversations;
+    for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+        rebuildMessageIndex(it.value());
+        recordStats(it.key(), statsOf(it.value()));
+        job.shards.append({it.key(), shardPath(it.key()), it->messages, false});
+    }
+    job.conversationStats = m_conversationStats;
+    return PersistenceWorker::writeSnapshot(job);
+}
+
+void JsonStore::checkpoint()
+{
+    if (!m_loaded || m_runningCheckpoint) {
+        return;
+    }
+    
+    // The shards of an open batch hold part of it; a checkpoint now would persist half
+    // the batch, so it runs once the batch commits
+    if (isBatching()) {
+        m_checkpointDeferred = true;
+        return;
     }
     
-    m_conversations.remove(conversationId);
+    // Shards are written with all draft text, so the journal must cover all of it first;
+    // otherwise a later append record would replay text the shard already holds
+    flushDrafts();
     
-    // Remove associated messages
-    QStringList messageIds;
-    for (auto it = m_messages.begin(); it != m_messages.end(); ++it) {
-        QJsonObject msgObj = it.value().toObject();
-        if (msgObj["conversationId"].toString() == conversationId) {
-            messageIds.append(it.key());
+    // Cold tier work rides along with the checkpoint so it is ordered after the shard writes.
+    // It deletes files live snapshots may still read, so it waits until they are released.
+    QVector<ColdTier::FreezeJob> freeze;
+    QStringList deadSegments;
+    if (!hasLiveSnapshots()) {
+        const QDateTime idleBefore = QDateTime::currentDateTime().addDays(-kColdAfterDays);
+        for (const Conversation &conversation : std::as_const(m_conversations)) {
+            if (isColdCandidate(conversation, idleBefore)) {
+                freeze.append({conversation.id, shardPath(conversation.id)});
+            }
         }
+        deadSegments = m_coldTier.takeDeadSegments();
+    }
+    if (m_unsavedRecords == 0 && !m_manifestDirty && freeze.isEmpty() && deadSegments.isEmpty()) {
+        return;
     }
     
-    for (const QString &msgId : messageIds) {
-        m_messages.remove(msgId);
+    // Collect only what changed. Copies are implicitly shared: cheap here,
+    // and the worker thread only reads them.
+    auto snapshot = std::make_shared<PersistenceWorker::Snapshot>();
+    snapshot->deadSegments = deadSegments;
+    if (!freeze.isEmpty()) {
+        snapshot->freeze = freeze;
+        snapshot->freezeSegment = m_coldTier.allocateSegment();
+        snapshot->freezeSegmentPath = m_coldTier.segmentPath(snapshot->freezeSegment);
     }
+    snapshot->manifestFile = m_manifestFile;
+    if (m_manifestDirty) {
+        snapshot->writeManifest = true;
+        snapshot->conversations = m_conversations;
+        snapshot->conversationStats = m_conversationStats;
+        m_manifestDirty = false;
+    }
+    for (auto it = m_shards.begin(); it != m_shards.end(); ++it) {
+        if (it->dirty) {
+            snapshot->shards.append({it.key(), shardPath(it.key()), it->messages, false});
+            m_checkpointingShards.insert(it.key());
+            it->dirty = false;
+        }
+    }
+    for (const QString &conversationId : std::as_const(m_removedShards)) {
+        snapshot->shards.append({conversationId, shardPath(conversationId), MessageArena(), true});
+    }
+    m_removedShards.clear();
     
-    scheduleAutoSave();
-    emit conversationDeleted(conversationId);
-    return true;
+    m_unsavedRecords = 0;
+    m_runningCheckpoint = snapshot;
+    m_worker->checkpoint(snapshot);
 }
 
-Conversation JsonStore::getConversation(const QString &conversationId) const
+void JsonStore::onCheckpointFinished(bool success, qint64 elapsedMs, qint64 bytesWritten)
 {
-    if (!m_conversations.contains(conversationId)) {
-        return Conversation(); // Invalid
+    std::shared_ptr<PersistenceWorker::Snapshot> snapshot = std::move(m_runningCheckpoint);
+    m_runningCheckpoint.reset();
+    m_checkpointingShards.clear();
+    
+    if (success) {
+        emit snapshotSaved(elapsedMs, bytesWritten);
+    } else if (snapshot) {
+        // Put the dirty state back so the next checkpoint retries it
+        qWarning() << "Checkpoint failed; journal segments kept for replay";
+        ++m_unsavedRecords;
+        m_manifestDirty = m_manifestDirty || snapshot->writeManifest;
+        for (const PersistenceWorker::ShardWrite &shard : std::as_const(snapshot->shards)) {
+            if (shard.remove) {
+                if (!m_conversations.contains(shard.conversationId)) {
+                    m_removedShards.insert(shard.conversationId);
+                }
+            } else {
+                auto it = m_shards.find(shard.conversationId);
+                if (it != m_shards.end()) {
+                    it->dirty = true;
+                }
+            }
+        }
     }
     
-    QJsonObject convObj = m_conversations[conversationId].toObject();
-    return Conversation::fromJson(convObj);
+    // What was just written can be unloaded now
+    trimCache();
+    scheduleCheckpoint();
 }
 
-ConversationList JsonStore::getAllConversations() const
+void JsonStore::onConversationsFrozen(const ColdTier::FreezeResult &result)
 {
-    ConversationList list;
-    for (auto it = m_conversations.begin(); it != m_conversations.end(); ++it) {
-        QJsonObject convObj = it.value().toObject();
-        Conversation conv = Conversation::fromJson(convObj);
-        if (conv.isValid()) {
-            list.append(conv);
+    // Anything deleted or changed while the segment was written stays hot
+    QStringList liveIds;
+    qint64 memoryReclaimed = 0;
+    for (auto it = result.entries.constBegin(); it != result.entries.constEnd(); ++it) {
+        const QString &conversationId = it.key();
+        if (!m_conversations.contains(conversationId) || m_removedShards.contains(conversationId)) {
+            continue;
         }
+        auto loaded = m_shards.find(conversationId);
+        if (loaded != m_shards.end()) {
+            if (loaded->dirty) {
+                continue;
+            }
+            memoryReclaimed += loaded->bytes;
+            dropShard(loaded);
+        }
+        liveIds.append(conversationId);
     }
-    return list;
+    
+    const qint64 diskBefore = m_coldTier.stats().diskReclaimed;
+    m_coldTier.addSegment(result, liveIds);
+    m_coldMemoryReclaimed += memoryReclaimed;
+    
+    // Only now does shard() read these from the segment. Shards skipped above keep their
+    // file, which the next checkpoint rewrites or removes; a file left by a crash before
+    // this point is newer than the segment as far as open() is concerned, and still right.
+    for (const QString &conversationId : std::as_const(liveIds)) {
+        QFile::remove(shardPath(conversationId));
+    }
+    
+    const qint64 diskReclaimed = m_coldTier.stats().diskReclaimed - diskBefore;
+    qDebug() << "Moved" << liveIds.size() << "conversations to the cold tier, reclaimed"
+             << memoryReclaimed << "bytes of memory and" << diskReclaimed << "bytes of disk";
+    emit coldTierUpdated(int(liveIds.size()), memoryReclaimed, diskReclaimed);
 }
 
-ConversationList JsonStore::getRecentConversations(int limit) const
+void JsonStore::scheduleCheckpoint()
+{
+    if (!m_loaded || m_unsavedRecords == 0) {
+        return;
+    }
+    
+    if (m_worker->journalSize() >= kCheckpointJournalBytes) {
+        m_checkpointTimer->start(0);
+    } else if (!m_checkpointTimer->isActive()) {
+        m_checkpointTimer->start(kCheckpointIntervalMs);
+    }
+}
+
+void JsonStore::logRecord(const StoreJournal::Record &record)
+{
+    if (isBatching()) {
+        m_batchRecords.append(record);
+        return;
+    }
+    
+    m_worker->append(record);
+    ++m_unsavedRecords;
+    scheduleCheckpoint();
+}
+
+void JsonStore::flushDraft(const QString &messageId)
+{
+    auto draft = m_drafts.find(messageId);
+    if (draft == m_drafts.end() || draft->unsaved.isEmpty()) {
+        return;
+    }
+    
+    StoreJournal::Record record;
+    record.operation = StoreJournal::Operation::Append;
+    record.id = messageId;
+    record.conversationId = draft->conversationId;
+    record.text = std::exchange(draft->unsaved, QString());
+    draft->sinceFlush.restart();
+    
+    // The next checkpoint writes the text into the shard before dropping this record
+    shard(record.conversationId).dirty = true;
+    logRecord(record);
+}
+
+void JsonStore::flushDrafts()
+{
+    const QStringList messageIds = m_drafts.keys();
+    for (const QString &messageId : messageIds) {
+        flushDraft(messageId);
+    }
+}
+
+bool JsonStore::batchFinished()
+{
+    // One journal frame and one checkpoint schedule for the whole batch
+    if (!m_batchRecords.isEmpty()) {
+        m_unsavedRecords += m_batchRecords.size();
+        m_worker->appendBatch(std::exchange(m_batchRecords, QVector<StoreJournal::Record>()));
+        scheduleCheckpoint();
+    }
+    if (std::exchange(m_checkpointDeferred, false)) {
+        checkpoint();
+    }
+    return true;
+}
+
+JsonStore::Shard &JsonStore::shard(const QString &conversationId) const
 {
-    ConversationList all = getAllConversations();
+    auto it = m_shards.find(conversationId);
+    if (it != m_shards.end()) {
+        ++m_cacheStats.hits;
+        m_lru.splice(m_lru.begin(), m_lru, it->lruPosition);
+        return it.value();
+    }
+    ++m_cacheStats.misses;
     
-    // Filter non-archived, non-deleted
-    ConversationList filtered;
-    for (const Conversation &conv : all) {
-        if (!conv.archived && !conv.deleted) {
-            filtered.append(conv);
+    // Conversations that are gone (or never existed) start empty; their file,
+    // if any, is stale and removed by the next checkpoint. Cold conversations
+    // are rehydrated from their compressed segment.
+    Shard loaded;
+    QByteArray data;
+    const bool cold = m_coldTier.contains(conversationId);
+    if (m_conversations.contains(conversationId) && !m_removedShards.contains(conversationId)
+        && (cold ? m_coldTier.read(conversationId, data) : readFile(shardPath(conversationId), data))
+        && !data.isEmpty()) {
+        MessageList messages;
+        if (!StorageCodec::decodeShard(data, messages)) {
+            // Rewritten from the intact records at the next checkpoint only once the damaged
+            // bytes are safe; otherwise the file stays as it is until the conversation changes
+            const QString copy = shardPath(conversationId, "damaged");
+            if (keepDamagedCopy(copy, data)) {
+                qWarning() << "Damaged shard, loading what could be read, original kept in" << copy;
+                loaded.dirty = true;
+                m_manifestDirty = true;
+            } else {
+                qWarning() << "Damaged shard, loading what could be read:" << shardPath(conversationId);
+            }
         }
+        loaded.messages.reserve(messages.size());
+        for (const Message &message : std::as_const(messages)) {
+            loaded.messages.insert(message);
+        }
+        recordStats(conversationId, statsOf(loaded)); // no-op unless the file lost records
+    }
+    rebuildMessageIndex(loaded);
+    for (auto msgIt = loaded.messages.constBegin(); msgIt != loaded.messages.constEnd(); ++msgIt) {
+        m_messageShards.insert(msgIt.key(), conversationId);
     }
+    handOverShard(conversationId, loaded); // still exactly what is on disk
     
-    // Sort by pinned first, then by updated time
-    std::sort(filtered.begin(), filtered.end(), [](const Conversation &a, const Conversation &b) {
-        if (a.pinned != b.pinned) return a.pinned > b.pinned;
-        return a.updatedAt > b.updatedAt;
+    // The new shard is the most recent, so trimming never unloads it; callers
+    // hold no references to other shards across this call
+    Shard &inserted = m_shards.insert(conversationId, loaded).value();
+    cacheShard(conversationId, inserted);
+    trimCache();
+    return m_shards[conversationId];
+}
+
+JsonStore::Shard *JsonStore::shardForMessage(const QString &messageId) const
+{
+    const Id id = Id::fromString(messageId);
+    auto convIt = m_messageShards.constFind(id);
+    if (convIt != m_messageShards.constEnd()) {
+        return &shard(convIt.value());
+    }
+    
+    // Unloading forgets a shard's messages, so the owner may be on disk only
+    const QString owner = findUnloadedOwner(id);
+    return owner.isEmpty() ? nullptr : &shard(owner);
+}
+
+QString JsonStore::findUnloadedOwner(const Id &messageId) const
+{
+    // Lookups by id alone are mostly for messages that just changed, so the most
+    // recently updated conversations are read first; the files are read without
+    // loading them, and only the owner found joins the cache
+    QVector<const Conversation *> candidates;
+    for (const Conversation &conversation : m_conversations) {
+        if (!m_shards.contains(conversation.id) && !m_removedShards.contains(conversation.id)
+            && m_conversationStats.value(conversation.id).messageCount > 0) {
+            candidates.append(&conversation);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Conversation *a, const Conversation *b) {
+        return a->updatedAt > b->updatedAt;
     });
     
-    if (limit > 0 && filtered.size() > limit) {
-        filtered = filtered.mid(0, limit);
+    for (const Conversation *conversation : std::as_const(candidates)) {
+        QByteArray data;
+        const bool read = m_coldTier.contains(conversation->id) ? m_coldTier.read(conversation->id, data)
+                                                                : readFile(shardPath(conversation->id), data);
+        if (!read || data.isEmpty()) {
+            continue;
+        }
+        MessageList messages;
+        StorageCodec::decodeShard(data, messages); // a damaged file still yields its good records
+        for (const Message &message : std::as_const(messages)) {
+            if (Id::fromString(message.id) == messageId) {
+                return conversation->id;
+            }
+        }
+    }
+    return QString();
+}
+
+bool JsonStore::isColdCandidate(const Conversation &conversation, const QDateTime &idleBefore) const
+{
+    if (!conversation.archived && conversation.updatedAt >= idleBefore) {
+        return false;
+    }
+    if (m_coldTier.contains(conversation.id) || m_removedShards.contains(conversation.id)) {
+        return false;
     }
     
-    return filtered;
+    // Changes not yet written would be lost from the frozen copy; try again later
+    auto loaded = m_shards.constFind(conversation.id);
+    return loaded == m_shards.constEnd() || !loaded->dirty;
 }
 
-ConversationList JsonStore::getPinnedConversations(int limit) const
+ColdTier::Stats JsonStore::coldTierStats() const
+{
+    ColdTier::Stats stats = m_coldTier.stats();
+    stats.memoryReclaimed = m_coldMemoryReclaimed;
+    return stats;
+}
+
+void JsonStore::cacheShard(const QString &conversationId, Shard &shard) const
+{
+    shard.bytes = shard.messages.memoryBytes();
+    m_cacheStats.residentBytes += shard.bytes;
+    shard.lruPosition = m_lru.insert(m_lru.begin(), conversationId);
+}
+
+void JsonStore::accountBytes(Shard &shard) const
+{
+    // The arena keeps running totals, so re-estimating after each change is cheap
+    const qint64 bytes = shard.messages.memoryBytes();
+    m_cacheStats.residentBytes += bytes - shard.bytes;
+    shard.bytes = bytes;
+}
+
+ConversationStats JsonStore::statsOf(const Shard &shard)
+{
+    ConversationStats stats;
+    stats.messageCount = static_cast<int>(shard.messages.size());
+    stats.textBytes = shard.messages.textBytes();
+    return stats;
+}
+
+void JsonStore::recordStats(const QString &conversationId, const ConversationStats &stats) const
+{
+    ConversationStats &current = m_conversationStats[conversationId];
+    if (current.messageCount == stats.messageCount && current.textBytes == stats.textBytes) {
+        return;
+    }
+    m_storageStats.messageCount += stats.messageCount - current.messageCount;
+    m_storageStats.textBytes += stats.textBytes - current.textBytes;
+    current = stats;
+    m_manifestDirty = true;
+}
+
+void JsonStore::dropStats(const QString &conversationId)
+{
+    auto it = m_conversationStats.find(conversationId);
+    if (it == m_conversationStats.end()) {
+        return;
+    }
+    m_storageStats.messageCount -= it->messageCount;
+    m_storageStats.textBytes -= it->textBytes;
+    m_conversationStats.erase(it);
+}
+
+void JsonStore::dropShard(QHash<QString, Shard>::iterator it) const
+{
+    for (const MessageIndexEntry &entry : std::as_const(it->index)) {
+        m_messageShards.remove(entry.messageId);
+    }
+    m_cacheStats.residentBytes -= it->bytes;
+    m_lru.erase(it->lruPosition);
+    m_shards.erase(it);
+}
+
+bool JsonStore::isEvictable(const QString &conversationId, const Shard &shard) const
+{
+    // Unloading is only safe when the files on disk hold exactly what is in memory
+    if (shard.dirty || m_checkpointingShards.contains(conversationId)) {
+        return false;
+    }
+    for (const Draft &draft : std::as_const(m_drafts)) {
+        if (draft.conversationId == conversationId) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void JsonStore::trimCache() const
+{
+    // Walk from the least recently used end; the most recent shard always stays
+    auto position = m_lru.end();
+    while (m_cacheStats.residentBytes > m_cacheStats.budgetBytes
+           && position != m_lru.begin()) {
+        --position;
+        if (position == m_lru.begin()) {
+            break;
+        }
+        auto it = m_shards.find(*position);
+        if (it == m_shards.end() || !isEvictable(it.key(), it.value())) {
+            continue;
+        }
+        ++position; // dropShard() erases the list node under the cursor
+        dropShard(it);
+        ++m_cacheStats.evictions;
+    }
+}
+
+void JsonStore::setCacheBudget(qint64 bytes)
+{
+    m_cacheStats.budgetBytes = bytes;
+    trimCache();
+}
+
+bool JsonStore::hasLiveSnapshots() const
 {
-    ConversationList all = getAllConversations();
+    m_snapshots.erase(std::remove_if(m_snapshots.begin(), m_snapshots.end(),
+                                     [](const std::weak_ptr<const StoreSnapshot> &snapshot) {
+        return snapshot.expired();
+    }), m_snapshots.end());
+    return !m_snapshots.empty();
+}
+
+void JsonStore::handOverShard(const QString &conversationId, const Shard &shard) const
+{
+    for (const std::weak_ptr<const StoreSnapshot> &weak : m_snapshots) {
+        std::shared_ptr<const StoreSnapshot> snapshot = weak.lock();
+        if (snapshot && snapshot->needsShard(conversationId)) {
+            snapshot->provideShard(conversationId, {shard.messages, shard.index});
+        }
+    }
+}
+
+std::shared_ptr<const StoreSnapshot> JsonStore::snapshot() const
+{
+    // Nothing changed since the newest snapshot: share it
+    if (hasLiveSnapshots()) {
+        std::shared_ptr<const StoreSnapshot> newest = m_snapshots.back().lock();
+        if (newest && newest->version() == m_version) {
+            return newest;
+        }
+    }
+    
+    // Shards being frozen right now may lose their file before a reader gets to them
+    QSet<QString> freezing;
+    QString freezeSegmentPath;
+    if (m_runningCheckpoint) {
+        freezeSegmentPath = m_runningCheckpoint->freezeSegmentPath;
+        for (const ColdTier::FreezeJob &job : std::as_const(m_runningCheckpoint->freeze)) {
+            freezing.insert(job.conversationId);
+        }
+    }
     
-    ConversationList filtered;
-    for (const Conversation &conv : all) {
-        if (conv.pinned && !conv.deleted) {
-            filtered.append(conv);
+    auto snapshot = std::make_shared<StoreSnapshot>(m_version);
+    snapshot->setConversations(m_conversations);
+    for (auto it = m_conversations.constBegin(); it != m_conversations.constEnd(); ++it) {
+        const QString &conversationId = it.key();
+        auto loaded = m_shards.constFind(conversationId);
+        if (loaded != m_shards.constEnd()) {
+            snapshot->addShard(conversationId, {loaded->messages, loaded->index});
+        } else if (m_removedShards.contains(conversationId)) {
+            snapshot->addShard(conversationId, StoreSnapshot::Shard());
+        } else {
+            StoreSnapshot::ShardSource source;
+            source.shardPath = shardPath(conversationId);
+            if (m_coldTier.contains(conversationId)) {
+                source.coldEntry = m_coldTier.entry(conversationId);
+                source.coldSegmentPath = m_coldTier.segmentPath(source.coldEntry.segment);
+            } else if (freezing.contains(conversationId)) {
+                source.coldSegmentPath = freezeSegmentPath;
+            }
+            snapshot->addSource(conversationId, source);
+        }
+    }
+    
+    m_snapshots.push_back(snapshot);
+    return snapshot;
+}
+
+JsonStore::CacheStats JsonStore::cacheStats() const
+{
+    CacheStats stats = m_cacheStats;
+    stats.residentConversations = int(m_shards.size());
+    for (const Shard &loaded : std::as_const(m_shards)) {
+        stats.textBytes += loaded.messages.textBytes();
+        stats.utf16TextBytes += loaded.messages.utf16TextBytes();
+    }
+    return stats;
+}
+
+QString JsonStore::shardPath(const QString &conversationId, const char *extension) const
+{
+    // Ids are UUIDs in practice; anything else is hashed into a safe file name
+    static const QRegularExpression safeId("^[A-Za-z0-9_-]+$");
+    QString name = safeId.match(conversationId).hasMatch()
+        ? conversationId
+        : QString::fromLatin1(QCryptographicHash::hash(conversationId.toUtf8(), QCryptographicHash::Sha1).toHex());
+    return QDir(m_shardDir).filePath(name + '.' + QLatin1String(extension));
+}
+
+void JsonStore::applyRecord(const StoreJournal::Record &record)
+{
+    const bool isPut = record.operation == StoreJournal::Operation::Put;
+    if (record.type == StoreJournal::RecordType::Conversation) {
+        if (isPut) {
+            putConversation(record.conversation);
+        } else {
+            removeConversation(record.id);
+        }
+    } else {
+        if (record.operation == StoreJournal::Operation::Append) {
+            appendMessageText(record.id, record.conversationId, record.text);
+        } else if (isPut) {
+            putMessage(record.message);
+        } else {
+            removeMessage(record.id, record.conversationId);
         }
     }
+}
+
+void JsonStore::putConversation(const Conversation &conversation)
+{
+    auto existing = m_conversations.constFind(conversation.id);
+    if (existing != m_conversations.constEnd()) {
+        unindexConversation(existing.value());
+    }
+    m_conversations.insert(conversation.id, conversation);
+    indexConversation(conversation);
+    m_removedShards.remove(conversation.id);
+    m_manifestDirty = true;
+    ++m_version;
+}
+
+void JsonStore::removeConversation(const QString &conversationId)
+{
+    // Its files go away with the next checkpoint; loading hands live snapshots their copy
+    if (!m_shards.contains(conversationId) && hasLiveSnapshots()) {
+        shard(conversationId);
+    }
+    
+    auto existing = m_conversations.constFind(conversationId);
+    if (existing != m_conversations.constEnd()) {
+        unindexConversation(existing.value());
+        m_conversations.erase(existing);
+    }
+    m_manifestDirty = true;
     
-    std::sort(filtered.begin(), filtered.end(), [](const Conversation &a, const Conversation &b) {
-        if (a.sortOrder != b.sortOrder) return a.sortOrder < b.sortOrder;
-        return a.updatedAt > b.updatedAt;
+    // Remove associated messages; only a loaded shard has them in m_messageShards
+    auto it = m_shards.find(conversationId);
+    if (it != m_shards.end()) {
+        dropShard(it);
+    }
+    m_drafts.removeIf([&conversationId](QHash<QString, Draft>::iterator draft) {
+        return draft->conversationId == conversationId;
     });
+    dropStats(conversationId);
+    m_removedShards.insert(conversationId);
+    m_coldTier.remove(conversationId);
+    ++m_version;
+}
+
+void JsonStore::putMessage(const Message &message)
+{
+    // A message that moved to another conversation leaves its old shard first
+    const Id id = Id::fromString(message.id);
+    const QString previousConversationId = m_messageShards.value(id);
+    if (!previousConversationId.isEmpty() && previousConversationId != message.conversationId) {
+        removeMessage(message.id, previousConversationId);
+    }
     
-    if (limit > 0 && filtered.size() > limit) {
-        filtered = filtered.mid(0, limit);
+    Shard &target = shard(message.conversationId);
+    auto existing = target.messages.constFind(id);
+    if (existing == target.messages.constEnd()) {
+        indexMessage(target, message.createdAt, id);
+    } else if (existing->header.createdAt != message.createdAt) {
+        // Only reposition the index entry when the ordering key actually changed
+        unindexMessage(target, id);
+        indexMessage(target, message.createdAt, id);
     }
+    target.messages.insert(message);
+    accountBytes(target);
+    recordStats(message.conversationId, statsOf(target));
     
-    return filtered;
+    target.dirty = true;
+    m_coldTier.remove(message.conversationId); // hot again once written
+    m_messageShards.insert(id, message.conversationId);
+    ++m_version;
 }
 
-ConversationList JsonStore::getArchivedConversations(int limit) const
+void JsonStore::removeMessage(const QString &messageId, const QString &conversationId)
 {
-    ConversationList all = getAllConversations();
+    // Journal records carry the conversation, so replay can reach unloaded shards
+    const Id id = Id::fromString(messageId);
+    const QString owner = m_messageShards.value(id, conversationId);
+    if (owner.isEmpty()) {
+        return;
+    }
     
-    ConversationList filtered;
-    for (const Conversation &conv : all) {
-        if (conv.archived && !conv.deleted) {
-            filtered.append(conv);
-        }
+    Shard &target = shard(owner);
+    if (target.messages.remove(id)) {
+        accountBytes(target);
+        recordStats(owner, statsOf(target));
+        unindexMessage(target, id);
+        target.dirty = true;
+        m_coldTier.remove(owner);
+        ++m_version;
+    }
+    m_messageShards.remove(id);
+    m_drafts.remove(messageId);
+}
+
+void JsonStore::appendMessageText(const QString &messageId, const QString &conversationId, const QString &text)
+{
+    Shard &target = shard(conversationId);
+    if (!target.messages.appendText(Id::fromString(messageId), text)) {
+        return;
     }
     
-    std::sort(filtered.begin(), filtered.end(), [](const Conversation &a, const Conversation &b) {
-        return a.updatedAt > b.updatedAt;
-    });
+    accountBytes(target);
+    recordStats(conversationId, statsOf(target));
+    target.dirty = true;
+    m_coldTier.remove(conversationId);
+    ++m_version;
+}
+
+bool JsonStore::inView(ConversationView view, const Conversation &conversation)
+{
+    if (!conversation.isValid()) {
+        return false;
+    }
     
-    if (limit > 0 && filtered.size() > limit) {
-        filtered = filtered.mid(0, limit);
+    switch (view) {
+    case RecentView: return !conversation.archived && !conversation.deleted;
+    case PinnedView: return conversation.pinned && !conversation.deleted;
+    case ArchivedView: return conversation.archived && !conversation.deleted;
+    case TrashView: return conversation.deleted;
+    default: return false;
     }
+}
+
+JsonStore::ViewKey JsonStore::viewKey(ConversationView view, const Conversation &conversation)
+{
+    // Newest first; conversations without a timestamp sort last
+    const qint64 newest = conversation.updatedAt.isValid()
+        ? -conversation.updatedAt.toMSecsSinceEpoch()
+        : std::numeric_limits<qint64>::max();
     
-    return filtered;
+    switch (view) {
+    case RecentView: return {conversation.pinned ? 0 : 1, newest, conversation.id};
+    case PinnedView: return {conversation.sortOrder, newest, conversation.id};
+    default: return {0, newest, conversation.id};
+    }
 }
 
-ConversationList JsonStore::getTrashConversations(int limit) const
+void JsonStore::indexConversation(const Conversation &conversation)
+{
+    for (int view = 0; view < ViewCount; ++view) {
+        if (inView(ConversationView(view), conversation)) {
+            m_views[view].insert(viewKey(ConversationView(view), conversation));
+        }
+    }
+}
+
+void JsonStore::unindexConversation(const Conversation &conversation)
+{
+    // Keys are derived from the stored copy, so they match what indexConversation inserted
+    for (int view = 0; view < ViewCount; ++view) {
+        if (inView(ConversationView(view), conversation)) {
+            m_views[view].erase(viewKey(ConversationView(view), conversation));
+        }
+    }
+}
+
+void JsonStore::rebuildConversationViews()
+{
+    for (std::set<ViewKey> &view : m_views) {
+        view.clear();
+    }
+    for (const Conversation &conversation : std::as_const(m_conversations)) {
+        indexConversation(conversation);
+    }
+}
+
+ConversationList JsonStore::selectView(ConversationView view, int limit) const
 {
-    ConversationList all = getAllConversations();
+    // The view is already ordered, so a page costs O(limit) plus the copies
+    const std::set<ViewKey> &keys = m_views[view];
+    const qsizetype count = limit > 0 ? std::min<qsizetype>(limit, qsizetype(keys.size())) : qsizetype(keys.size());
     
-    ConversationList filtered;
-    for (const Conversation &conv : all) {
-        if (conv.deleted) {
-            filtered.append(conv);
+    ConversationList list;
+    list.reserve(count);
+    for (auto it = keys.begin(); it != keys.end() && list.size() < count; ++it) {
+        auto conv = m_conversations.constFind(it->conversationId);
+        if (conv != m_conversations.constEnd()) {
+            list.append(conv.value());
         }
     }
+    return list;
+}
+
+void JsonStore::rebuildMessageIndex(Shard &shard)
+{
+    shard.index.clear();
+    shard.index.reserve(shard.messages.size());
+    
+    for (auto it = shard.messages.constBegin(); it != shard.messages.constEnd(); ++it) {
+        shard.index.append({it->header.createdAt, it.key()});
+    }
     
-    std::sort(filtered.begin(), filtered.end(), [](const Conversation &a, const Conversation &b) {
-        return a.updatedAt > b.updatedAt;
+    // Stable sort keeps the previous id order for messages sharing a timestamp
+    std::stable_sort(shard.index.begin(), shard.index.end(), [](const MessageIndexEntry &a, const MessageIndexEntry &b) {
+        return a.createdAt < b.createdAt;
+    });
+}
+
+void JsonStore::indexMessage(Shard &shard, const QDateTime &createdAt, const Id &messageId)
+{
+    // Insert after any message with the same timestamp so arrival order is preserved.
+    // Messages are almost always appended, so this is effectively O(1).
+    auto pos = std::upper_bound(shard.index.begin(), shard.index.end(), createdAt,
+                                [](const QDateTime &value, const MessageIndexEntry &entry) {
+        return value < entry.createdAt;
+    });
+    shard.index.insert(pos, {createdAt, messageId});
+}
+
+void JsonStore::unindexMessage(Shard &shard, const Id &messageId)
+{
+    // Recently written messages are the most likely to be touched, so search from the back
+    for (qsizetype i = shard.index.size() - 1; i >= 0; --i) {
+        if (shard.index[i].messageId == messageId) {
+            shard.index.removeAt(i);
+            break;
+        }
+    }
+}
+
+qsizetype JsonStore::cursorPosition(const MessageIndex &index, const MessageCursor &cursor, bool after)
+{
+    // Entries sharing a timestamp keep arrival order, so find the cursor's own entry among them
+    auto range = std::equal_range(index.begin(), index.end(), MessageIndexEntry{cursor.createdAt, Id()},
+                                  [](const MessageIndexEntry &a, const MessageIndexEntry &b) {
+        return a.createdAt < b.createdAt;
     });
+    const Id cursorId = Id::fromString(cursor.messageId);
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->messageId == cursorId) {
+            return (it - index.begin()) + (after ? 1 : 0);
+        }
+    }
     
-    if (limit > 0 && filtered.size() > limit) {
-        filtered = filtered.mid(0, limit);
+    // The cursor message is gone: page around its whole timestamp group
+    return (after ? range.second : range.first) - index.begin();
+}
+
+MessagePage JsonStore::pageOf(const Shard &shard, qsizetype begin, qsizetype end)
+{
+    MessagePage page;
+    page.totalCount = static_cast<int>(shard.index.size());
+    page.hasMoreBefore = begin > 0;
+    page.hasMoreAfter = end < shard.index.size();
+    
+    page.messages.reserve(end - begin);
+    for (qsizetype i = begin; i < end; ++i) {
+        auto it = shard.messages.constFind(shard.index[i].messageId);
+        if (it != shard.messages.constEnd() && MessageArena::isValid(it)) {
+            page.messages.append(shard.messages.message(it));
+        }
+    }
+    return page;
+}
+
+// Conversation operations
+bool JsonStore::createConversation(const Conversation &conversation)
+{
+    putConversation(conversation);
+    
+    StoreJournal::Record record;
+    record.type = StoreJournal::RecordType::Conversation;
+    record.id = conversation.id;
+    record.conversation = conversation;
+    logRecord(record);
+    
+    notifyConversationCreated(conversation.id);
+    return true;
+}
+
+bool JsonStore::updateConversation(const Conversation &conversation)
+{
+    auto existing = m_conversations.constFind(conversation.id);
+    if (existing == m_conversations.constEnd()) {
+        return false;
+    }
+    
+    // Unarchiving brings a cold conversation back as a regular shard
+    if (existing->archived && !conversation.archived && m_coldTier.contains(conversation.id)) {
+        shard(conversation.id).dirty = true;
+        m_coldTier.remove(conversation.id);
+    }
+    
+    putConversation(conversation);
+    
+    StoreJournal::Record record;
+    record.type = StoreJournal::RecordType::Conversation;
+    record.id = conversation.id;
+    record.conversation = conversation;
+    logRecord(record);
+    
+    notifyConversationUpdated(conversation.id);
+    return true;
+}
+
+bool JsonStore::deleteConversation(const QString &conversationId)
+{
+    if (!m_conversations.contains(conversationId)) {
+        return false;
+    }
+    
+    removeConversation(conversationId);
+    
+    StoreJournal::Record record;
+    record.operation = StoreJournal::Operation::Delete;
+    record.type = StoreJournal::RecordType::Conversation;
+    record.id = conversationId;
+    logRecord(record);
+    
+    notifyConversationDeleted(conversationId);
+    return true;
+}
+
+Conversation JsonStore::getConversation(const QString &conversationId) const
+{
+    auto it = m_conversations.constFind(conversationId);
+    if (it == m_conversations.constEnd()) {
+        return Conversation(); // Invalid
     }
     
-    return filtered;
+    return it.value();
+}
+
+ConversationList JsonStore::getAllConversations() const
+{
+    ConversationList list;
+    list.reserve(m_conversations.size());
+    for (const Conversation &conv : m_conversations) {
+        if (conv.isValid()) {
+            list.append(conv);
+        }
+    }
+    return list;
+}
+
+ConversationList JsonStore::getRecentConversations(int limit) const
+{
+    return selectView(RecentView, limit);
+}
+
+ConversationList JsonStore::getPinnedConversations(int limit) const
+{
+    return selectView(PinnedView, limit);
+}
+
+ConversationList JsonStore::getArchivedConversations(int limit) const
+{
+    return selectView(ArchivedView, limit);
+}
+
+ConversationList JsonStore::getTrashConversations(int limit) const
+{
+    return selectView(TrashView, limit);
 }
 
 // Message operations
 bool JsonStore::createMessage(const Message &message)
 {
-    QJsonObject msgObj = message.toJson();
-    m_messages[message.id] = msgObj;
-    scheduleAutoSave();
-    emit messageCreated(message.id);
+    putMessage(message);
+    
+    StoreJournal::Record record;
+    record.id = message.id;
+    record.conversationId = message.conversationId;
+    record.message = message;
+    logRecord(record);
+    
+    notifyMessageCreated(message.id);
     return true;
 }
 
 bool JsonStore::updateMessage(const Message &message)
 {
-    if (!m_messages.contains(message.id)) {
+    // Loading the target shard also registers its messages; a message that moves
+    // here from another conversation is looked up there
+    shard(message.conversationId);
+    if (!m_messageShards.contains(Id::fromString(message.id)) && !shardForMessage(message.id)) {
         return false;
     }
     
-    QJsonObject msgObj = message.toJson();
-    m_messages[message.id] = msgObj;
-    scheduleAutoSave();
-    emit messageUpdated(message.id);
+    putMessage(message);
+    
+    StoreJournal::Record record;
+    record.id = message.id;
+    record.conversationId = message.conversationId;
+    record.message = message;
+    logRecord(record);
+    
+    notifyMessageUpdated(message.id);
     return true;
 }
 
+bool JsonStore::appendDraftText(const QString &messageId, const QString &text)
+{
+    // Readers see the text right away; the shard only becomes dirty once the text is journaled
+    Shard *owner = shardForMessage(messageId);
+    const Id id = Id::fromString(messageId);
+    if (!owner || !owner->messages.appendText(id, text)) {
+        return false;
+    }
+    const QString conversationId = m_messageShards.value(id);
+    accountBytes(*owner);
+    recordStats(conversationId, statsOf(*owner));
+    ++m_version;
+    
+    Draft &draft = m_drafts[messageId];
+    if (draft.conversationId.isEmpty()) {
+        draft.conversationId = conversationId;
+        draft.sinceFlush.start();
+    }
+    draft.unsaved += text;
+    if (draft.unsaved.size() >= kDraftFlushChars || draft.sinceFlush.elapsed() >= kDraftFlushIntervalMs) {
+        flushDraft(messageId);
+    } else if (!m_draftTimer->isActive()) {
+        m_draftTimer->start();
+    }
+    return true;
+}
+
+bool JsonStore::finishDraft(const Message &message)
+{
+    // The final message record supersedes whatever of the draft was journaled
+    m_drafts.remove(message.id);
+    return updateMessage(message);
+}
+
 bool JsonStore::deleteMessage(const QString &messageId)
 {
-    if (!m_messages.contains(messageId)) {
+    // Loading the owner registers the message, wherever it was found
+    if (!shardForMessage(messageId)) {
         return false;
     }
+    const QString conversationId = m_messageShards.value(Id::fromString(messageId));
     
-    m_messages.remove(messageId);
-    scheduleAutoSave();
-    emit messageDeleted(messageId);
+    removeMessage(messageId, conversationId);
+    
+    StoreJournal::Record record;
+    record.operation = StoreJournal::Operation::Delete;
+    record.id = messageId;
+    record.conversationId = conversationId;
+    logRecord(record);
+    
+    notifyMessageDeleted(messageId);
     return true;
 }
 
 Message JsonStore::getMessage(const QString &messageId) const
 {
-    if (!m_messages.contains(messageId)) {
+    const Shard *owner = shardForMessage(messageId);
+    if (!owner) {
         return Message(); // Invalid
     }
     
-    QJsonObject msgObj = m_messages[messageId].toObject();
-    return Message::fromJson(msgObj);
+    return owner->messages.value(Id::fromString(messageId));
 }
 
 MessageList JsonStore::getMessagesForConversation(const QString &conversationId) const
 {
+    const Shard &messages = shard(conversationId);
+    
+    // The index is already ordered by creation time
     MessageList list;
-    for (auto it = m_messages.begin(); it != m_messages.end(); ++it) {
-        QJsonObject msgObj = it.value().toObject();
-        if (msgObj["conversationId"].toString() == conversationId) {
-            Message msg = Message::fromJson(msgObj);
-            if (msg.isValid()) {
-                list.append(msg);
-            }
+    list.reserve(messages.index.size());
+    for (const MessageIndexEntry &entry : messages.index) {
+        auto it = messages.messages.constFind(entry.messageId);
+        if (it != messages.messages.constEnd() && MessageArena::isValid(it)) {
+            list.append(messages.messages.message(it));
         }
     }
     
-    // Sort by creation time
-    std::sort(list.begin(), list.end(), [](const Message &a, const Message &b) {
-        return a.createdAt < b.createdAt;
-    });
-    
     return list;
 }
 
 int JsonStore::getConversationMessageCount(const QString &conversationId) const
 {
-    int count = 0;
-    for (auto it = m_messages.begin(); it != m_messages.end(); ++it) {
-        QJsonObject msgObj = it.value().toObject();
-        if (msgObj["conversationId"].toString() == conversationId) {
-            count++;
-        }
-    }
-    return count;
+    return static_cast<int>(shard(conversationId).index.size());
+}
+
+StorageStats JsonStore::getStorageStats() const
+{
+    StorageStats stats = m_storageStats;
+    stats.conversationCount = static_cast<int>(m_conversations.size());
+    return stats;
+}
+
+ConversationStats JsonStore::getConversationStats(const QString &conversationId) const
+{
+    return m_conversationStats.value(conversationId);
+}
+
+MessagePage JsonStore::getMessagesBefore(const QString &conversationId, const MessageCursor &cursor, int limit) const
+{
+    const Shard &messages = shard(conversationId);
+    qsizetype end = cursor.isValid() ? cursorPosition(messages.index, cursor, false) : messages.index.size();
+    qsizetype begin = limit > 0 ? std::max<qsizetype>(0, end - limit) : 0;
+    return pageOf(messages, begin, end);
+}
+
+MessagePage JsonStore::getMessagesAfter(const QString &conversationId, const MessageCursor &cursor, int limit) const
+{
+    const Shard &messages = shard(conversationId);
+    qsizetype begin = cursor.isValid() ? cursorPosition(messages.index, cursor, true) : 0;
+    qsizetype end = limit > 0 ? std::min<qsizetype>(messages.index.size(), begin + limit) : messages.index.size();
+    return pageOf(messages, begin, end);
 }
 
 } // namespace DesktopApp
@@ -8,66 +8,291 @@
 #include <QDir>
 #include <QStandardPaths>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QSet>
+#include <QVector>
 #include "Models.h"
+#include "ConversationRepository.h"
+#include "StoreJournal.h"
+#include "PersistenceWorker.h"
+#include "ColdTier.h"
+#include "StoreSnapshot.h"
+#include "MessageArena.h"
+#include <memory>
+#include <list>
+#include <set>
+#include <vector>
+
+class QThread;
 
 namespace DesktopApp {
 
 /**
- * @brief Lightweight JSON-based storage replacing SQLite
+ * @brief Lightweight file-based storage, the default ConversationRepository
+ *
+ * Conversations live in a small manifest that is loaded at startup; the
+ * messages of each conversation live in their own shard file, loaded the
+ * first time that conversation is read. Records are kept as typed structs
+ * and only encoded when persisted. Mutations are appended to a
+ * write-ahead journal and periodic checkpoints rewrite only the manifest
+ * and the shards that changed; both run on a PersistenceWorker thread. Files are binary CBOR (see
+ * StorageCodec); stores written in the older JSON layouts are converted on
+ * first load.
  */
-class JsonStore : public QObject
+class JsonStore : public ConversationRepository
 {
     Q_OBJECT
 
 public:
     explicit JsonStore(QObject *parent = nullptr);
-    ~JsonStore();
+    ~JsonStore() override;
 
-    bool initialize(const QString &dataDir);
+    bool initialize(const QString &dataDir) override;
 
     // Conversation operations
-    bool createConversation(const Conversation &conversation);
-    bool updateConversation(const Conversation &conversation);
-    bool deleteConversation(const QString &conversationId);
-    Conversation getConversation(const QString &conversationId) const;
-    ConversationList getAllConversations() const;
-    ConversationList getRecentConversations(int limit = 100) const;
-    ConversationList getPinnedConversations(int limit = 100) const;
-    ConversationList getArchivedConversations(int limit = 100) const;
-    ConversationList getTrashConversations(int limit = 100) const;
+    bool createConversation(const Conversation &conversation) override;
+    bool updateConversation(const Conversation &conversation) override;
+    bool deleteConversation(const QString &conversationId) override;
+    Conversation getConversation(const QString &conversationId) const override;
+    ConversationList getAllConversations() const override;
+    ConversationList getRecentConversations(int limit = 100) const override;
+    ConversationList getPinnedConversations(int limit = 100) const override;
+    ConversationList getArchivedConversations(int limit = 100) const override;
+    ConversationList getTrashConversations(int limit = 100) const override;
 
     // Message operations
-    bool createMessage(const Message &message);
-    bool updateMessage(const Message &message);
-    bool deleteMessage(const QString &messageId);
-    Message getMessage(const QString &messageId) const;
-    MessageList getMessagesForConversation(const QString &conversationId) const;
-    int getConversationMessageCount(const QString &conversationId) const;
+    bool createMessage(const Message &message) override;
+    bool updateMessage(const Message &message) override;
+    bool deleteMessage(const QString &messageId) override;
+    Message getMessage(const QString &messageId) const override;
+    MessageList getMessagesForConversation(const QString &conversationId) const override;
+    int getConversationMessageCount(const QString &conversationId) const override;
+    
+    // Kept per conversation in the manifest, so unloaded conversations are counted too
+    StorageStats getStorageStats() const override;
+    ConversationStats getConversationStats(const QString &conversationId) const override;
+    
+    // Pages cost O(log M + limit) on the per-conversation index
+    MessagePage getMessagesBefore(const QString &conversationId, const MessageCursor &cursor, int limit) const override;
+    MessagePage getMessagesAfter(const QString &conversationId, const MessageCursor &cursor, int limit) const override;
+    
+    /**
+     * @brief Streaming drafts are held in memory and journaled as appended text
+     *
+     * Chunks are logged at most every couple of seconds (or every 16K
+     * characters), so a long reply costs journal space proportional to its
+     * length instead of one full message record per chunk.
+     */
+    bool appendDraftText(const QString &messageId, const QString &text) override;
+    bool finishDraft(const Message &message) override;
+    
+    /**
+     * @brief Copy-on-write view; unloaded conversations are read from their files on demand
+     *
+     * Taking a snapshot copies no messages. While one is alive, conversations
+     * are not moved into the cold tier.
+     */
+    std::shared_ptr<const StoreSnapshot> snapshot() const override;
+    
+    /**
+     * @brief Size of the cold tier and what moving conversations into it saved
+     */
+    ColdTier::Stats coldTierStats() const;
+    
+    /**
+     * @brief Counters of the loaded-conversation cache
+     */
+    struct CacheStats {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 evictions = 0;
+        qint64 residentBytes = 0;       // estimated size of all loaded messages
+        qint64 budgetBytes = 0;
+        int residentConversations = 0;
+        qint64 textBytes = 0;           // loaded message text as stored (UTF-8)
+        qint64 utf16TextBytes = 0;      // the same text as QString
+    };
+    
+    /**
+     * @brief Memory budget for loaded message sets
+     *
+     * Least recently used conversations are unloaded once their changes are
+     * on disk; conversations with unsaved changes may push the cache past the
+     * budget until the next checkpoint. getMessage() and deleteMessage() find
+     * messages of unloaded conversations by reading their files, most recently
+     * updated first, so those calls cost at least one shard read.
+     */
+    void setCacheBudget(qint64 bytes);
+    CacheStats cacheStats() const;
 
 signals:
-    void conversationCreated(const QString &conversationId);
-    void conversationUpdated(const QString &conversationId);
-    void conversationDeleted(const QString &conversationId);
-    void messageCreated(const QString &messageId);
-    void messageUpdated(const QString &messageId);
-    void messageDeleted(const QString &messageId);
+    /**
+     * @brief A background checkpoint finished writing
+     * @param elapsedMs Time the worker spent sealing, encoding, writing and syncing
+     * @param bytesWritten Size of the shard and manifest files written
+     */
+    void snapshotSaved(qint64 elapsedMs, qint64 bytesWritten);
+    
+    /**
+     * @brief Conversations were moved into the cold tier
+     * @param memoryReclaimed Estimated size of the decoded messages evicted
+     * @param diskReclaimed Shard bytes minus their compressed size
+     */
+    void coldTierUpdated(int frozenConversations, qint64 memoryReclaimed, qint64 diskReclaimed);
+
+public slots:
+    /**
+     * @brief Snapshot pending changes in the background now; snapshotSaved() reports completion
+     */
+    void checkpoint();
+
+protected:
+    bool batchFinished() override;
 
 private slots:
-    void saveData();
+    void onCheckpointFinished(bool success, qint64 elapsedMs, qint64 bytesWritten);
+    void onConversationsFrozen(const ColdTier::FreezeResult &result);
 
 private:
-    void loadData();
-    void scheduleAutoSave();
+    /**
+     * @brief Messages of one conversation, loaded on first access
+     */
+    struct Shard {
+        MessageArena messages;            // messageId -> message, text as UTF-8
+        MessageIndex index;               // ordered by createdAt
+        bool dirty = false;               // changed since the last checkpoint
+        qint64 bytes = 0;                 // estimated memory use, see MessageArena::memoryBytes()
+        std::list<QString>::iterator lruPosition;
+    };
+
+    /**
+     * @brief Ordered conversation lists maintained on every mutation
+     */
+    enum ConversationView {
+        RecentView,   // not archived/deleted; pinned first, then newest
+        PinnedView,   // pinned, not deleted; by sortOrder, then newest
+        ArchivedView, // archived, not deleted; newest first
+        TrashView,    // deleted; newest first
+        ViewCount
+    };
+
+    /**
+     * @brief Position of a conversation in a view; ascending order is display order
+     */
+    struct ViewKey {
+        qint64 primary;
+        qint64 secondary;
+        QString conversationId;
+
+        bool operator<(const ViewKey &other) const
+        {
+            if (primary != other.primary) return primary < other.primary;
+            if (secondary != other.secondary) return secondary < other.secondary;
+            return conversationId < other.conversationId;
+        }
+    };
+
+    /**
+     * @brief Text appended to an in-flight message that is not journaled yet
+     */
+    struct Draft {
+        QString conversationId;
+        QString unsaved;
+        QElapsedTimer sinceFlush;
+    };
+
+    bool loadManifest();
+    void recoverConversations();
+    bool migrateLegacyFiles();
+    bool migrateJsonShards(const QString &jsonManifest);
+    bool writeMigratedStore();
+    void scheduleCheckpoint();
+    void logRecord(const StoreJournal::Record &record);
+    void flushDraft(const QString &messageId);
+    void flushDrafts();
+
+    // Shard access; loading is a cache fill, so it is allowed from const getters
+    Shard &shard(const QString &conversationId) const;
+    Shard *shardForMessage(const QString &messageId) const;
+    QString findUnloadedOwner(const Id &messageId) const;
+    QString shardPath(const QString &conversationId, const char *extension = "cbor") const;
+    
+    // Per-conversation stats follow the loaded shard after every change and every load
+    static ConversationStats statsOf(const Shard &shard);
+    void recordStats(const QString &conversationId, const ConversationStats &stats) const;
+    void dropStats(const QString &conversationId);
+    void countMissingStats();
+    
+    // Cold tier: archived or idle conversations whose shard is on disk and unchanged
+    bool isColdCandidate(const Conversation &conversation, const QDateTime &idleBefore) const;
+    
+    // Loaded-shard cache
+    void cacheShard(const QString &conversationId, Shard &shard) const;
+    void accountBytes(Shard &shard) const;
+    void dropShard(QHash<QString, Shard>::iterator it) const;
+    bool isEvictable(const QString &conversationId, const Shard &shard) const;
+    void trimCache() const;
+    
+    // Live snapshots read unloaded conversations from disk; they get a copy before the files change
+    bool hasLiveSnapshots() const;
+    void handOverShard(const QString &conversationId, const Shard &shard) const;
+
+    // State changes shared by the public API and journal replay
+    void applyRecord(const StoreJournal::Record &record);
+    void putConversation(const Conversation &conversation);
+    void removeConversation(const QString &conversationId);
+    void putMessage(const Message &message);
+    void removeMessage(const QString &messageId, const QString &conversationId = QString());
+    void appendMessageText(const QString &messageId, const QString &conversationId, const QString &text);
+
+    // Per-shard message index maintenance
+    static void rebuildMessageIndex(Shard &shard);
+    static void indexMessage(Shard &shard, const QDateTime &createdAt, const Id &messageId);
+    static void unindexMessage(Shard &shard, const Id &messageId);
+    static qsizetype cursorPosition(const MessageIndex &index, const MessageCursor &cursor, bool after);
+    static MessagePage pageOf(const Shard &shard, qsizetype begin, qsizetype end);
+
+    // Conversation view maintenance
+    static bool inView(ConversationView view, const Conversation &conversation);
+    static ViewKey viewKey(ConversationView view, const Conversation &conversation);
+    void indexConversation(const Conversation &conversation);
+    void unindexConversation(const Conversation &conversation);
+    void rebuildConversationViews();
+    ConversationList selectView(ConversationView view, int limit) const;
 
     QString m_dataDir;
-    QString m_conversationsFile;
-    QString m_messagesFile;
+    QString m_manifestFile;
+    QString m_shardDir;
     
-    QJsonObject m_conversations;
-    QJsonObject m_messages;
-    QTimer *m_autoSaveTimer;
+    QHash<QString, Conversation> m_conversations;        // authoritative typed state
+    std::set<ViewKey> m_views[ViewCount];                 // sidebar orderings of m_conversations
+    mutable QHash<QString, ConversationStats> m_conversationStats; // written with the manifest
+    mutable StorageStats m_storageStats;                 // sums of m_conversationStats
+    mutable bool m_manifestDirty = false;
+    mutable QHash<QString, Shard> m_shards;              // conversationId -> loaded shard
+    mutable QHash<Id, QString> m_messageShards;          // messageId -> conversationId, loaded shards only
+    mutable std::list<QString> m_lru;                    // loaded shards, most recently used first
+    mutable CacheStats m_cacheStats;
+    QSet<QString> m_checkpointingShards;                 // being written; not yet safe to unload
+    QSet<QString> m_removedShards;                       // shard files to delete at the next checkpoint
+    ColdTier m_coldTier;                                 // compressed shards of cold conversations
+    qint64 m_coldMemoryReclaimed = 0;
+    QThread *m_persistenceThread;
+    PersistenceWorker *m_worker;                         // lives on m_persistenceThread, owns the journal
+    QTimer *m_checkpointTimer;
+    QTimer *m_coldScanTimer;                             // checkpoints for freezing while otherwise idle
+    std::shared_ptr<PersistenceWorker::Snapshot> m_runningCheckpoint;
+    int m_unsavedRecords = 0;                            // journaled since the last checkpoint started
+    QVector<StoreJournal::Record> m_batchRecords;        // held back until the open batch commits
+    bool m_checkpointDeferred = false;                   // requested while a batch was open
+    QHash<QString, Draft> m_drafts;                      // messageId -> streaming draft
+    QTimer *m_draftTimer;                                // journals drafts whose stream stalled
+    quint64 m_version = 0;                               // bumped by every state change
+    mutable std::vector<std::weak_ptr<const StoreSnapshot>> m_snapshots; // handed out, oldest first
     
     bool m_loaded = false;
+    bool m_recovering = false;                           // manifest was damaged; rebuilding from shards
 };
 
 } // namespace DesktopApp
@@ -0,0 +1,173 @@
+#include "MessageArena.h"
+#include "StoreSnapshot.h"
+#include <algorithm>
+#include <vector>
+
+namespace DesktopApp {
+
+namespace {
+
+const qint64 kCompactMinWaste = 64 * 1024; // unreferenced bytes tolerated regardless of ratio
+
+} // namespace
+
+Message MessageArena::value(const Id &messageId) const
+{
+    const_iterator it = m_entries.constFind(messageId);
+    return it != m_entries.constEnd() ? message(it) : Message();
+}
+
+Message MessageArena::message(const_iterator it) const
+{
+    Message message = it->header;
+    message.id = messageId(it);
+    message.text = text(it);
+    return message;
+}
+
+QString MessageArena::messageId(const_iterator it)
+{
+    return it->header.id.isEmpty() ? it.key().toString() : it->header.id;
+}
+
+bool MessageArena::isValid(const_iterator it)
+{
+    return !it.key().isNull() && !it->header.conversationId.isEmpty() && it->header.createdAt.isValid();
+}
+
+QByteArrayView MessageArena::utf8Text(const_iterator it) const
+{
+    return QByteArrayView(m_text.constData() + it->offset, it->size);
+}
+
+QString MessageArena::text(const_iterator it) const
+{
+    return QString::fromUtf8(utf8Text(it));
+}
+
+void MessageArena::insert(const Message &message)
+{
+    bool canonical = false;
+    const Id id = Id::fromString(message.id, &canonical);
+    auto existing = m_entries.find(id);
+    if (existing != m_entries.end()) {
+        release(existing.value());
+    }
+
+    Entry entry;
+    entry.header = message;
+    entry.header.text = QString();
+    if (canonical) {
+        entry.header.id = QString();
+    }
+    if (message.conversationId == m_conversationId) {
+        entry.header.conversationId = m_conversationId;
+    } else if (m_entries.isEmpty()) {
+        m_conversationId = message.conversationId;
+    }
+    const QByteArray utf8 = message.text.toUtf8();
+    entry.offset = m_text.size();
+    entry.size = utf8.size();
+    entry.length = message.text.size();
+    m_text.append(utf8);
+
+    m_liveBytes += entry.size;
+    m_utf16Length += entry.length;
+    m_headerBytes += headerBytes(entry.header);
+    m_entries.insert(id, entry);
+    compactIfWasteful();
+}
+
+bool MessageArena::remove(const Id &messageId)
+{
+    auto existing = m_entries.find(messageId);
+    if (existing == m_entries.end()) {
+        return false;
+    }
+    release(existing.value());
+    m_entries.erase(existing);
+    compactIfWasteful();
+    return true;
+}
+
+bool MessageArena::appendText(const Id &messageId, QStringView text)
+{
+    auto existing = m_entries.find(messageId);
+    if (existing == m_entries.end()) {
+        return false;
+    }
+
+    // A streaming reply is usually the last text written, so it grows in place
+    Entry &entry = existing.value();
+    if (entry.offset + entry.size != m_text.size()) {
+        const QByteArray current = m_text.mid(entry.offset, entry.size);
+        entry.offset = m_text.size();
+        m_text.append(current);
+    }
+    const QByteArray utf8 = text.toUtf8();
+    m_text.append(utf8);
+    entry.size += utf8.size();
+    entry.length += text.size();
+    m_liveBytes += utf8.size();
+    m_utf16Length += text.size();
+    compactIfWasteful();
+    return true;
+}
+
+MessageList MessageArena::values() const
+{
+    MessageList list;
+    list.reserve(m_entries.size());
+    for (const_iterator it = m_entries.constBegin(); it != m_entries.constEnd(); ++it) {
+        list.append(message(it));
+    }
+    return list;
+}
+
+qint64 MessageArena::memoryBytes() const
+{
+    return m_headerBytes + m_text.capacity();
+}
+
+qint64 MessageArena::headerBytes(const Message &header)
+{
+    // Hash node, header and index entry; the conversation id is shared. An estimate, not an exact count
+    return qint64(sizeof(Entry)) + qint64(sizeof(MessageIndexEntry)) + 32
+         + 2 * qint64(header.id.size() + header.parentId.size());
+}
+
+void MessageArena::release(const Entry &entry)
+{
+    m_liveBytes -= entry.size;
+    m_utf16Length -= entry.length;
+    m_headerBytes -= headerBytes(entry.header);
+}
+
+void MessageArena::compactIfWasteful()
+{
+    const qint64 waste = m_text.size() - m_liveBytes;
+    if (waste < kCompactMinWaste || waste < m_liveBytes) {
+        return;
+    }
+
+    // Rewrite in buffer order so the most recent text stays last and keeps growing in place
+    std::vector<Entry *> entries;
+    entries.reserve(size_t(m_entries.size()));
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it) {
+        entries.push_back(&it.value());
+    }
+    std::sort(entries.begin(), entries.end(), [](const Entry *a, const Entry *b) {
+        return a->offset < b->offset;
+    });
+
+    QByteArray compacted;
+    compacted.reserve(m_liveBytes);
+    for (Entry *entry : entries) {
+        const qsizetype offset = compacted.size();
+        compacted.append(m_text.constData() + entry->offset, entry->size);
+        entry->offset = offset;
+    }
+    m_text = compacted;
+}
+
+} // namespace DesktopApp
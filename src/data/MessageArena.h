@@ -0,0 +1,104 @@
+#pragma once
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QHash>
+#include <QString>
+#include "Models.h"
+#include "Id.h"
+
+namespace DesktopApp {
+
+/**
+ * @brief Messages of one conversation with their text packed as UTF-8
+ *
+ * Everything but the text is kept as a Message header; the bodies share one
+ * append-only UTF-8 buffer, which halves the memory of mostly-ASCII chat
+ * history compared to QString. A QString is only created when a caller asks
+ * for the text or the full message. Text that is replaced or removed stays
+ * in the buffer until enough has accumulated to compact it.
+ *
+ * Messages are keyed by their binary Id; the header keeps no id text unless
+ * the original was not a canonical UUID string, and all headers share one
+ * copy of the conversation id.
+ *
+ * A value type: copies are implicitly shared and may be read from other
+ * threads while the original keeps changing.
+ */
+class MessageArena
+{
+public:
+    struct Entry {
+        Message header;        // text left empty; id only when not canonical UUID text
+        qsizetype offset = 0;  // of the UTF-8 text in the buffer
+        qsizetype size = 0;    // UTF-8 bytes
+        qsizetype length = 0;  // UTF-16 code units once decoded
+    };
+    using const_iterator = QHash<Id, Entry>::const_iterator;
+
+    bool isEmpty() const { return m_entries.isEmpty(); }
+    qsizetype size() const { return m_entries.size(); }
+    bool contains(const Id &messageId) const { return m_entries.contains(messageId); }
+    void reserve(qsizetype size) { m_entries.reserve(size); }
+
+    const_iterator constBegin() const { return m_entries.constBegin(); }
+    const_iterator constEnd() const { return m_entries.constEnd(); }
+    const_iterator constFind(const Id &messageId) const { return m_entries.constFind(messageId); }
+
+    /**
+     * @brief The full message, or an invalid Message if there is none
+     */
+    Message value(const Id &messageId) const;
+    Message message(const_iterator it) const;
+    static QString messageId(const_iterator it);
+    static bool isValid(const_iterator it); // Message::isValid() without decoding
+
+    /**
+     * @brief Text of an entry, without decoding it
+     *
+     * The view stays valid until this arena is modified.
+     */
+    QByteArrayView utf8Text(const_iterator it) const;
+    QString text(const_iterator it) const;
+
+    /**
+     * @brief Add @p message or replace the message with the same id
+     */
+    void insert(const Message &message);
+    bool remove(const Id &messageId);
+
+    /**
+     * @brief Append to the text of a message; in place when it is the last text written
+     */
+    bool appendText(const Id &messageId, QStringView text);
+
+    /**
+     * @brief All messages, decoded, in no particular order
+     */
+    MessageList values() const;
+
+    /**
+     * @brief Estimated memory use of the headers and the text buffer
+     */
+    qint64 memoryBytes() const;
+
+    /**
+     * @brief Size of the live text as UTF-8, and what it would take as QString
+     */
+    qint64 textBytes() const { return m_liveBytes; }
+    qint64 utf16TextBytes() const { return 2 * m_utf16Length; }
+
+private:
+    static qint64 headerBytes(const Message &header);
+    void release(const Entry &entry);
+    void compactIfWasteful();
+
+    QHash<Id, Entry> m_entries;
+    QByteArray m_text;
+    QString m_conversationId;     // shared by the headers
+    qint64 m_liveBytes = 0;       // bytes of m_text still referenced
+    qint64 m_utf16Length = 0;
+    qint64 m_headerBytes = 0;
+};
+
+} // namespace DesktopApp
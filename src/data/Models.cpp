@@ -447,4 +447,42 @@ bool SearchResult::isValid() const
     return !messageId.isEmpty() && !conversationId.isEmpty();
 }
 
+// MessageCursor implementation
+MessageCursor::MessageCursor()
+{
+}
+
+MessageCursor::MessageCursor(const Message &message)
+    : createdAt(message.createdAt)
+    , messageId(message.id)
+{
+}
+
+bool MessageCursor::isValid() const
+{
+    return !messageId.isEmpty();
+}
+
+// MessagePage implementation
+MessagePage::MessagePage()
+    : totalCount(0)
+    , hasMoreBefore(false)
+    , hasMoreAfter(false)
+{
+}
+
+// ConversationStats and StorageStats implementation
+ConversationStats::ConversationStats()
+    : messageCount(0)
+    , textBytes(0)
+{
+}
+
+StorageStats::StorageStats()
+    : conversationCount(0)
+    , messageCount(0)
+    , textBytes(0)
+{
+}
+
 } // namespace DesktopApp
@@ -208,4 +208,50 @@ using ProviderAccountList = QVector<ProviderAccount>;
 using PromptList = QVector<Prompt>;
 using SearchResultList = QVector<SearchResult>;
 
+/**
+ * @brief Position in a conversation's message order, for keyset pagination
+ */
+struct MessageCursor {
+    QDateTime createdAt;
+    QString messageId;
+
+    MessageCursor();
+    explicit MessageCursor(const Message &message);
+    
+    bool isValid() const;
+};
+
+/**
+ * @brief One page of a conversation's messages, oldest first
+ */
+struct MessagePage {
+    MessageList messages;
+    int totalCount;      // messages in the whole conversation
+    bool hasMoreBefore;  // older messages exist before this page
+    bool hasMoreAfter;   // newer messages exist after this page
+
+    MessagePage();
+};
+
+/**
+ * @brief Size of one conversation's messages, kept current by the store
+ */
+struct ConversationStats {
+    int messageCount;
+    qint64 textBytes;    // message text as UTF-8
+
+    ConversationStats();
+};
+
+/**
+ * @brief Totals over all conversations of a store
+ */
+struct StorageStats {
+    int conversationCount;
+    int messageCount;
+    qint64 textBytes;    // message text as UTF-8
+
+    StorageStats();
+};
+
 } // namespace DesktopApp
@@ -0,0 +1,165 @@
+#include "PersistenceWorker.h"
+#include "StorageCodec.h"
+#include <QFile>
+#include <QSaveFile>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QDebug>
+
+namespace DesktopApp {
+
+namespace {
+
+bool writeSnapshotFile(const QString &path, const QByteArray &bytes)
+{
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Cannot open snapshot for writing:" << path << file.errorString();
+        return false;
+    }
+
+    if (file.write(bytes) != bytes.size() || !syncToDisk(file)) {
+        qWarning() << "Failed to write snapshot:" << path << file.errorString();
+        file.cancelWriting();
+        return false;
+    }
+
+    return file.commit();
+}
+
+} // namespace
+
+PersistenceWorker::PersistenceWorker(QObject *parent)
+    : QObject(parent)
+    , m_journal(new StoreJournal(this))
+{
+    qRegisterMetaType<ColdTier::FreezeResult>();
+}
+
+PersistenceWorker::~PersistenceWorker()
+{
+    m_journal->close();
+}
+
+int PersistenceWorker::openJournal(const QString &directory, const std::function<void(const StoreJournal::Record &)> &apply)
+{
+    if (!m_journal->open(directory)) {
+        return -1;
+    }
+
+    int replayed = m_journal->replay(apply);
+    m_journalSize = m_journal->size();
+    return replayed;
+}
+
+void PersistenceWorker::append(const StoreJournal::Record &record)
+{
+    QMetaObject::invokeMethod(this, [this, record]() {
+        m_journal->append(record);
+        m_journalSize = m_journal->size();
+    }, Qt::QueuedConnection);
+}
+
+void PersistenceWorker::appendBatch(const QVector<StoreJournal::Record> &records)
+{
+    QMetaObject::invokeMethod(this, [this, records]() {
+        m_journal->appendBatch(records);
+        m_journalSize = m_journal->size();
+    }, Qt::QueuedConnection);
+}
+
+void PersistenceWorker::checkpoint(const std::shared_ptr<const Snapshot> &snapshot)
+{
+    QMetaObject::invokeMethod(this, [this, snapshot]() {
+        runCheckpoint(*snapshot);
+    }, Qt::QueuedConnection);
+}
+
+void PersistenceWorker::shutdown()
+{
+    auto flush = [this]() { m_journal->close(); };
+    if (thread() == QThread::currentThread() || !thread()->isRunning()) {
+        flush();
+    } else {
+        // Runs after everything queued before it, including a pending checkpoint
+        QMetaObject::invokeMethod(this, flush, Qt::BlockingQueuedConnection);
+    }
+}
+
+void PersistenceWorker::runCheckpoint(const Snapshot &snapshot)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Seal the journal so it holds exactly the records the snapshot covers
+    qint64 bytesWritten = 0;
+    int sealedSegment = m_journal->rotate();
+    bool ok = sealedSegment >= 0 && writeSnapshot(snapshot, &bytesWritten);
+    if (ok) {
+        m_journal->discardThrough(sealedSegment);
+        runColdTierWork(snapshot);
+    }
+    m_journalSize = m_journal->size();
+
+    qDebug() << "Store checkpoint" << (ok ? "written" : "failed") << "in" << timer.elapsed() << "ms,"
+             << bytesWritten << "bytes," << snapshot.shards.size() << "shards";
+    emit checkpointFinished(ok, timer.elapsed(), bytesWritten);
+}
+
+void PersistenceWorker::runColdTierWork(const Snapshot &snapshot)
+{
+    // Entries in these segments were superseded by shards or manifest changes just written
+    for (const QString &path : snapshot.deadSegments) {
+        if (QFile::exists(path) && !QFile::remove(path)) {
+            qWarning() << "Failed to remove cold segment:" << path;
+        }
+    }
+
+    if (snapshot.freeze.isEmpty()) {
+        return;
+    }
+
+    ColdTier::FreezeResult result;
+    if (ColdTier::writeSegment(snapshot.freezeSegmentPath, snapshot.freezeSegment, snapshot.freeze, result)) {
+        qDebug() << "Froze" << result.entries.size() << "conversations:" << result.hotBytesRemoved
+                 << "shard bytes into" << result.coldBytesWritten;
+        emit conversationsFrozen(result);
+    }
+}
+
+bool PersistenceWorker::writeSnapshot(const Snapshot &snapshot, qint64 *bytesWritten)
+{
+    bool ok = true;
+    qint64 written = 0;
+    for (const ShardWrite &shard : snapshot.shards) {
+        if (shard.remove) {
+            if (QFile::exists(shard.path) && !QFile::remove(shard.path)) {
+                qWarning() << "Failed to remove shard:" << shard.path;
+                ok = false;
+            }
+        } else {
+            QByteArray bytes = StorageCodec::encodeShard(shard.messages.values());
+            if (writeSnapshotFile(shard.path, bytes)) {
+                written += bytes.size();
+            } else {
+                ok = false;
+            }
+        }
+    }
+
+    // The manifest goes last so it never references shards that were not written
+    if (ok && snapshot.writeManifest) {
+        QByteArray bytes = StorageCodec::encodeManifest(snapshot.conversations.values(), snapshot.conversationStats);
+        ok = writeSnapshotFile(snapshot.manifestFile, bytes);
+        if (ok) {
+            written += bytes.size();
+        }
+    }
+
+    if (bytesWritten) {
+        *bytesWritten = written;
+    }
+    return ok;
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "Models.h"
+#include "StoreJournal.h"
+#include "ColdTier.h"
+#include "MessageArena.h"
+
+namespace DesktopApp {
+
+/**
+ * @brief Background writer for JsonStore
+ *
+ * Lives on its own thread and owns the journal. The store hands it journal
+ * records and copy-on-write snapshots; all encoding, file writes, fsyncs and
+ * atomic renames happen on the worker thread, in submission order, so a
+ * checkpoint always seals exactly the records appended before it.
+ */
+class PersistenceWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Messages of one shard to rewrite (or delete)
+     */
+    struct ShardWrite {
+        QString conversationId;
+        QString path;
+        MessageArena messages;
+        bool remove = false;
+    };
+
+    /**
+     * @brief Snapshot taken on the store thread; members are implicitly shared copies
+     */
+    struct Snapshot {
+        QString manifestFile;
+        QHash<QString, Conversation> conversations;
+        QHash<QString, ConversationStats> conversationStats;
+        bool writeManifest = false;
+        QVector<ShardWrite> shards;
+
+        // Cold tier work, done only once the snapshot itself is durable
+        QStringList deadSegments;            // cold segments to delete
+        QVector<ColdTier::FreezeJob> freeze; // shards to move into a new segment
+        int freezeSegment = -1;
+        QString freezeSegmentPath;
+    };
+
+    explicit PersistenceWorker(QObject *parent = nullptr);
+    ~PersistenceWorker();
+
+    /**
+     * @brief Open the journal and replay it; call before moving to the worker thread
+     * @return Number of replayed records, or -1 if the journal cannot be opened
+     */
+    int openJournal(const QString &directory, const std::function<void(const StoreJournal::Record &)> &apply);
+
+    // Thread-safe entry points: the work is queued onto the worker thread
+
+    /**
+     * @brief Journal a mutation; durable after the next group commit
+     */
+    void append(const StoreJournal::Record &record);
+
+    /**
+     * @brief Journal several mutations as one atomic frame
+     */
+    void appendBatch(const QVector<StoreJournal::Record> &records);
+
+    /**
+     * @brief Seal the journal, write @p snapshot and drop the sealed segments
+     *
+     * Then applies the snapshot's cold tier work. Emits checkpointFinished()
+     * when done.
+     */
+    void checkpoint(const std::shared_ptr<const Snapshot> &snapshot);
+
+    /**
+     * @brief Flush the journal and wait until all queued work has run
+     */
+    void shutdown();
+
+    /**
+     * @brief Journal bytes not yet covered by a snapshot (approximate from other threads)
+     */
+    qint64 journalSize() const { return m_journalSize.load(); }
+
+    /**
+     * @brief Write a snapshot synchronously on the calling thread
+     * @param bytesWritten Receives the size of all files written
+     */
+    static bool writeSnapshot(const Snapshot &snapshot, qint64 *bytesWritten = nullptr);
+
+signals:
+    /**
+     * @brief Reports the outcome of checkpoint() with its latency and bytes written
+     */
+    void checkpointFinished(bool success, qint64 elapsedMs, qint64 bytesWritten);
+
+    /**
+     * @brief A checkpoint moved shards into a cold segment; emitted before checkpointFinished()
+     */
+    void conversationsFrozen(const DesktopApp::ColdTier::FreezeResult &result);
+
+private:
+    void runCheckpoint(const Snapshot &snapshot);
+    void runColdTierWork(const Snapshot &snapshot);
+
+    StoreJournal *m_journal;
+    std::atomic<qint64> m_journalSize{0};
+};
+
+} // namespace DesktopApp
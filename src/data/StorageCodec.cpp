@@ -0,0 +1,465 @@
+#include "StorageCodec.h"
+#include "Crc32c.h"
+#include <QCborStreamWriter>
+#include <QCborStreamReader>
+#include <QCborValue>
+#include <QCborMap>
+#include <QUuid>
+#include <QtEndian>
+#include <QDebug>
+#include <cstring>
+
+namespace DesktopApp {
+
+namespace {
+
+const char *kManifestFormat = "desktopapp-manifest";
+const char *kShardFormat = "desktopapp-shard";
+
+// Conversation flag bits
+const qint64 kPinned = 0x1;
+const qint64 kArchived = 0x2;
+const qint64 kDeleted = 0x4;
+
+QByteArray readBytes(QCborStreamReader &reader)
+{
+    if (!reader.isByteArray()) {
+        reader.next();
+        return QByteArray();
+    }
+
+    QByteArray bytes;
+    auto chunk = reader.readByteArray();
+    while (chunk.status == QCborStreamReader::Ok) {
+        bytes += chunk.data;
+        chunk = reader.readByteArray();
+    }
+    return bytes;
+}
+
+qint64 readInteger(QCborStreamReader &reader, qint64 defaultValue = 0)
+{
+    qint64 value = defaultValue;
+    if (reader.isInteger()) {
+        value = reader.toInteger();
+    }
+    reader.next();
+    return value;
+}
+
+bool readBool(QCborStreamReader &reader, bool defaultValue = false)
+{
+    bool value = defaultValue;
+    if (reader.isBool()) {
+        value = reader.toBool();
+    }
+    reader.next();
+    return value;
+}
+
+void writeTimestamp(QCborStreamWriter &writer, const QDateTime &timestamp)
+{
+    if (timestamp.isValid()) {
+        writer.append(qint64(timestamp.toMSecsSinceEpoch()));
+    } else {
+        writer.appendNull();
+    }
+}
+
+QDateTime readTimestamp(QCborStreamReader &reader)
+{
+    if (!reader.isInteger()) {
+        reader.next();
+        return QDateTime();
+    }
+    return QDateTime::fromMSecsSinceEpoch(readInteger(reader));
+}
+
+void writeMetadata(QCborStreamWriter &writer, const QJsonObject &metadata)
+{
+    QCborValue(QCborMap::fromJsonObject(metadata)).toCbor(writer);
+}
+
+QJsonObject readMetadata(QCborStreamReader &reader)
+{
+    return QCborValue::fromCbor(reader).toMap().toJsonObject();
+}
+
+// Skip fields appended by newer versions and close the record
+bool finishRecord(QCborStreamReader &reader)
+{
+    while (reader.hasNext()) {
+        reader.next();
+    }
+    return reader.leaveContainer() && reader.lastError() == QCborError::NoError;
+}
+
+// Files are a header map {"format", "version"} followed by one frame per record, each
+// [magic][uint32 little-endian payload length][uint32 CRC-32C of length and payload][CBOR record]
+// as in the journal. A damaged record is skipped by resuming at the next magic.
+const char kRecordMagic[4] = {'D', 'A', 'S', 'R'};
+const int kFrameHeaderSize = 12;
+const qint64 kFramedVersion = 3;
+
+void appendFrame(QByteArray &data, const QByteArray &payload)
+{
+    char header[kFrameHeaderSize];
+    memcpy(header, kRecordMagic, 4);
+    qToLittleEndian<quint32>(quint32(payload.size()), header + 4);
+    qToLittleEndian<quint32>(crc32c(payload, crc32c(header + 4, 4)), header + 8);
+    data.append(header, kFrameHeaderSize);
+    data.append(payload);
+}
+
+// Decode the frames from @p offset to the end of @p data; false if any was skipped
+template <typename ReadRecord>
+bool readFrames(const QByteArray &data, qsizetype offset, ReadRecord readRecord)
+{
+    int skipped = 0;
+    while (offset < data.size()) {
+        const qsizetype available = data.size() - offset;
+        if (available >= kFrameHeaderSize && memcmp(data.constData() + offset, kRecordMagic, 4) == 0) {
+            const qsizetype length = qFromLittleEndian<quint32>(data.constData() + offset + 4);
+            const quint32 checksum = qFromLittleEndian<quint32>(data.constData() + offset + 8);
+            if (length <= available - kFrameHeaderSize) {
+                const char *payload = data.constData() + offset + kFrameHeaderSize;
+                if (crc32c(payload, length, crc32c(data.constData() + offset + 4, 4)) == checksum) {
+                    // An intact frame that does not decode is skipped whole
+                    QCborStreamReader reader(QByteArray::fromRawData(payload, length));
+                    if (!readRecord(reader)) {
+                        ++skipped;
+                    }
+                    offset += kFrameHeaderSize + length;
+                    continue;
+                }
+            }
+        }
+
+        ++skipped;
+        const qsizetype next = data.indexOf(QByteArray::fromRawData(kRecordMagic, 4), offset + 1);
+        if (next < 0) {
+            break;
+        }
+        offset = next;
+    }
+    if (skipped > 0) {
+        qWarning() << "Skipped" << skipped << "damaged store records";
+    }
+    return skipped == 0;
+}
+
+// Files of version 2 and before are maps of {"format", "version", <payload key>: [records],
+// "checksums": [crc]} with one CRC-32C per record over its encoded bytes, or no "checksums"
+// key before they were added. Nothing marks where a record starts, so a record that does not
+// decode ends the read, and the records before it go unverified. Those files are rewritten
+// framed when they next change.
+template <typename ReadRecord>
+bool readContainerFile(const QByteArray &data, const char *format, const char *payloadKey, ReadRecord readRecord,
+                       QVector<qsizetype> &damaged)
+{
+    QCborStreamReader reader(data);
+    bool headerOk = reader.isMap() && reader.enterContainer();
+    bool formatOk = false;
+    qint64 version = 0;
+    QVector<QPair<qint64, qint64>> spans;  // byte range of each record read
+    QVector<quint32> checksums;
+    bool hasChecksums = false;
+    while (headerOk && reader.hasNext()) {
+        const QString key = StorageCodec::readText(reader);
+        if (key == QLatin1String("format")) {
+            formatOk = StorageCodec::readText(reader) == QLatin1String(format);
+        } else if (key == QLatin1String("version")) {
+            version = readInteger(reader);
+            if (version > StorageCodec::FormatVersion) {
+                qWarning() << "Store file written by a newer version:" << version;
+                return false;
+            }
+        } else if (key == QLatin1String(payloadKey) && reader.isArray() && reader.enterContainer()) {
+            while (reader.hasNext()) {
+                const qint64 start = reader.currentOffset();
+                if (!readRecord(reader)) {
+                    qWarning() << "Damaged store file, reading stopped after" << spans.size() << "records";
+                    return false;
+                }
+                spans.append({start, reader.currentOffset()});
+            }
+            reader.leaveContainer();
+        } else if (key == QLatin1String("checksums") && reader.isArray() && reader.enterContainer()) {
+            hasChecksums = true;
+            while (reader.hasNext()) {
+                checksums.append(quint32(readInteger(reader, -1)));
+            }
+            reader.leaveContainer();
+        } else {
+            reader.next();
+        }
+        headerOk = reader.lastError() == QCborError::NoError;
+    }
+    if (headerOk && !reader.leaveContainer()) {
+        if (version < kFramedVersion) {
+            return false;
+        }
+        headerOk = false;
+    }
+    if (headerOk && !formatOk) {
+        return false;
+    }
+
+    if (!headerOk || version >= kFramedVersion) {
+        // A header too damaged to read leaves the frames to be found by their magic
+        const qsizetype first = headerOk ? qsizetype(reader.currentOffset())
+                                         : data.indexOf(QByteArray::fromRawData(kRecordMagic, 4));
+        if (first < 0) {
+            return false;
+        }
+        return readFrames(data, first, readRecord) && headerOk;
+    }
+
+    // Verified only now, when the file is actually read; shards are loaded on first access
+    if (hasChecksums) {
+        if (checksums.size() != spans.size()) {
+            qWarning() << "Store file checksum list does not match its records";
+            return false;
+        }
+        for (qsizetype i = 0; i < spans.size(); ++i) {
+            const QPair<qint64, qint64> &span = spans.at(i);
+            if (crc32c(data.constData() + span.first, span.second - span.first) != checksums.at(i)) {
+                damaged.append(i);
+            }
+        }
+    }
+    return damaged.isEmpty();
+}
+
+template <typename Record, typename WriteRecord>
+QByteArray encodeContainerFile(const char *format, const QVector<Record> &records, WriteRecord writeRecord)
+{
+    QByteArray data;
+    {
+        QCborStreamWriter writer(&data);
+        writer.startMap(2);
+        writer.append(QLatin1String("format"));
+        writer.append(QLatin1String(format));
+        writer.append(QLatin1String("version"));
+        writer.append(qint64(StorageCodec::FormatVersion));
+        writer.endMap();
+    }
+    for (const Record &record : records) {
+        QByteArray payload;
+        QCborStreamWriter writer(&payload);
+        writeRecord(writer, record);
+        appendFrame(data, payload);
+    }
+    return data;
+}
+
+// Drop records that failed their checksum; @p first is where this file's records start in @p records
+template <typename Record>
+void removeDamaged(QVector<Record> &records, qsizetype first, const QVector<qsizetype> &damaged)
+{
+    for (qsizetype i = damaged.size() - 1; i >= 0; --i) {
+        records.removeAt(first + damaged.at(i));
+    }
+    if (!damaged.isEmpty()) {
+        qWarning() << "Skipped" << damaged.size() << "records with bad checksums";
+    }
+}
+
+} // namespace
+
+void StorageCodec::writeId(QCborStreamWriter &writer, const QString &id)
+{
+    if (id.isEmpty()) {
+        writer.appendNull();
+        return;
+    }
+
+    // Only canonical UUID strings are stored in binary, so every id round-trips exactly
+    QUuid uuid = QUuid::fromString(id);
+    if (!uuid.isNull() && uuid.toString(QUuid::WithoutBraces) == id) {
+        writer.append(uuid.toRfc4122());
+    } else {
+        writer.append(id);
+    }
+}
+
+QString StorageCodec::readId(QCborStreamReader &reader)
+{
+    if (reader.isByteArray()) {
+        QByteArray bytes = readBytes(reader);
+        return bytes.size() == 16 ? QUuid::fromRfc4122(bytes).toString(QUuid::WithoutBraces) : QString();
+    }
+    return readText(reader);
+}
+
+QString StorageCodec::readText(QCborStreamReader &reader)
+{
+    if (!reader.isString()) {
+        reader.next();
+        return QString();
+    }
+
+    QString text;
+    auto chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok) {
+        text += chunk.data;
+        chunk = reader.readString();
+    }
+    return text;
+}
+
+void StorageCodec::writeConversation(QCborStreamWriter &writer, const Conversation &conversation,
+                                     const ConversationStats *stats)
+{
+    qint64 flags = (conversation.pinned ? kPinned : 0)
+                 | (conversation.archived ? kArchived : 0)
+                 | (conversation.deleted ? kDeleted : 0);
+
+    writer.startArray(stats ? 11 : 9);
+    writeId(writer, conversation.id);
+    writer.append(conversation.title);
+    writeTimestamp(writer, conversation.createdAt);
+    writeTimestamp(writer, conversation.updatedAt);
+    writer.append(flags);
+    writer.append(qint64(conversation.sortOrder));
+    writer.append(conversation.providerId);
+    writer.append(conversation.modelName);
+    writeMetadata(writer, conversation.metadata);
+    if (stats) {
+        writer.append(qint64(stats->messageCount));
+        writer.append(stats->textBytes);
+    }
+    writer.endArray();
+}
+
+bool StorageCodec::readConversation(QCborStreamReader &reader, Conversation &conversation,
+                                    ConversationStats *stats, bool *hasStats)
+{
+    if (!reader.isArray() || !reader.enterContainer()) {
+        return false;
+    }
+
+    conversation.id = readId(reader);
+    conversation.title = readText(reader);
+    conversation.createdAt = readTimestamp(reader);
+    conversation.updatedAt = readTimestamp(reader);
+    qint64 flags = readInteger(reader);
+    conversation.pinned = flags & kPinned;
+    conversation.archived = flags & kArchived;
+    conversation.deleted = flags & kDeleted;
+    conversation.sortOrder = int(readInteger(reader));
+    conversation.providerId = readText(reader);
+    conversation.modelName = readText(reader);
+    conversation.metadata = readMetadata(reader);
+
+    const bool found = stats && reader.hasNext() && reader.isInteger();
+    if (found) {
+        stats->messageCount = int(readInteger(reader));
+        stats->textBytes = reader.hasNext() ? readInteger(reader) : 0;
+    }
+    if (hasStats) {
+        *hasStats = found;
+    }
+
+    return finishRecord(reader);
+}
+
+void StorageCodec::writeMessage(QCborStreamWriter &writer, const Message &message)
+{
+    writer.startArray(9);
+    writeId(writer, message.id);
+    writeId(writer, message.conversationId);
+    writer.append(qint64(message.role));
+    writer.append(message.text);
+    writeTimestamp(writer, message.createdAt);
+    writeMetadata(writer, message.metadata);
+    writeId(writer, message.parentId);
+    writer.append(message.isStreaming);
+    writer.append(qint64(message.deliveryState));
+    writer.endArray();
+}
+
+bool StorageCodec::readMessage(QCborStreamReader &reader, Message &message)
+{
+    if (!reader.isArray() || !reader.enterContainer()) {
+        return false;
+    }
+
+    message.id = readId(reader);
+    message.conversationId = readId(reader);
+    message.role = static_cast<MessageRole>(readInteger(reader, qint64(MessageRole::User)));
+    message.text = readText(reader);
+    message.createdAt = readTimestamp(reader);
+    message.metadata = readMetadata(reader);
+    message.parentId = readId(reader);
+    message.isStreaming = readBool(reader);
+    message.deliveryState = static_cast<MessageDeliveryState>(
+        readInteger(reader, qint64(MessageDeliveryState::Sent)));
+
+    return finishRecord(reader);
+}
+
+QByteArray StorageCodec::encodeManifest(const ConversationList &conversations,
+                                        const QHash<QString, ConversationStats> &stats)
+{
+    return encodeContainerFile(kManifestFormat, conversations,
+                               [&stats](QCborStreamWriter &writer, const Conversation &conversation) {
+        const ConversationStats conversationStats = stats.value(conversation.id);
+        writeConversation(writer, conversation, &conversationStats);
+    });
+}
+
+bool StorageCodec::decodeManifest(const QByteArray &data, ConversationList &conversations,
+                                  QHash<QString, ConversationStats> *stats)
+{
+    const qsizetype first = conversations.size();
+    QVector<qsizetype> damaged;
+    QHash<QString, ConversationStats> decodedStats;
+    bool ok = readContainerFile(data, kManifestFormat, "conversations",
+                                [&conversations, &decodedStats](QCborStreamReader &reader) {
+        Conversation conversation;
+        ConversationStats conversationStats;
+        bool hasStats = false;
+        if (!readConversation(reader, conversation, &conversationStats, &hasStats)) {
+            return false;
+        }
+        conversations.append(conversation);
+        if (hasStats) {
+            decodedStats.insert(conversation.id, conversationStats);
+        }
+        return true;
+    }, damaged);
+
+    // Stats of records that failed their checksum cannot be trusted either
+    for (qsizetype index : std::as_const(damaged)) {
+        decodedStats.remove(conversations.at(first + index).id);
+    }
+    removeDamaged(conversations, first, damaged);
+    if (stats) {
+        stats->insert(decodedStats);
+    }
+    return ok;
+}
+
+QByteArray StorageCodec::encodeShard(const MessageList &messages)
+{
+    return encodeContainerFile(kShardFormat, messages, writeMessage);
+}
+
+bool StorageCodec::decodeShard(const QByteArray &data, MessageList &messages)
+{
+    const qsizetype first = messages.size();
+    QVector<qsizetype> damaged;
+    bool ok = readContainerFile(data, kShardFormat, "messages", [&messages](QCborStreamReader &reader) {
+        Message message;
+        if (!readMessage(reader, message)) {
+            return false;
+        }
+        messages.append(message);
+        return true;
+    }, damaged);
+    removeDamaged(messages, first, damaged);
+    return ok;
+}
+
+} // namespace DesktopApp
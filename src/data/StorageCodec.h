@@ -0,0 +1,71 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include "Models.h"
+
+class QCborStreamWriter;
+class QCborStreamReader;
+
+namespace DesktopApp {
+
+/**
+ * @brief Binary (CBOR) encoding of store records
+ *
+ * Records are positional CBOR arrays: ids are written as 16-byte RFC 4122
+ * values (text for ids that are not UUIDs), timestamps as int64 epoch
+ * milliseconds and metadata as a CBOR map. Readers ignore trailing fields
+ * they do not know, so new fields can be appended without a format bump.
+ * Manifest and shard files frame every record with its length and a
+ * CRC-32C, as the journal does; decoding skips a damaged record, resumes at
+ * the next frame and reports the file as damaged.
+ */
+class StorageCodec
+{
+public:
+    static const int FormatVersion = 3; // 1 was the JSON layout, 2 had no record framing
+
+    /**
+     * @brief Conversation records; manifest records append the conversation's stats
+     *
+     * readConversation() leaves @p stats untouched and returns with
+     * @p hasStats false for records written without them.
+     */
+    static void writeConversation(QCborStreamWriter &writer, const Conversation &conversation,
+                                  const ConversationStats *stats = nullptr);
+    static bool readConversation(QCborStreamReader &reader, Conversation &conversation,
+                                 ConversationStats *stats = nullptr, bool *hasStats = nullptr);
+
+    static void writeMessage(QCborStreamWriter &writer, const Message &message);
+    static bool readMessage(QCborStreamReader &reader, Message &message);
+
+    static void writeId(QCborStreamWriter &writer, const QString &id);
+    static QString readId(QCborStreamReader &reader);
+
+    /**
+     * @brief Read a (possibly chunked) text string; other items are skipped and read as empty
+     */
+    static QString readText(QCborStreamReader &reader);
+
+    /**
+     * @brief Encode/decode the conversation manifest file
+     *
+     * The decoders append every intact record they can read, also when they
+     * return false for a damaged file. Conversations missing from @p stats
+     * are written with empty stats; manifests from older versions decode
+     * without any.
+     */
+    static QByteArray encodeManifest(const ConversationList &conversations,
+                                     const QHash<QString, ConversationStats> &stats = {});
+    static bool decodeManifest(const QByteArray &data, ConversationList &conversations,
+                               QHash<QString, ConversationStats> *stats = nullptr);
+
+    /**
+     * @brief Encode/decode the message shard of one conversation
+     */
+    static QByteArray encodeShard(const MessageList &messages);
+    static bool decodeShard(const QByteArray &data, MessageList &messages);
+};
+
+} // namespace DesktopApp
@@ -0,0 +1,507 @@
+#include "StoreJournal.h"
+#include "StorageCodec.h"
+#include "Crc32c.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QCborStreamWriter>
+#include <QCborStreamReader>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace DesktopApp {
+
+namespace {
+
+const char *kSegmentPrefix = "journal-";
+const char *kSegmentSuffix = ".cwal";
+const char *kUncheckedSegmentSuffix = ".wal"; // binary segments written before frames had checksums
+const char *kLegacySegmentSuffix = ".log";    // JSON-lines segments of the JSON store format
+
+// Frames are [magic][uint32 little-endian payload length][uint32 CRC-32C of length and payload][CBOR record].
+// The magic lets replay find the next frame after a damaged one.
+const char kFrameMagic[4] = {'D', 'A', 'J', 'F'};
+const int kFrameHeaderSize = 12;
+const int kUncheckedFrameHeaderSize = 4;  // [uint32 length][CBOR record]
+
+void writeRecord(QCborStreamWriter &writer, const StoreJournal::Record &record)
+{
+    writer.startArray(4);
+    writer.append(qint64(record.operation));
+    writer.append(qint64(record.type));
+    StorageCodec::writeId(writer, record.id);
+    if (record.operation == StoreJournal::Operation::Delete) {
+        // Deletes only carry the owning conversation (messages) so replay can find the shard
+        StorageCodec::writeId(writer, record.conversationId);
+    } else if (record.operation == StoreJournal::Operation::Append) {
+        writer.startArray(2);
+        StorageCodec::writeId(writer, record.conversationId);
+        writer.append(record.text);
+        writer.endArray();
+    } else if (record.type == StoreJournal::RecordType::Conversation) {
+        StorageCodec::writeConversation(writer, record.conversation);
+    } else {
+        StorageCodec::writeMessage(writer, record.message);
+    }
+    writer.endArray();
+}
+
+QByteArray frame(const QByteArray &payload)
+{
+    QByteArray bytes(kFrameHeaderSize, Qt::Uninitialized);
+    memcpy(bytes.data(), kFrameMagic, 4);
+    qToLittleEndian<quint32>(quint32(payload.size()), bytes.data() + 4);
+    qToLittleEndian<quint32>(crc32c(payload, crc32c(bytes.constData() + 4, 4)), bytes.data() + 8);
+    bytes.append(payload);
+    return bytes;
+}
+
+QByteArray encodeRecord(const StoreJournal::Record &record)
+{
+    QByteArray payload;
+    QCborStreamWriter writer(&payload);
+    writeRecord(writer, record);
+    return frame(payload);
+}
+
+// A batch frame holds an array of records so it replays all-or-nothing
+QByteArray encodeBatch(const QVector<StoreJournal::Record> &records)
+{
+    QByteArray payload;
+    QCborStreamWriter writer(&payload);
+    writer.startArray(quint64(records.size()));
+    for (const StoreJournal::Record &record : records) {
+        writeRecord(writer, record);
+    }
+    writer.endArray();
+    return frame(payload);
+}
+
+bool readRecord(QCborStreamReader &reader, StoreJournal::Record &record)
+{
+    if (!reader.isArray() || !reader.enterContainer()) {
+        return false;
+    }
+
+    qint64 operation = reader.isInteger() ? reader.toInteger() : -1;
+    reader.next();
+    qint64 type = reader.isInteger() ? reader.toInteger() : -1;
+    reader.next();
+    if (operation < 0 || operation > qint64(StoreJournal::Operation::Append)
+        || type < 0 || type > qint64(StoreJournal::RecordType::Message)) {
+        return false;
+    }
+
+    record.operation = static_cast<StoreJournal::Operation>(operation);
+    record.type = static_cast<StoreJournal::RecordType>(type);
+    record.id = StorageCodec::readId(reader);
+
+    if (record.operation == StoreJournal::Operation::Delete) {
+        record.conversationId = StorageCodec::readId(reader);
+    } else if (record.operation == StoreJournal::Operation::Append) {
+        if (record.type != StoreJournal::RecordType::Message || !reader.isArray() || !reader.enterContainer()) {
+            return false;
+        }
+        record.conversationId = StorageCodec::readId(reader);
+        record.text = StorageCodec::readText(reader);
+        if (!reader.leaveContainer()) {
+            return false;
+        }
+    } else if (record.type == StoreJournal::RecordType::Conversation) {
+        if (!StorageCodec::readConversation(reader, record.conversation)) {
+            return false;
+        }
+    } else {
+        if (!StorageCodec::readMessage(reader, record.message)) {
+            return false;
+        }
+        record.conversationId = record.message.conversationId;
+    }
+
+    return reader.leaveContainer() && reader.lastError() == QCborError::NoError && !record.id.isEmpty();
+}
+
+/**
+ * @brief Decode one frame: a single record, or a batch whose records all decode
+ */
+bool decodeFrame(const QByteArray &payload, QVector<StoreJournal::Record> &records)
+{
+    QCborStreamReader reader(payload);
+    if (!reader.isArray() || !reader.enterContainer()) {
+        return false;
+    }
+
+    if (!reader.isArray()) {
+        // Single record: rewind and read it whole
+        StoreJournal::Record record;
+        QCborStreamReader single(payload);
+        if (!readRecord(single, record)) {
+            return false;
+        }
+        records.append(record);
+        return true;
+    }
+
+    while (reader.hasNext()) {
+        StoreJournal::Record record;
+        if (!readRecord(reader, record)) {
+            return false;
+        }
+        records.append(record);
+    }
+    return reader.leaveContainer() && reader.lastError() == QCborError::NoError;
+}
+
+/**
+ * @brief Replay a checksummed segment, skipping damaged frames
+ * @return Number of records applied; @p damaged counts the frames skipped
+ */
+int replayFrames(const QByteArray &data, const std::function<void(const StoreJournal::Record &)> &apply, int &damaged)
+{
+    int replayed = 0;
+    qsizetype offset = 0;
+    while (offset < data.size()) {
+        const qsizetype available = data.size() - offset;
+        if (available >= kFrameHeaderSize && memcmp(data.constData() + offset, kFrameMagic, 4) == 0) {
+            const qsizetype length = qFromLittleEndian<quint32>(data.constData() + offset + 4);
+            const quint32 checksum = qFromLittleEndian<quint32>(data.constData() + offset + 8);
+            if (length <= available - kFrameHeaderSize) {
+                const char *payload = data.constData() + offset + kFrameHeaderSize;
+                QVector<StoreJournal::Record> records;
+                if (crc32c(payload, length, crc32c(data.constData() + offset + 4, 4)) == checksum
+                    && decodeFrame(QByteArray::fromRawData(payload, length), records)) {
+                    for (const StoreJournal::Record &record : std::as_const(records)) {
+                        apply(record);
+                    }
+                    replayed += int(records.size());
+                    offset += kFrameHeaderSize + length;
+                    continue;
+                }
+            }
+        }
+
+        // Damaged or torn: resume at the next frame marker
+        ++damaged;
+        const qsizetype next = data.indexOf(QByteArray::fromRawData(kFrameMagic, 4), offset + 1);
+        if (next < 0) {
+            break;
+        }
+        offset = next;
+    }
+    return replayed;
+}
+
+/**
+ * @brief Replay a segment without checksums; replay stops at the first bad frame
+ */
+int replayUncheckedFrames(const QByteArray &data, const std::function<void(const StoreJournal::Record &)> &apply,
+                          int &damaged)
+{
+    int replayed = 0;
+    qsizetype offset = 0;
+    while (offset < data.size()) {
+        if (data.size() - offset < kUncheckedFrameHeaderSize) {
+            ++damaged;
+            break;
+        }
+        const qsizetype length = qFromLittleEndian<quint32>(data.constData() + offset);
+        if (data.size() - offset - kUncheckedFrameHeaderSize < length) {
+            ++damaged;
+            break;
+        }
+
+        QVector<StoreJournal::Record> records;
+        if (!decodeFrame(data.mid(offset + kUncheckedFrameHeaderSize, length), records)) {
+            ++damaged;
+            break;
+        }
+        for (const StoreJournal::Record &record : std::as_const(records)) {
+            apply(record);
+        }
+        replayed += int(records.size());
+        offset += kUncheckedFrameHeaderSize + length;
+    }
+    return replayed;
+}
+
+bool decodeLegacyRecord(const QByteArray &line, StoreJournal::Record &record)
+{
+    QJsonParseError error;
+    QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+    if (error.error != QJsonParseError::NoError || !doc.isObject()) {
+        return false;
+    }
+
+    QJsonObject obj = doc.object();
+    QString op = obj.value("op").toString();
+    QString type = obj.value("type").toString();
+    if ((op != "put" && op != "del") || (type != "conversation" && type != "message")) {
+        return false;
+    }
+
+    record.operation = op == "del" ? StoreJournal::Operation::Delete : StoreJournal::Operation::Put;
+    record.type = type == "conversation" ? StoreJournal::RecordType::Conversation : StoreJournal::RecordType::Message;
+    record.id = obj.value("id").toString();
+
+    const QJsonObject data = obj.value("data").toObject();
+    if (record.operation == StoreJournal::Operation::Delete) {
+        record.conversationId = data.value("conversationId").toString();
+    } else if (record.type == StoreJournal::RecordType::Conversation) {
+        record.conversation = Conversation::fromJson(data);
+    } else {
+        record.message = Message::fromJson(data);
+        record.conversationId = record.message.conversationId;
+    }
+    return !record.id.isEmpty();
+}
+
+} // namespace
+
+bool syncToDisk(QFileDevice &file)
+{
+    if (!file.isOpen() || !file.flush()) {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+StoreJournal::StoreJournal(QObject *parent)
+    : QObject(parent)
+    , m_flushTimer(new QTimer(this))
+{
+    m_flushTimer->setSingleShot(true);
+    m_flushTimer->setInterval(200); // Group-commit window
+    connect(m_flushTimer, &QTimer::timeout, this, [this]() { flush(); });
+}
+
+StoreJournal::~StoreJournal()
+{
+    close();
+}
+
+bool StoreJournal::open(const QString &directory)
+{
+    m_directory = directory;
+    if (!QDir().mkpath(directory)) {
+        qCritical() << "Failed to create journal directory:" << directory;
+        return false;
+    }
+
+    m_size = 0;
+    for (int segment : existingSegments(kLegacySegmentSuffix)) {
+        m_size += QFileInfo(segmentPath(segment, kLegacySegmentSuffix)).size();
+    }
+    int last = 0;
+    for (const char *suffix : {kUncheckedSegmentSuffix, kSegmentSuffix}) {
+        for (int segment : existingSegments(suffix)) {
+            m_size += QFileInfo(segmentPath(segment, suffix)).size();
+            last = std::max(last, segment);
+        }
+    }
+
+    // Never append behind a possibly torn tail: always start a fresh segment
+    return openSegment(last + 1);
+}
+
+void StoreJournal::close()
+{
+    if (m_file.isOpen()) {
+        flush();
+        m_file.close();
+    }
+}
+
+int StoreJournal::replay(const std::function<void(const Record &)> &apply)
+{
+    int replayed = 0;
+
+    // Segments left by the JSON store format predate every binary segment
+    for (int segment : existingSegments(kLegacySegmentSuffix)) {
+        QFile file(segmentPath(segment, kLegacySegmentSuffix));
+        if (!file.open(QIODevice::ReadOnly)) {
+            qWarning() << "Cannot read journal segment:" << file.fileName();
+            continue;
+        }
+
+        while (!file.atEnd()) {
+            QByteArray line = file.readLine();
+            Record record;
+            if (!line.endsWith('\n') || !decodeLegacyRecord(line, record)) {
+                qWarning() << "Stopping replay of" << file.fileName() << "at damaged record";
+                break;
+            }
+            apply(record);
+            ++replayed;
+        }
+    }
+
+    // Unchecked segments were all written before the first checksummed one
+    for (const char *suffix : {kUncheckedSegmentSuffix, kSegmentSuffix}) {
+        const bool checked = suffix == kSegmentSuffix;
+        for (int segment : existingSegments(suffix)) {
+            if (checked && segment == m_activeSegment) {
+                continue;
+            }
+
+            QFile file(segmentPath(segment, suffix));
+            if (!file.open(QIODevice::ReadOnly)) {
+                qWarning() << "Cannot read journal segment:" << file.fileName();
+                continue;
+            }
+
+            const QByteArray data = file.readAll();
+            int damaged = 0;
+            replayed += checked ? replayFrames(data, apply, damaged) : replayUncheckedFrames(data, apply, damaged);
+            if (damaged > 0) {
+                qWarning() << "Skipped" << damaged << "damaged or torn records in" << file.fileName();
+            }
+        }
+    }
+
+    if (replayed > 0) {
+        qDebug() << "Replayed" << replayed << "journal records";
+    }
+    return replayed;
+}
+
+void StoreJournal::append(const Record &record)
+{
+    appendFrame(encodeRecord(record));
+}
+
+void StoreJournal::appendBatch(const QVector<Record> &records)
+{
+    if (records.isEmpty()) {
+        return;
+    }
+    appendFrame(records.size() == 1 ? encodeRecord(records.first()) : encodeBatch(records));
+}
+
+void StoreJournal::appendFrame(const QByteArray &bytes)
+{
+    m_pending.append(bytes);
+    m_size += bytes.size();
+
+    if (!m_flushTimer->isActive()) {
+        m_flushTimer->start();
+    }
+}
+
+bool StoreJournal::flush()
+{
+    m_flushTimer->stop();
+    if (m_pending.isEmpty()) {
+        return true;
+    }
+    if (!m_file.isOpen()) {
+        qWarning() << "Journal is not open; dropping" << m_pending.size() << "bytes";
+        m_pending.clear();
+        return false;
+    }
+
+    bool ok = m_file.write(m_pending) == m_pending.size();
+    ok = syncToDisk(m_file) && ok;
+    if (!ok) {
+        qWarning() << "Failed to commit journal records:" << m_file.errorString();
+    }
+    m_pending.clear();
+    return ok;
+}
+
+int StoreJournal::rotate()
+{
+    if (!flush()) {
+        return -1;
+    }
+
+    int sealed = m_activeSegment;
+    m_file.close();
+    if (!openSegment(sealed + 1)) {
+        return -1;
+    }
+    return sealed;
+}
+
+void StoreJournal::discardThrough(int segment)
+{
+    m_size = m_pending.size();
+
+    // Legacy and unchecked segments are replayed before any checksummed one, so every checkpoint covers them
+    for (int existing : existingSegments(kLegacySegmentSuffix)) {
+        QString path = segmentPath(existing, kLegacySegmentSuffix);
+        if (!QFile::remove(path)) {
+            qWarning() << "Failed to remove journal segment:" << path;
+            m_size += QFileInfo(path).size();
+        }
+    }
+
+    for (int existing : existingSegments(kUncheckedSegmentSuffix)) {
+        QString path = segmentPath(existing, kUncheckedSegmentSuffix);
+        if (!QFile::remove(path)) {
+            qWarning() << "Failed to remove journal segment:" << path;
+            m_size += QFileInfo(path).size();
+        }
+    }
+
+    for (int existing : existingSegments(kSegmentSuffix)) {
+        QString path = segmentPath(existing, kSegmentSuffix);
+        if (existing > segment || existing == m_activeSegment) {
+            m_size += QFileInfo(path).size();
+        } else if (!QFile::remove(path)) {
+            qWarning() << "Failed to remove journal segment:" << path;
+            m_size += QFileInfo(path).size();
+        }
+    }
+}
+
+QString StoreJournal::segmentPath(int segment, const char *suffix) const
+{
+    return QDir(m_directory).filePath(QString("%1%2%3")
+                                      .arg(kSegmentPrefix)
+                                      .arg(segment, 6, 10, QChar('0'))
+                                      .arg(suffix));
+}
+
+QList<int> StoreJournal::existingSegments(const char *suffix) const
+{
+    QList<int> segments;
+    QDir dir(m_directory);
+    const QStringList files = dir.entryList({QString("%1*%2").arg(kSegmentPrefix, suffix)}, QDir::Files);
+    for (const QString &fileName : files) {
+        QString number = fileName.mid(int(strlen(kSegmentPrefix)));
+        number.chop(int(strlen(suffix)));
+        bool ok = false;
+        int segment = number.toInt(&ok);
+        if (ok) {
+            segments.append(segment);
+        }
+    }
+    std::sort(segments.begin(), segments.end());
+    return segments;
+}
+
+bool StoreJournal::openSegment(int segment)
+{
+    m_activeSegment = segment;
+    m_file.setFileName(segmentPath(segment, kSegmentSuffix));
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qCritical() << "Failed to open journal segment:" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+    return true;
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QFile>
+#include <QTimer>
+#include <QVector>
+#include <functional>
+#include "Models.h"
+
+namespace DesktopApp {
+
+/**
+ * @brief Flush OS buffers of an open file to stable storage (fsync/_commit)
+ */
+bool syncToDisk(QFileDevice &file);
+
+/**
+ * @brief Append-only write-ahead log for JsonStore mutations
+ *
+ * Records are buffered and written with a single fsync per group-commit
+ * window. The log is split into numbered segments so a checkpoint can seal
+ * the active segment, persist a snapshot and then discard everything it
+ * covers without racing new appends. Records are length-prefixed CBOR
+ * frames encoded with StorageCodec and protected by a CRC-32C; a batch
+ * shares one frame.
+ */
+class StoreJournal : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum class Operation {
+        Put,
+        Delete,
+        Append      // text added to the end of a message (streaming drafts)
+    };
+
+    enum class RecordType {
+        Conversation,
+        Message
+    };
+
+    struct Record {
+        Operation operation = Operation::Put;
+        RecordType type = RecordType::Message;
+        QString id;
+        QString conversationId;     // owner of a message record, so replay can locate its shard
+        Conversation conversation;  // Put of a conversation
+        Message message;            // Put of a message
+        QString text;               // Append to a message
+    };
+
+    explicit StoreJournal(QObject *parent = nullptr);
+    ~StoreJournal();
+
+    /**
+     * @brief Open the journal directory; existing segments are kept for replay
+     */
+    bool open(const QString &directory);
+
+    /**
+     * @brief Flush pending records and close the active segment
+     */
+    void close();
+
+    /**
+     * @brief Replay every segment in order
+     * @param apply Called once per intact record
+     * @return Number of records replayed
+     *
+     * Frames that fail their checksum, including a torn one at the end of a
+     * segment (crash mid-append), are skipped and replay resumes at the next
+     * intact frame. New records always go to a fresh segment afterwards.
+     */
+    int replay(const std::function<void(const Record &)> &apply);
+
+    /**
+     * @brief Queue a record; it becomes durable at the next group commit
+     */
+    void append(const Record &record);
+
+    /**
+     * @brief Queue several records as one frame; replay applies all of them or none
+     */
+    void appendBatch(const QVector<Record> &records);
+
+    /**
+     * @brief Write and fsync all queued records now
+     */
+    bool flush();
+
+    /**
+     * @brief Seal the active segment and start a new one
+     * @return Number of the sealed segment, or -1 on failure
+     */
+    int rotate();
+
+    /**
+     * @brief Delete all segments up to and including @p segment
+     */
+    void discardThrough(int segment);
+
+    /**
+     * @brief Bytes appended since the last discard (pending records included)
+     */
+    qint64 size() const { return m_size; }
+
+    void setGroupCommitInterval(int msec) { m_flushTimer->setInterval(msec); }
+
+private:
+    QString segmentPath(int segment, const char *suffix) const;
+    QList<int> existingSegments(const char *suffix) const;
+    bool openSegment(int segment);
+    void appendFrame(const QByteArray &bytes);
+
+    QString m_directory;
+    QFile m_file;
+    int m_activeSegment = 0;
+    QByteArray m_pending;
+    qint64 m_size = 0;
+    QTimer *m_flushTimer;
+};
+
+} // namespace DesktopApp
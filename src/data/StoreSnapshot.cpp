@@ -0,0 +1,151 @@
+#include "StoreSnapshot.h"
+#include "StorageCodec.h"
+#include <QFile>
+#include <QMutexLocker>
+#include <QDebug>
+#include <algorithm>
+
+namespace DesktopApp {
+
+StoreSnapshot::StoreSnapshot(quint64 version)
+    : m_version(version)
+{
+}
+
+ConversationList StoreSnapshot::conversations() const
+{
+    ConversationList list;
+    list.reserve(m_conversations.size());
+    for (const Conversation &conversation : m_conversations) {
+        if (conversation.isValid()) {
+            list.append(conversation);
+        }
+    }
+    return list;
+}
+
+Conversation StoreSnapshot::conversation(const QString &conversationId) const
+{
+    return m_conversations.value(conversationId);
+}
+
+MessageList StoreSnapshot::messages(const QString &conversationId) const
+{
+    if (!m_conversations.contains(conversationId)) {
+        return MessageList();
+    }
+
+    auto inMemory = m_shards.constFind(conversationId);
+    const Shard shard = inMemory != m_shards.constEnd() ? inMemory.value() : loadShard(conversationId);
+
+    MessageList list;
+    list.reserve(shard.index.size());
+    for (const MessageIndexEntry &entry : shard.index) {
+        auto it = shard.messages.constFind(entry.messageId);
+        if (it != shard.messages.constEnd() && MessageArena::isValid(it)) {
+            list.append(shard.messages.message(it));
+        }
+    }
+    return list;
+}
+
+Message StoreSnapshot::message(const QString &conversationId, const QString &messageId) const
+{
+    if (!m_conversations.contains(conversationId)) {
+        return Message();
+    }
+
+    auto inMemory = m_shards.constFind(conversationId);
+    const Shard shard = inMemory != m_shards.constEnd() ? inMemory.value() : loadShard(conversationId);
+
+    auto it = shard.messages.constFind(Id::fromString(messageId));
+    if (it == shard.messages.constEnd() || !MessageArena::isValid(it)) {
+        return Message();
+    }
+    return shard.messages.message(it);
+}
+
+bool StoreSnapshot::needsShard(const QString &conversationId) const
+{
+    if (!m_sources.contains(conversationId)) {
+        return false;
+    }
+    QMutexLocker locker(&m_mutex);
+    return !m_loaded.contains(conversationId);
+}
+
+void StoreSnapshot::provideShard(const QString &conversationId, const Shard &shard) const
+{
+    if (!m_sources.contains(conversationId)) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    if (!m_loaded.contains(conversationId)) {
+        m_loaded.insert(conversationId, shard);
+    }
+}
+
+StoreSnapshot::Shard StoreSnapshot::loadShard(const QString &conversationId) const
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        auto it = m_loaded.constFind(conversationId);
+        if (it != m_loaded.constEnd()) {
+            return it.value();
+        }
+    }
+
+    // Read without holding the lock so readers of other conversations are not held up.
+    // The store hands over a conversation's contents before touching its files, so a
+    // copy that arrived meanwhile is the one that matches the snapshot.
+    MessageList messages;
+    auto source = m_sources.constFind(conversationId);
+    if (source != m_sources.constEnd()) {
+        QByteArray data;
+        bool found = false;
+        QFile file(source->shardPath);
+        if (!source->shardPath.isEmpty() && file.open(QIODevice::ReadOnly)) {
+            data = file.readAll();
+            found = true;
+        } else if (!source->coldSegmentPath.isEmpty()) {
+            ColdTier::Entry entry = source->coldEntry;
+            found = (entry.segment >= 0 || ColdTier::findEntry(source->coldSegmentPath, conversationId, entry))
+                 && ColdTier::readEntry(source->coldSegmentPath, entry, data);
+        }
+        if (found && !data.isEmpty() && !StorageCodec::decodeShard(data, messages)) {
+            qWarning() << "Damaged shard in snapshot, reading what could be decoded:" << conversationId;
+        }
+    } else if (m_loader) {
+        messages = m_loader(conversationId);
+    }
+
+    Shard shard;
+    shard.messages.reserve(messages.size());
+    for (const Message &message : std::as_const(messages)) {
+        shard.messages.insert(message);
+    }
+    shard.index = buildIndex(shard.messages);
+
+    QMutexLocker locker(&m_mutex);
+    auto provided = m_loaded.constFind(conversationId);
+    if (provided != m_loaded.constEnd()) {
+        return provided.value();
+    }
+    m_loaded.insert(conversationId, shard);
+    return shard;
+}
+
+MessageIndex StoreSnapshot::buildIndex(const MessageArena &messages)
+{
+    MessageIndex index;
+    index.reserve(messages.size());
+    for (auto it = messages.constBegin(); it != messages.constEnd(); ++it) {
+        index.append({it->header.createdAt, it.key()});
+    }
+    std::stable_sort(index.begin(), index.end(), [](const MessageIndexEntry &a, const MessageIndexEntry &b) {
+        return a.createdAt < b.createdAt;
+    });
+    return index;
+}
+
+} // namespace DesktopApp
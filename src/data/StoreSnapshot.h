@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QString>
+#include <QHash>
+#include <QVector>
+#include <QMutex>
+#include <QDateTime>
+#include <functional>
+#include "Models.h"
+#include "ColdTier.h"
+#include "MessageArena.h"
+#include "Id.h"
+
+namespace DesktopApp {
+
+/**
+ * @brief Entry of a per-conversation message index, ordered by creation time
+ */
+struct MessageIndexEntry {
+    QDateTime createdAt;
+    Id messageId;
+};
+using MessageIndex = QVector<MessageIndexEntry>;
+
+/**
+ * @brief Immutable, point-in-time view of a conversation store
+ *
+ * Obtained from ConversationRepository::snapshot() on the store's thread and
+ * then safe to read from any thread, concurrently, for as long as it is
+ * held. Later writes to the store never show up in it.
+ *
+ * Data the store had in memory is shared copy-on-write, so taking a
+ * snapshot costs no message copies; the store pays for a copy only when it
+ * later modifies a shared conversation. Conversations that were not loaded
+ * are read from disk on first access; the store keeps those files, or hands
+ * over their contents before changing them, while the snapshot is alive.
+ * Stores without shard files supply a loader instead.
+ */
+class StoreSnapshot
+{
+public:
+    /**
+     * @brief Where to find a conversation that was not loaded at snapshot time
+     */
+    struct ShardSource {
+        QString shardPath;         // regular shard file, tried first
+        QString coldSegmentPath;   // cold copy, if any
+        ColdTier::Entry coldEntry; // segment < 0: look it up in the segment's index
+    };
+
+    /**
+     * @brief Reads the messages of a conversation as they were at snapshot time
+     *
+     * Called from any thread, concurrently, for conversations that have
+     * neither a shard nor a source; it serializes access itself.
+     */
+    using Loader = std::function<MessageList(const QString &conversationId)>;
+
+    /**
+     * @brief Messages of one conversation with their ordering
+     */
+    struct Shard {
+        MessageArena messages;
+        MessageIndex index;
+    };
+
+    explicit StoreSnapshot(quint64 version = 0);
+
+    /**
+     * @brief Store version the snapshot was taken at; equal versions hold equal data
+     */
+    quint64 version() const { return m_version; }
+
+    ConversationList conversations() const;
+    Conversation conversation(const QString &conversationId) const;
+    bool contains(const QString &conversationId) const { return m_conversations.contains(conversationId); }
+
+    /**
+     * @brief Messages of a conversation, oldest first; may read from disk
+     */
+    MessageList messages(const QString &conversationId) const;
+
+    /**
+     * @brief One message of a conversation; may read the conversation from disk
+     * @return an invalid message if it is not in the snapshot
+     */
+    Message message(const QString &conversationId, const QString &messageId) const;
+
+    // Filled in by the store while building the snapshot
+    void setConversations(const QHash<QString, Conversation> &conversations) { m_conversations = conversations; }
+    void addShard(const QString &conversationId, const Shard &shard) { m_shards.insert(conversationId, shard); }
+    void addSource(const QString &conversationId, const ShardSource &source) { m_sources.insert(conversationId, source); }
+    void setLoader(const Loader &loader) { m_loader = loader; }
+
+    /**
+     * @brief Whether the contents of @p conversationId must still be read from disk
+     */
+    bool needsShard(const QString &conversationId) const;
+
+    /**
+     * @brief Supply the contents of a conversation before the store changes its files
+     */
+    void provideShard(const QString &conversationId, const Shard &shard) const;
+
+private:
+    Shard loadShard(const QString &conversationId) const;
+    static MessageIndex buildIndex(const MessageArena &messages);
+
+    quint64 m_version;
+    QHash<QString, Conversation> m_conversations;
+    QHash<QString, Shard> m_shards;         // in memory at snapshot time
+    QHash<QString, ShardSource> m_sources;  // on disk at snapshot time
+    Loader m_loader;                        // everything else, if set
+
+    // Contents of m_sources read so far, by readers or handed over by the store
+    mutable QMutex m_mutex;
+    mutable QHash<QString, Shard> m_loaded;
+};
+
+} // namespace DesktopApp
@@ -7,6 +7,7 @@
 #include <QUuid>
 #include <QDebug>
 #include <QDirIterator>
+#include <algorithm>
 
 namespace DesktopApp {
 
@@ -39,7 +40,11 @@ bool FileVault::initialize()
         return false;
     }
     
-    qDebug() << "FileVault initialized successfully";
+    // The only full scan; stats are maintained incrementally from here on
+    m_stats = {};
+    scanDirectory(m_vaultPath, m_stats);
+    
+    qDebug() << "FileVault initialized successfully," << m_stats.totalFiles << "files," << m_stats.totalSize << "bytes";
     return true;
 }
 
@@ -95,6 +100,7 @@ QString FileVault::storeFileData(const QByteArray &data, const QString &fileName
     
     qint64 written = vaultFile.write(data);
     vaultFile.close();
+    countFile(m_stats, relativeVaultPath, std::max<qint64>(written, 0), 1); // removeFile() below takes it back
     
     if (written != data.size()) {
         qWarning() << "Failed to write complete file data";
@@ -118,9 +124,11 @@ bool FileVault::removeFile(const QString &vaultPath)
         return false;
     }
     
+    const qint64 size = file.size();
     bool success = file.remove();
     if (success) {
         qDebug() << "Removed file from vault:" << vaultPath;
+        countFile(m_stats, vaultPath, -size, -1);
         emit fileRemoved(vaultPath);
     } else {
         qWarning() << "Failed to remove file from vault:" << vaultPath;
@@ -199,16 +207,14 @@ int FileVault::cleanupOrphanedFiles(const QStringList &referencedPaths)
     return removedCount;
 }
 
+void FileVault::recordWrite(const QString &vaultPath, qint64 bytes, bool created)
+{
+    countFile(m_stats, vaultPath, bytes, created ? 1 : 0);
+}
+
 FileVault::VaultStats FileVault::getStats() const
 {
-    VaultStats stats = {};
-    
-    if (!m_vaultDir.exists()) {
-        return stats;
-    }
-    
-    scanDirectory(m_vaultPath, stats);
-    return stats;
+    return m_stats;
 }
 
 QStringList FileVault::getSupportedExtensions(const QString &category)
@@ -324,6 +330,32 @@ bool FileVault::createDirectoryStructure()
     return true;
 }
 
+QStringList FileVault::listFiles() const
+{
+    QStringList files;
+    QDirIterator it(m_vaultPath, QDir::Files, QDirIterator::Subdirectories);
+    
+    while (it.hasNext()) {
+        QString vaultPath = getVaultPath(it.next());
+        if (!vaultPath.isEmpty()) {
+            files.append(vaultPath);
+        }
+    }
+    
+    files.sort();
+    return files;
+}
+
+bool FileVault::isSafeVaultPath(const QString &vaultPath) const
+{
+    if (vaultPath.isEmpty() || QDir::isAbsolutePath(vaultPath)) {
+        return false;
+    }
+    
+    QString cleaned = QDir::cleanPath(vaultPath);
+    return cleaned != ".." && !cleaned.startsWith("../") && !cleaned.contains(':');
+}
+
 void FileVault::scanDirectory(const QString &dirPath, VaultStats &stats) const
 {
     QDirIterator it(dirPath, QDirIterator::Subdirectories);
@@ -333,21 +365,31 @@ void FileVault::scanDirectory(const QString &dirPath, VaultStats &stats) const
         QFileInfo info(filePath);
         
         if (info.isFile()) {
-            stats.totalFiles++;
-            stats.totalSize += info.size();
-            
-            QString extension = info.suffix().toLower();
-            if (IMAGE_EXTENSIONS.contains(extension)) {
-                stats.imageFiles++;
-            } else if (DOCUMENT_EXTENSIONS.contains(extension)) {
-                stats.documentFiles++;
-            } else if (AUDIO_EXTENSIONS.contains(extension)) {
-                stats.audioFiles++;
-            } else {
-                stats.otherFiles++;
-            }
+            countFile(stats, info.fileName(), info.size(), 1);
         }
     }
 }
 
+void FileVault::countFile(VaultStats &stats, const QString &fileName, qint64 bytes, int files)
+{
+    // Categorized by extension rather than by directory, like getCategoryForFile()
+    stats.totalFiles += files;
+    stats.totalSize += bytes;
+    
+    const QString category = getCategoryForFile(fileName);
+    if (category == "images") {
+        stats.imageFiles += files;
+        stats.imageBytes += bytes;
+    } else if (category == "documents") {
+        stats.documentFiles += files;
+        stats.documentBytes += bytes;
+    } else if (category == "audio") {
+        stats.audioFiles += files;
+        stats.audioBytes += bytes;
+    } else {
+        stats.otherFiles += files;
+        stats.otherBytes += bytes;
+    }
+}
+
 } // namespace DesktopApp
@@ -82,6 +82,18 @@ public:
      */
     QString getVaultPath(const QString &fullPath) const;
 
+    /**
+     * @brief Vault paths of every stored file
+     */
+    QStringList listFiles() const;
+
+    /**
+     * @brief Check that a vault path is relative and does not leave the vault
+     * @param vaultPath Path within the vault, e.g. from an imported archive
+     * @return true if the path is safe to write to
+     */
+    bool isSafeVaultPath(const QString &vaultPath) const;
+
     /**
      * @brief Clean up orphaned files not referenced by any attachments
      * @param referencedPaths List of currently referenced vault paths
@@ -89,8 +101,18 @@ public:
      */
     int cleanupOrphanedFiles(const QStringList &referencedPaths);
 
+    /**
+     * @brief Count bytes written into the vault other than through storeFileData()
+     * @param bytes Bytes added to the file
+     * @param created The file did not exist before
+     */
+    void recordWrite(const QString &vaultPath, qint64 bytes, bool created);
+
     /**
      * @brief Get vault usage statistics
+     *
+     * Counted once by initialize() and kept current as files are stored and
+     * removed, so reading them is O(1).
      */
     struct VaultStats {
         qint64 totalSize;
@@ -99,6 +121,10 @@ public:
         int documentFiles;
         int audioFiles;
         int otherFiles;
+        qint64 imageBytes;
+        qint64 documentBytes;
+        qint64 audioBytes;
+        qint64 otherBytes;
     };
     VaultStats getStats() const;
 
@@ -117,9 +143,11 @@ private:
     QString sanitizeFileName(const QString &fileName) const;
     bool createDirectoryStructure();
     void scanDirectory(const QString &dirPath, VaultStats &stats) const;
+    static void countFile(VaultStats &stats, const QString &fileName, qint64 bytes, int files);
 
     QString m_vaultPath;
     QDir m_vaultDir;
+    VaultStats m_stats = {};
     
     static const QStringList IMAGE_EXTENSIONS;
     static const QStringList DOCUMENT_EXTENSIONS;
@@ -0,0 +1,324 @@
+#include "HistoryArchive.h"
+#include "FileVault.h"
+#include "data/ConversationRepository.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QDateTime>
+#include <QDebug>
+#include <algorithm>
+
+namespace DesktopApp {
+
+namespace {
+
+const char *kArchiveFormat = "desktopapp-history";
+const int kArchiveVersion = 1;
+const int kExportPageSize = 500;                      // messages fetched per page while exporting
+const int kImportBatchRecords = 500;                  // records committed per import batch
+const qint64 kAttachmentChunkBytes = 512 * 1024;      // raw bytes per attachment line
+const qint64 kMaxLineBytes = 16 * 1024 * 1024;        // longer lines are skipped, not buffered
+
+} // namespace
+
+HistoryArchive::HistoryArchive(ConversationRepository *store, FileVault *fileVault, QObject *parent)
+    : QObject(parent)
+    , m_store(store)
+    , m_fileVault(fileVault)
+{
+}
+
+bool HistoryArchive::exportTo(const QString &path, bool includeAttachments)
+{
+    m_summary = Summary();
+    m_errorString.clear();
+    m_cancelled = false;
+    
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return fail(QString("Cannot write %1: %2").arg(path, file.errorString()));
+    }
+    
+    QJsonObject header;
+    header["type"] = "header";
+    header["format"] = kArchiveFormat;
+    header["version"] = kArchiveVersion;
+    header["exportedAt"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    header["attachments"] = includeAttachments && m_fileVault != nullptr;
+    if (!writeRecord(file, header)) {
+        file.cancelWriting();
+        return false;
+    }
+    
+    // Messages are paged so only one page is decoded at a time
+    const ConversationList conversations = m_store->getAllConversations();
+    for (int i = 0; i < conversations.size(); ++i) {
+        const Conversation &conversation = conversations[i];
+        if (m_cancelled) {
+            file.cancelWriting();
+            return fail("Export cancelled");
+        }
+    
+        QJsonObject record;
+        record["type"] = "conversation";
+        record["conversation"] = conversation.toJson();
+        if (!writeRecord(file, record)) {
+            file.cancelWriting();
+            return false;
+        }
+    
+        MessageCursor cursor;
+        while (true) {
+            const MessagePage page = m_store->getMessagesAfter(conversation.id, cursor, kExportPageSize);
+            for (const Message &message : page.messages) {
+                QJsonObject messageRecord;
+                messageRecord["type"] = "message";
+                messageRecord["message"] = message.toJson();
+                if (!writeRecord(file, messageRecord)) {
+                    file.cancelWriting();
+                    return false;
+                }
+                ++m_summary.messages;
+            }
+            if (!page.hasMoreAfter || page.messages.isEmpty()) {
+                break;
+            }
+            cursor = MessageCursor(page.messages.last());
+        }
+    
+        ++m_summary.conversations;
+        emit progress(i + 1, conversations.size());
+    }
+    
+    if (includeAttachments && m_fileVault && !exportAttachments(file)) {
+        file.cancelWriting();
+        return false;
+    }
+    
+    if (!file.commit()) {
+        return fail(QString("Cannot write %1: %2").arg(path, file.errorString()));
+    }
+    
+    qDebug() << "Exported" << m_summary.conversations << "conversations," << m_summary.messages
+             << "messages and" << m_summary.attachments << "attachments to" << path;
+    return true;
+}
+
+bool HistoryArchive::exportAttachments(QIODevice &device)
+{
+    const QStringList files = m_fileVault->listFiles();
+    for (const QString &vaultPath : files) {
+        if (m_cancelled) {
+            return fail("Export cancelled");
+        }
+    
+        QFile source(m_fileVault->getFullPath(vaultPath));
+        if (!source.open(QIODevice::ReadOnly)) {
+            qWarning() << "Skipping unreadable vault file:" << vaultPath;
+            continue;
+        }
+    
+        // Split into chunks so neither side holds a whole large file in one line
+        const qint64 size = source.size();
+        qint64 offset = 0;
+        do {
+            const QByteArray chunk = source.read(kAttachmentChunkBytes);
+            QJsonObject record;
+            record["type"] = "attachment";
+            record["path"] = vaultPath;
+            record["offset"] = offset;
+            record["size"] = size;
+            record["data"] = QString::fromLatin1(chunk.toBase64());
+            if (!writeRecord(device, record)) {
+                return false;
+            }
+            if (chunk.isEmpty()) {
+                break;
+            }
+            offset += chunk.size();
+        } while (offset < size);
+    
+        ++m_summary.attachments;
+    }
+    return true;
+}
+
+bool HistoryArchive::importFrom(const QString &path)
+{
+    m_summary = Summary();
+    m_errorString.clear();
+    m_cancelled = false;
+    
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return fail(QString("Cannot read %1: %2").arg(path, file.errorString()));
+    }
+    const qint64 total = file.size();
+    
+    bool headerSeen = false;
+    QString currentConversationId;    // messages follow their conversation, so one lookup per conversation
+    bool conversationExists = false;
+    QString keptAttachment;           // vault file that already existed; its chunks are ignored
+    int batched = 0;
+    bool committed = true;
+    
+    m_store->beginBatch();
+    while (!file.atEnd() && !m_cancelled) {
+        QByteArray line = file.readLine(kMaxLineBytes);
+        if (!line.endsWith('\n') && !file.atEnd()) {
+            // Longer than anything an export writes: drop the rest of the line unread
+            while (!file.atEnd() && !file.readLine(kMaxLineBytes).endsWith('\n')) {
+            }
+            ++m_summary.skipped;
+            continue;
+        }
+        line = line.trimmed();
+        if (line.isEmpty()) {
+            continue;
+        }
+    
+        QJsonParseError error;
+        const QJsonDocument document = QJsonDocument::fromJson(line, &error);
+        if (error.error != QJsonParseError::NoError || !document.isObject()) {
+            ++m_summary.skipped;
+            continue;
+        }
+        const QJsonObject record = document.object();
+        const QString type = record.value("type").toString();
+    
+        if (!headerSeen) {
+            if (type != "header" || record.value("format").toString() != kArchiveFormat) {
+                m_store->commitBatch();
+                return fail(QString("%1 is not a history archive").arg(path));
+            }
+            if (record.value("version").toInt() > kArchiveVersion) {
+                m_store->commitBatch();
+                return fail(QString("%1 was written by a newer version").arg(path));
+            }
+            headerSeen = true;
+            continue;
+        }
+    
+        if (type == "conversation") {
+            const Conversation conversation = Conversation::fromJson(record.value("conversation").toObject());
+            if (!conversation.isValid()) {
+                ++m_summary.skipped;
+                continue;
+            }
+            if (m_store->getConversation(conversation.id).isValid()) {
+                // The imported copy replaces it, so messages missing from the archive go
+                for (const Message &existing : m_store->getMessagesForConversation(conversation.id)) {
+                    m_store->deleteMessage(existing.id);
+                }
+                m_store->updateConversation(conversation);
+            } else {
+                m_store->createConversation(conversation);
+            }
+            currentConversationId = conversation.id;
+            conversationExists = true;
+            ++m_summary.conversations;
+        } else if (type == "message") {
+            const Message message = Message::fromJson(record.value("message").toObject());
+            if (message.conversationId != currentConversationId) {
+                currentConversationId = message.conversationId;
+                conversationExists = m_store->getConversation(currentConversationId).isValid();
+            }
+            if (!message.isValid() || !conversationExists) {
+                ++m_summary.skipped;
+                continue;
+            }
+            m_store->createMessage(message);
+            ++m_summary.messages;
+        } else if (type == "attachment") {
+            if (!importAttachmentChunk(record, keptAttachment)) {
+                ++m_summary.skipped;
+            }
+            continue;
+        } else {
+            ++m_summary.skipped;
+            continue;
+        }
+    
+        if (++batched >= kImportBatchRecords) {
+            committed = m_store->commitBatch() && committed;
+            batched = 0;
+            emit progress(file.pos(), total);
+            m_store->beginBatch();
+        }
+    }
+    committed = m_store->commitBatch() && committed;
+    emit progress(file.pos(), total);
+    
+    qDebug() << "Imported" << m_summary.conversations << "conversations," << m_summary.messages
+             << "messages and" << m_summary.attachments << "attachments from" << path
+             << "(" << m_summary.skipped << "records skipped)";
+    
+    if (!headerSeen) {
+        return fail(QString("%1 is not a history archive").arg(path));
+    }
+    if (!committed) {
+        return fail("The store failed to save part of the import");
+    }
+    if (m_cancelled) {
+        return fail("Import cancelled");
+    }
+    return true;
+}
+
+bool HistoryArchive::importAttachmentChunk(const QJsonObject &record, QString &keptAttachment)
+{
+    const QString vaultPath = record.value("path").toString();
+    const qint64 offset = record.value("offset").toInteger(-1);
+    if (!m_fileVault || !m_fileVault->isSafeVaultPath(vaultPath) || offset < 0) {
+        return false;
+    }
+    if (vaultPath == keptAttachment) {
+        return true;
+    }
+    
+    const QString fullPath = m_fileVault->getFullPath(vaultPath);
+    QFile target(fullPath);
+    if (offset == 0) {
+        // Vault names are unique, so an existing file is the same attachment; never overwrite it
+        keptAttachment.clear();
+        if (target.exists()) {
+            keptAttachment = vaultPath;
+            return true;
+        }
+        if (!QDir().mkpath(QFileInfo(fullPath).absolutePath()) || !target.open(QIODevice::WriteOnly)) {
+            qWarning() << "Cannot restore vault file:" << vaultPath;
+            return false;
+        }
+        ++m_summary.attachments;
+    } else if (target.size() != offset || !target.open(QIODevice::Append)) {
+        qWarning() << "Out of order chunk for vault file:" << vaultPath;
+        return false;
+    }
+    
+    const QByteArray data = QByteArray::fromBase64(record.value("data").toString().toLatin1());
+    const qint64 written = target.write(data);
+    m_fileVault->recordWrite(vaultPath, std::max<qint64>(written, 0), offset == 0);
+    return written == data.size();
+}
+
+bool HistoryArchive::writeRecord(QIODevice &device, const QJsonObject &record)
+{
+    QByteArray line = QJsonDocument(record).toJson(QJsonDocument::Compact);
+    line.append('\n');
+    if (device.write(line) != line.size()) {
+        return fail(QString("Write failed: %1").arg(device.errorString()));
+    }
+    return true;
+}
+
+bool HistoryArchive::fail(const QString &error)
+{
+    m_errorString = error;
+    qWarning() << "History archive:" << error;
+    return false;
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QJsonObject>
+
+class QIODevice;
+
+namespace DesktopApp {
+
+class ConversationRepository;
+class FileVault;
+
+/**
+ * @brief Streaming export and import of the whole conversation history
+ *
+ * Archives are line-delimited JSON: a header line, then one line per
+ * conversation followed by its messages, then optionally the FileVault
+ * files split into base64 chunks. Both directions work record by record,
+ * so memory use does not grow with the archive size. Imports are committed
+ * in batches; while importing, keep the event loop turning (progress() is
+ * emitted after every batch, e.g. into a modal QProgressDialog) so the
+ * store can checkpoint and unload what was written.
+ */
+class HistoryArchive : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * @brief Records written or read by the last export or import
+     */
+    struct Summary {
+        int conversations = 0;
+        int messages = 0;
+        int attachments = 0;   // vault files
+        int skipped = 0;       // malformed, unknown or orphaned records
+    };
+
+    HistoryArchive(ConversationRepository *store, FileVault *fileVault, QObject *parent = nullptr);
+
+    /**
+     * @brief Write every conversation and message to @p path
+     * @param includeAttachments Also embed the files stored in the FileVault
+     * @return true if the archive was written completely
+     */
+    bool exportTo(const QString &path, bool includeAttachments);
+
+    /**
+     * @brief Merge an archive into the store; conversations with the same id are replaced
+     * @return true if the whole archive was read; false on a read error or cancellation
+     */
+    bool importFrom(const QString &path);
+
+    /**
+     * @brief Stop the running export or import after the current record
+     */
+    void cancel() { m_cancelled = true; }
+
+    Summary summary() const { return m_summary; }
+    QString errorString() const { return m_errorString; }
+
+signals:
+    /**
+     * @brief Export: conversations written; import: archive bytes read
+     */
+    void progress(qint64 done, qint64 total);
+
+private:
+    bool writeRecord(QIODevice &device, const QJsonObject &record);
+    bool exportAttachments(QIODevice &device);
+    bool importAttachmentChunk(const QJsonObject &record, QString &skippedPath);
+    bool fail(const QString &error);
+
+    ConversationRepository *m_store;
+    FileVault *m_fileVault;
+    Summary m_summary;
+    QString m_errorString;
+    bool m_cancelled = false;
+};
+
+} // namespace DesktopApp
@@ -0,0 +1,493 @@
+#include "IndexSegment.h"
+#include "TermIndex.h"
+#include <QSaveFile>
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <utility>
+
+namespace DesktopApp {
+
+namespace {
+
+// [header][documents][conversations][message order][terms][postings][strings],
+// every section starting on an 8-byte boundary
+const char kMagic[8] = {'D', 'A', 'S', 'E', 'A', 'R', 'C', 'H'};
+const quint32 kVersion = 1;
+const int kHeaderSize = 128;
+const int kDocumentSize = 32;       // id (offset, length), conversation, termCount, createdAt, length, UTF-8 bytes
+const int kConversationSize = 16;   // id (offset, length), first document, document count
+const int kMessageOrderSize = 4;    // document number, in message id order
+const int kTermSize = 16;           // term (offset, length), first posting, posting count
+const int kPostingSize = 8;         // document, frequency
+const qint64 kNoTimestamp = std::numeric_limits<qint64>::min();
+
+quint32 read32(const uchar *data) { return qFromLittleEndian<quint32>(data); }
+quint64 read64(const uchar *data) { return qFromLittleEndian<quint64>(data); }
+
+void append32(QByteArray &out, quint32 value)
+{
+    char bytes[4];
+    qToLittleEndian<quint32>(value, bytes);
+    out.append(bytes, 4);
+}
+
+void append64(QByteArray &out, quint64 value)
+{
+    char bytes[8];
+    qToLittleEndian<quint64>(value, bytes);
+    out.append(bytes, 8);
+}
+
+quint64 aligned(quint64 offset)
+{
+    return (offset + 7) & ~quint64(7);
+}
+
+int compareBytes(const char *a, qsizetype aLength, const char *b, qsizetype bLength)
+{
+    const int result = std::memcmp(a, b, size_t(std::min(aLength, bLength)));
+    if (result != 0) {
+        return result;
+    }
+    return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+}
+
+bool lessBytes(const QByteArray &a, const QByteArray &b)
+{
+    return compareBytes(a.constData(), a.size(), b.constData(), b.size()) < 0;
+}
+
+/**
+ * @brief UTF-8 strings of a segment, referenced by offset and length
+ */
+class StringPool
+{
+public:
+    void append(QByteArray &out, const QByteArray &string)
+    {
+        append32(out, quint32(m_bytes.size()));
+        append32(out, quint32(string.size()));
+        m_bytes.append(string);
+    }
+
+    const QByteArray &bytes() const { return m_bytes; }
+
+private:
+    QByteArray m_bytes;
+};
+
+bool writePadded(QSaveFile &file, const QByteArray &section)
+{
+    if (file.write(section) != section.size()) {
+        return false;
+    }
+    const QByteArray padding(int(aligned(quint64(section.size())) - quint64(section.size())), '\0');
+    return file.write(padding) == padding.size();
+}
+
+} // namespace
+
+IndexSegment::Posting IndexSegment::PostingList::at(int i) const
+{
+    const uchar *posting = m_data + qsizetype(i) * kPostingSize;
+    return {int(read32(posting)), int(read32(posting + 4))};
+}
+
+IndexSegment::~IndexSegment()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+    }
+    m_file.close();
+    if (m_removeWhenClosed && !m_file.fileName().isEmpty()) {
+        QFile::remove(m_file.fileName());
+    }
+}
+
+bool IndexSegment::open(const QString &path)
+{
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < kHeaderSize) {
+        qWarning() << "Cannot open search index segment:" << path;
+        return false;
+    }
+    m_size = m_file.size();
+    m_data = m_file.map(0, m_size);
+    if (!m_data) {
+        qWarning() << "Cannot map search index segment:" << path;
+        return false;
+    }
+
+    if (std::memcmp(m_data, kMagic, sizeof(kMagic)) != 0 || read32(m_data + 8) != kVersion) {
+        qWarning() << "Not a search index segment of this version:" << path;
+        return false;
+    }
+    m_documentCount = int(read32(m_data + 12));
+    m_conversationCount = int(read32(m_data + 16));
+    m_termCount = int(read32(m_data + 20));
+    m_totalTerms = qint64(read64(m_data + 24));
+    m_indexedChars = qint64(read64(m_data + 32));
+    m_documentsOffset = read64(m_data + 40);
+    m_conversationsOffset = read64(m_data + 48);
+    m_messageOrderOffset = read64(m_data + 56);
+    m_termsOffset = read64(m_data + 64);
+    m_postingsOffset = read64(m_data + 72);
+    m_postingCount = read64(m_data + 80);
+    m_stringsOffset = read64(m_data + 88);
+    m_stringsSize = read64(m_data + 96);
+
+    // Every table must lie inside the file; entries are bounds-checked as they are read
+    const quint64 size = quint64(m_size);
+    const auto fits = [size](quint64 offset, quint64 count, int recordSize) {
+        return offset <= size && count <= (size - offset) / quint64(recordSize);
+    };
+    if (m_documentCount < 0 || m_conversationCount < 0 || m_termCount < 0 || read64(m_data + 104) != size
+        || !fits(m_documentsOffset, quint64(m_documentCount), kDocumentSize)
+        || !fits(m_conversationsOffset, quint64(m_conversationCount), kConversationSize)
+        || !fits(m_messageOrderOffset, quint64(m_documentCount), kMessageOrderSize)
+        || !fits(m_termsOffset, quint64(m_termCount), kTermSize)
+        || !fits(m_postingsOffset, m_postingCount, kPostingSize)
+        || !fits(m_stringsOffset, m_stringsSize, 1)) {
+        qWarning() << "Damaged search index segment:" << path;
+        return false;
+    }
+    return true;
+}
+
+IndexSegment::Document IndexSegment::document(int number) const
+{
+    Document document;
+    if (number < 0 || number >= m_documentCount) {
+        return document;
+    }
+    const uchar *entry = record(m_documentsOffset, number, kDocumentSize);
+    document.messageId = string(entry);
+    const quint32 conversation = read32(entry + 8);
+    if (conversation < quint32(m_conversationCount)) {
+        document.conversationId = string(record(m_conversationsOffset, int(conversation), kConversationSize));
+    }
+    document.termCount = int(read32(entry + 12));
+    const qint64 createdAt = qint64(read64(entry + 16));
+    if (createdAt != kNoTimestamp) {
+        document.createdAt = QDateTime::fromMSecsSinceEpoch(createdAt);
+    }
+    document.length = int(read32(entry + 24));
+    document.bytes = int(read32(entry + 28));
+    return document;
+}
+
+QString IndexSegment::messageId(int number) const
+{
+    if (number < 0 || number >= m_documentCount) {
+        return QString();
+    }
+    return string(record(m_documentsOffset, number, kDocumentSize));
+}
+
+int IndexSegment::documentTermCount(int number) const
+{
+    return number >= 0 && number < m_documentCount ? int(read32(record(m_documentsOffset, number, kDocumentSize) + 12)) : 0;
+}
+
+int IndexSegment::documentLength(int number) const
+{
+    return number >= 0 && number < m_documentCount ? int(read32(record(m_documentsOffset, number, kDocumentSize) + 24)) : 0;
+}
+
+int IndexSegment::findMessage(const QString &messageId) const
+{
+    const QByteArray key = messageId.toUtf8();
+    int low = 0;
+    int high = m_documentCount;
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const quint32 number = read32(record(m_messageOrderOffset, middle, kMessageOrderSize));
+        if (number >= quint32(m_documentCount)) {
+            return -1;
+        }
+        const int order = compare(record(m_documentsOffset, int(number), kDocumentSize), key);
+        if (order == 0) {
+            return int(number);
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return -1;
+}
+
+bool IndexSegment::findConversation(const QString &conversationId, int &first, int &count) const
+{
+    const QByteArray key = conversationId.toUtf8();
+    int low = 0;
+    int high = m_conversationCount;
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const uchar *entry = record(m_conversationsOffset, middle, kConversationSize);
+        const int order = compare(entry, key);
+        if (order == 0) {
+            first = int(read32(entry + 8));
+            count = int(read32(entry + 12));
+            return first >= 0 && count >= 0 && first <= m_documentCount - count;
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return false;
+}
+
+IndexSegment::PostingList IndexSegment::postings(const QByteArray &term) const
+{
+    int low = 0;
+    int high = m_termCount;
+    while (low < high) {
+        const int middle = low + (high - low) / 2;
+        const int order = compare(record(m_termsOffset, middle, kTermSize), term);
+        if (order == 0) {
+            return postingsAt(middle);
+        }
+        if (order < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    return PostingList();
+}
+
+QString IndexSegment::term(int number) const
+{
+    return number >= 0 && number < m_termCount ? string(record(m_termsOffset, number, kTermSize)) : QString();
+}
+
+IndexSegment::PostingList IndexSegment::postingsAt(int number) const
+{
+    PostingList list;
+    if (number < 0 || number >= m_termCount) {
+        return list;
+    }
+    const uchar *entry = record(m_termsOffset, number, kTermSize);
+    const quint64 first = read32(entry + 8);
+    const quint64 count = read32(entry + 12);
+    if (first + count <= m_postingCount) {
+        list.m_data = m_data + m_postingsOffset + first * kPostingSize;
+        list.m_size = int(count);
+    }
+    return list;
+}
+
+int IndexSegment::countDistinctTerms(const QVector<std::shared_ptr<IndexSegment>> &segments)
+{
+    // The dictionaries share one byte order, so a term held by several segments comes up
+    // at the head of each of them at the same step and is counted once
+    QVector<int> next(segments.size(), 0);
+    int distinct = 0;
+    while (true) {
+        QByteArray smallest;
+        bool found = false;
+        for (int i = 0; i < segments.size(); ++i) {
+            const IndexSegment &segment = *segments.at(i);
+            if (next.at(i) < segment.m_termCount) {
+                const QByteArray head = segment.bytes(segment.record(segment.m_termsOffset, next.at(i), kTermSize));
+                if (!found || lessBytes(head, smallest)) {
+                    smallest = head;
+                    found = true;
+                }
+            }
+        }
+        if (!found) {
+            return distinct;
+        }
+        ++distinct;
+        for (int i = 0; i < segments.size(); ++i) {
+            const IndexSegment &segment = *segments.at(i);
+            if (next.at(i) < segment.m_termCount
+                && segment.compare(segment.record(segment.m_termsOffset, next.at(i), kTermSize), smallest) == 0) {
+                ++next[i];
+            }
+        }
+    }
+}
+
+QByteArray IndexSegment::bytes(const uchar *reference) const
+{
+    const quint64 offset = read32(reference);
+    const quint64 length = read32(reference + 4);
+    if (offset + length > m_stringsSize) {
+        return QByteArray();
+    }
+    return QByteArray::fromRawData(reinterpret_cast<const char *>(m_data + m_stringsOffset + offset), qsizetype(length));
+}
+
+QString IndexSegment::string(const uchar *reference) const
+{
+    return QString::fromUtf8(bytes(reference));
+}
+
+int IndexSegment::compare(const uchar *reference, const QByteArray &key) const
+{
+    const QByteArray stored = bytes(reference);
+    return compareBytes(stored.constData(), stored.size(), key.constData(), key.size());
+}
+
+bool IndexSegment::write(const QString &path, const TermIndex &index)
+{
+    // Live documents, grouped by conversation and otherwise in index order
+    struct Source {
+        int position;
+        QByteArray messageId;
+        QByteArray conversationId;
+    };
+    QVector<Source> sources;
+    sources.reserve(index.documentIds.size());
+    for (int position = 0; position < index.documents.size(); ++position) {
+        const TermIndex::Document &document = index.documents.at(position);
+        if (!document.messageId.isEmpty()) {
+            sources.append({position, document.messageId.toUtf8(), document.conversationId.toUtf8()});
+        }
+    }
+    std::sort(sources.begin(), sources.end(), [](const Source &a, const Source &b) {
+        const int order = compareBytes(a.conversationId.constData(), a.conversationId.size(),
+                                       b.conversationId.constData(), b.conversationId.size());
+        return order != 0 ? order < 0 : a.position < b.position;
+    });
+    QVector<int> numbers(index.documents.size(), -1);
+    for (int number = 0; number < sources.size(); ++number) {
+        numbers[sources.at(number).position] = number;
+    }
+
+    StringPool pool;
+    QByteArray conversations;
+    QVector<quint32> conversationOf(sources.size());
+    for (int first = 0; first < sources.size();) {
+        int end = first + 1;
+        while (end < sources.size() && sources.at(end).conversationId == sources.at(first).conversationId) {
+            ++end;
+        }
+        const quint32 conversation = quint32(conversations.size() / kConversationSize);
+        pool.append(conversations, sources.at(first).conversationId);
+        append32(conversations, quint32(first));
+        append32(conversations, quint32(end - first));
+        for (int number = first; number < end; ++number) {
+            conversationOf[number] = conversation;
+        }
+        first = end;
+    }
+
+    QByteArray documents;
+    documents.reserve(sources.size() * kDocumentSize);
+    for (int number = 0; number < sources.size(); ++number) {
+        const TermIndex::Document &document = index.documents.at(sources.at(number).position);
+        pool.append(documents, sources.at(number).messageId);
+        append32(documents, conversationOf.at(number));
+        append32(documents, quint32(document.termCount));
+        append64(documents, quint64(document.createdAt.isValid() ? document.createdAt.toMSecsSinceEpoch() : kNoTimestamp));
+        append32(documents, quint32(document.length));
+        append32(documents, quint32(document.bytes));
+    }
+
+    QVector<int> byMessage(sources.size());
+    for (int number = 0; number < sources.size(); ++number) {
+        byMessage[number] = number;
+    }
+    std::sort(byMessage.begin(), byMessage.end(), [&sources](int a, int b) {
+        return lessBytes(sources.at(a).messageId, sources.at(b).messageId);
+    });
+    QByteArray messageOrder;
+    for (int number : std::as_const(byMessage)) {
+        append32(messageOrder, quint32(number));
+    }
+
+    struct TermSource {
+        QByteArray term;
+        const QVector<TermIndex::Posting> *postings;
+    };
+    QVector<TermSource> terms;
+    terms.reserve(index.postings.size());
+    for (auto list = index.postings.cbegin(); list != index.postings.cend(); ++list) {
+        terms.append({list.key().toUtf8(), &list.value()});
+    }
+    std::sort(terms.begin(), terms.end(), [](const TermSource &a, const TermSource &b) {
+        return lessBytes(a.term, b.term);
+    });
+    QByteArray dictionary;
+    dictionary.reserve(terms.size() * kTermSize);
+    quint64 postingCount = 0;
+    for (const TermSource &term : std::as_const(terms)) {
+        pool.append(dictionary, term.term);
+        append32(dictionary, quint32(postingCount));
+        append32(dictionary, quint32(term.postings->size()));
+        postingCount += quint64(term.postings->size());
+    }
+    if (postingCount > std::numeric_limits<quint32>::max()) {
+        qWarning() << "Too many postings for one search index segment:" << postingCount;
+        return false;
+    }
+
+    const quint64 documentsOffset = kHeaderSize;
+    const quint64 conversationsOffset = aligned(documentsOffset + quint64(documents.size()));
+    const quint64 messageOrderOffset = aligned(conversationsOffset + quint64(conversations.size()));
+    const quint64 termsOffset = aligned(messageOrderOffset + quint64(messageOrder.size()));
+    const quint64 postingsOffset = aligned(termsOffset + quint64(dictionary.size()));
+    const quint64 stringsOffset = aligned(postingsOffset + postingCount * kPostingSize);
+    const quint64 fileSize = aligned(stringsOffset + quint64(pool.bytes().size()));
+
+    QByteArray header(kMagic, int(sizeof(kMagic)));
+    append32(header, kVersion);
+    append32(header, quint32(sources.size()));
+    append32(header, quint32(conversations.size() / kConversationSize));
+    append32(header, quint32(terms.size()));
+    append64(header, quint64(index.totalTerms));
+    append64(header, quint64(index.indexedChars));
+    for (quint64 value : {documentsOffset, conversationsOffset, messageOrderOffset, termsOffset, postingsOffset,
+                          postingCount, stringsOffset, quint64(pool.bytes().size()), fileSize}) {
+        append64(header, value);
+    }
+    header.append(QByteArray(kHeaderSize - header.size(), '\0'));
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)
+        || !writePadded(file, header) || !writePadded(file, documents) || !writePadded(file, conversations)
+        || !writePadded(file, messageOrder) || !writePadded(file, dictionary)) {
+        qWarning() << "Cannot write search index segment:" << path;
+        return false;
+    }
+
+    // Postings renumbered into segment order, one term at a time
+    QVector<TermIndex::Posting> renumbered;
+    QByteArray chunk;
+    for (const TermSource &term : std::as_const(terms)) {
+        renumbered.clear();
+        for (const TermIndex::Posting &posting : *term.postings) {
+            renumbered.append({numbers.value(posting.document, -1), posting.frequency});
+        }
+        std::sort(renumbered.begin(), renumbered.end(), [](const TermIndex::Posting &a, const TermIndex::Posting &b) {
+            return a.document < b.document;
+        });
+        for (const TermIndex::Posting &posting : std::as_const(renumbered)) {
+            append32(chunk, quint32(posting.document));
+            append32(chunk, quint32(posting.frequency));
+        }
+        if (chunk.size() >= 1 << 20) {
+            if (file.write(chunk) != chunk.size()) {
+                return false;
+            }
+            chunk.clear();
+        }
+    }
+    if (!writePadded(file, chunk) || !writePadded(file, pool.bytes()) || !file.commit()) {
+        qWarning() << "Cannot write search index segment:" << path;
+        return false;
+    }
+    return true;
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <QString>
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QVector>
+#include <memory>
+
+namespace DesktopApp {
+
+struct TermIndex;
+
+/**
+ * @brief Immutable search index segment, memory-mapped from disk
+ *
+ * Written once from a TermIndex and never modified: a header, a document
+ * table grouped by conversation, a conversation table and a message table
+ * for lookups by id, a sorted term dictionary, the postings of every term
+ * and a pool of UTF-8 strings. All integers are little-endian. Reading a
+ * segment decodes only what a query touches, so opening one costs a
+ * mapping and a header check, whatever its size.
+ *
+ * Messages removed after the segment was written are masked by its owner;
+ * the file itself only shrinks when segments are merged into a new one.
+ * Once opened, a segment may be read from any thread.
+ */
+class IndexSegment
+{
+public:
+    struct Document {
+        QString messageId;
+        QString conversationId;
+        QDateTime createdAt;
+        int termCount = 0;
+        int length = 0;
+        int bytes = 0;
+    };
+
+    struct Posting {
+        int document;
+        int frequency;
+    };
+
+    /**
+     * @brief Postings of one term, ordered by document, read straight from the mapping
+     */
+    class PostingList
+    {
+    public:
+        int size() const { return m_size; }
+        Posting at(int i) const;
+
+    private:
+        friend class IndexSegment;
+        const uchar *m_data = nullptr;
+        int m_size = 0;
+    };
+
+    IndexSegment() = default;
+    ~IndexSegment();
+
+    IndexSegment(const IndexSegment &) = delete;
+    IndexSegment &operator=(const IndexSegment &) = delete;
+
+    /**
+     * @brief Map the segment at @p path and check its header and table bounds
+     */
+    bool open(const QString &path);
+    QString path() const { return m_file.fileName(); }
+
+    /**
+     * @brief Delete the file once the last user lets go of the segment
+     */
+    void removeWhenClosed() { m_removeWhenClosed = true; }
+
+    int documentCount() const { return m_documentCount; }
+    int termCount() const { return m_termCount; }
+    qint64 totalTerms() const { return m_totalTerms; }
+    qint64 indexedChars() const { return m_indexedChars; }
+
+    Document document(int number) const;
+    QString messageId(int number) const;
+    int documentTermCount(int number) const;
+    int documentLength(int number) const;
+
+    /**
+     * @brief Document number of a message, or -1
+     */
+    int findMessage(const QString &messageId) const;
+
+    /**
+     * @brief Documents of a conversation, which are numbered consecutively
+     */
+    bool findConversation(const QString &conversationId, int &first, int &count) const;
+
+    /**
+     * @brief Postings of a term given as UTF-8; empty if the term is not in the segment
+     */
+    PostingList postings(const QByteArray &term) const;
+
+    /**
+     * @brief Dictionary entries in term order, for merges and suggestions
+     */
+    QString term(int number) const;
+    PostingList postingsAt(int number) const;
+
+    /**
+     * @brief Distinct terms across the dictionaries of @p segments, read in one ordered pass
+     */
+    static int countDistinctTerms(const QVector<std::shared_ptr<IndexSegment>> &segments);
+
+    /**
+     * @brief Write the live documents of @p index as a new segment file
+     */
+    static bool write(const QString &path, const TermIndex &index);
+
+private:
+    const uchar *record(quint64 offset, int number, int size) const { return m_data + offset + quint64(number) * size; }
+    QByteArray bytes(const uchar *reference) const;
+    QString string(const uchar *reference) const;
+    int compare(const uchar *reference, const QByteArray &key) const;
+
+    QFile m_file;
+    uchar *m_data = nullptr;
+    qint64 m_size = 0;
+    bool m_removeWhenClosed = false;
+
+    int m_documentCount = 0;
+    int m_conversationCount = 0;
+    int m_termCount = 0;
+    qint64 m_totalTerms = 0;
+    qint64 m_indexedChars = 0;
+    quint64 m_documentsOffset = 0;
+    quint64 m_conversationsOffset = 0;
+    quint64 m_messageOrderOffset = 0;
+    quint64 m_termsOffset = 0;
+    quint64 m_postingsOffset = 0;
+    quint64 m_postingCount = 0;
+    quint64 m_stringsOffset = 0;
+    quint64 m_stringsSize = 0;
+};
+
+} // namespace DesktopApp
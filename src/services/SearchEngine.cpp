@@ -1,14 +1,75 @@
 #include "SearchEngine.h"
-#include "data/JsonStore.h"
+#include "IndexSegment.h"
+#include "data/ConversationRepository.h"
+#include "data/StoreSnapshot.h"
+#include "data/StorageCodec.h"
 #include <QRegularExpression>
 #include <QStringList>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <QThread>
+#include <QtConcurrent>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QCborStreamWriter>
+#include <QCborStreamReader>
+#include <QVarLengthArray>
 #include <QDebug>
 #include <QSet>
 #include <algorithm>
+#include <cmath>
+#include <functional>
+#include <utility>
 
 namespace DesktopApp {
 
-SearchEngine::SearchEngine(JsonStore *conversationStore, QObject *parent)
+namespace {
+
+const char *kManifestFile = "manifest.cbor";
+const char *kSegmentPrefix = "segment-";
+const char *kSegmentSuffix = ".idx";
+const qint64 kManifestVersion = 2;
+const int kMemtableDocuments = 16384;   // recent messages kept in memory before they are written as a segment
+const int kMaxSegments = 8;             // beyond this many, the smallest are merged
+const int kMergeWidth = 4;
+
+bool readInteger(QCborStreamReader &reader, qint64 &value)
+{
+    if (!reader.isInteger()) {
+        return false;
+    }
+    value = reader.toInteger();
+    return reader.next();
+}
+
+// Those of @p terms the index holds no postings for
+QStringList missingFrom(const TermIndex &index, const QStringList &terms)
+{
+    QStringList missing;
+    for (const QString &term : terms) {
+        if (!index.postings.contains(term)) {
+            missing.append(term);
+        }
+    }
+    return missing;
+}
+
+QByteArray readBytes(QCborStreamReader &reader)
+{
+    QByteArray bytes;
+    auto chunk = reader.readByteArray();
+    while (chunk.status == QCborStreamReader::Ok) {
+        bytes += chunk.data;
+        chunk = reader.readByteArray();
+    }
+    return bytes;
+}
+
+} // namespace
+
+SearchEngine::SearchEngine(ConversationRepository *conversationStore, QObject *parent)
     : QObject(parent)
     , m_conversationStore(conversationStore)
 {
@@ -23,13 +84,52 @@ SearchEngine::SearchEngine(JsonStore *conversationStore, QObject *parent)
     };
     
     qDebug() << "SearchEngine initialized with" << m_stopWords.size() << "stop words";
+    
+    // Rebuilds use every core, but from a pool of their own so interactive searches
+    // on the global pool are not queued behind them
+    connect(&m_rebuildWatcher, &QFutureWatcherBase::finished, this, &SearchEngine::finishRebuild);
+    connect(&m_rebuildWatcher, &QFutureWatcherBase::progressValueChanged, this, [this](int done) {
+        emit indexRebuildProgress(done, m_rebuildWatcher.progressMaximum());
+    });
+    
+    if (m_conversationStore) {
+        connect(m_conversationStore, &ConversationRepository::messageCreated, this, &SearchEngine::reindexMessage);
+        connect(m_conversationStore, &ConversationRepository::messageUpdated, this, &SearchEngine::reindexMessage);
+        connect(m_conversationStore, &ConversationRepository::messageDeleted, this, &SearchEngine::unindexMessage);
+        connect(m_conversationStore, &ConversationRepository::conversationDeleted, this, &SearchEngine::unindexConversation);
+        connect(m_conversationStore, &ConversationRepository::changesCommitted, this, &SearchEngine::applyChanges);
+    }
+}
+
+SearchEngine::~SearchEngine()
+{
+    if (m_cancelRebuild) {
+        m_cancelRebuild->store(true);
+    }
+    m_rebuildWatcher.cancel();
+    m_indexPool.waitForDone();
+    flushOnExit();
 }
 
 SearchResultList SearchEngine::searchMessages(const QString &query, int limit) const
+{
+    if (query.trimmed().isEmpty() || !m_conversationStore) {
+        return SearchResultList();
+    }
+    
+    return findMessages(nullptr, query, limit);
+}
+
+SearchResultList SearchEngine::searchMessages(const StoreSnapshot &snapshot, const QString &query, int limit) const
+{
+    return findMessages(&snapshot, query, limit);
+}
+
+SearchResultList SearchEngine::findMessages(const StoreSnapshot *snapshot, const QString &query, int limit) const
 {
     SearchResultList results;
     
-    if (query.trimmed().isEmpty() || !m_conversationStore) {
+    if (query.trimmed().isEmpty()) {
         return results;
     }
     
@@ -38,14 +138,47 @@ SearchResultList SearchEngine::searchMessages(const QString &query, int limit) c
         return results;
     }
     
-    // Get all conversations to search through
-    ConversationList conversations = m_conversationStore->getAllConversations();
-    
-    for (const Conversation &conv : conversations) {
-        MessageList messages = m_conversationStore->getMessagesForConversation(conv.id);
+    QVector<IndexMatch> matches;
+    if (limit > 0 && matchIndex(searchTerms, matches)) {
+        std::sort(matches.begin(), matches.end(), [](const IndexMatch &a, const IndexMatch &b) {
+            if (a.score != b.score) {
+                return a.score > b.score;
+            }
+            return a.createdAt > b.createdAt;
+        });
         
-        for (const Message &message : messages) {
-            double relevance = calculateRelevance(message.text, searchTerms);
+        QStringList phrases;
+        for (const SearchTerm &term : std::as_const(searchTerms)) {
+            if (term.isExact) {
+                phrases.append(term.word);
+            }
+        }
+        
+        // Scores come from the index; the text is read only for the snippet and to
+        // check quoted phrases, which can only lower a score. Candidates are visited
+        // best first, so once the limit is filled with results scoring at least the
+        // next candidate's bound, no later one can make it in.
+        QVector<double> best; // highest first, at most limit
+        for (const IndexMatch &match : std::as_const(matches)) {
+            if (best.size() >= limit && best.last() >= match.score) {
+                break;
+            }
+            
+            const Message message = snapshot ? snapshot->message(match.conversationId, match.messageId)
+                                             : m_conversationStore->getMessage(match.messageId);
+            if (!message.isValid()) {
+                continue; // created after the snapshot was taken
+            }
+            
+            double relevance = match.score;
+            if (!match.phraseScores.isEmpty()) {
+                const QString normalizedText = normalizeText(message.text);
+                for (int i = 0; i < phrases.size(); ++i) {
+                    if (match.phraseScores.at(i) > 0.0 && !normalizedText.contains(phrases.at(i), Qt::CaseInsensitive)) {
+                        relevance -= match.phraseScores.at(i); // words present, but not as the phrase
+                    }
+                }
+            }
             
             if (relevance > 0.0) {
                 SearchResult result;
@@ -56,8 +189,14 @@ SearchResultList SearchEngine::searchMessages(const QString &query, int limit) c
                 result.timestamp = message.createdAt;
                 
                 results.append(result);
+                best.insert(std::upper_bound(best.begin(), best.end(), relevance, std::greater<double>()), relevance);
+                if (best.size() > limit) {
+                    best.removeLast();
+                }
             }
         }
+    } else {
+        results = scanMessages(snapshot ? *snapshot : *m_conversationStore->snapshot(), searchTerms);
     }
     
     // Sort by relevance (highest first)
@@ -78,10 +217,24 @@ SearchResultList SearchEngine::searchMessages(const QString &query, int limit) c
 }
 
 ConversationList SearchEngine::searchConversations(const QString &query, int limit) const
+{
+    if (query.trimmed().isEmpty() || !m_conversationStore) {
+        return ConversationList();
+    }
+    
+    return findConversations(nullptr, query, limit);
+}
+
+ConversationList SearchEngine::searchConversations(const StoreSnapshot &snapshot, const QString &query, int limit) const
+{
+    return findConversations(&snapshot, query, limit);
+}
+
+ConversationList SearchEngine::findConversations(const StoreSnapshot *snapshot, const QString &query, int limit) const
 {
     ConversationList results;
     
-    if (query.trimmed().isEmpty() || !m_conversationStore) {
+    if (query.trimmed().isEmpty()) {
         return results;
     }
     
@@ -90,25 +243,25 @@ ConversationList SearchEngine::searchConversations(const QString &query, int lim
         return results;
     }
     
-    ConversationList allConversations = m_conversationStore->getAllConversations();
+    // Average content relevance per conversation. From the index it is computed from
+    // the postings alone, since reading the text of every matching message would cost
+    // what the index saves; quoted phrases then count for messages holding all their words.
+    QHash<QString, double> contentRelevance;
+    QVector<IndexMatch> matches;
+    if (matchIndex(searchTerms, matches)) {
+        for (const IndexMatch &match : std::as_const(matches)) {
+            contentRelevance[match.conversationId] += match.score / std::max(1, match.conversationSize);
+        }
+    } else {
+        contentRelevance = scanContentRelevance(snapshot ? *snapshot : *m_conversationStore->snapshot(), searchTerms);
+    }
+    
+    ConversationList allConversations = snapshot ? snapshot->conversations() : m_conversationStore->getAllConversations();
     QList<QPair<Conversation, double>> scoredConversations;
     
     for (const Conversation &conv : allConversations) {
         double titleRelevance = calculateRelevance(conv.title, searchTerms) * 2.0; // Weight title higher
-        double contentRelevance = 0.0;
-        
-        // Search through conversation messages
-        MessageList messages = m_conversationStore->getMessagesForConversation(conv.id);
-        for (const Message &message : messages) {
-            contentRelevance += calculateRelevance(message.text, searchTerms);
-        }
-        
-        // Average content relevance
-        if (!messages.isEmpty()) {
-            contentRelevance /= messages.size();
-        }
-        
-        double totalRelevance = titleRelevance + contentRelevance;
+        double totalRelevance = titleRelevance + contentRelevance.value(conv.id);
         
         if (totalRelevance > 0.0) {
             scoredConversations.append(qMakePair(conv, totalRelevance));
@@ -129,117 +282,1103 @@ ConversationList SearchEngine::searchConversations(const QString &query, int lim
     return results;
 }
 
-QStringList SearchEngine::getSearchSuggestions(const QString &partialQuery, int limit) const
+bool SearchEngine::matchIndex(const QList<SearchTerm> &terms, QVector<IndexMatch> &matches) const
 {
-    QStringList suggestions;
-    
-    if (partialQuery.length() < 2) {
-        return suggestions;
+    // Tokenize before taking the lock; writers on the store's thread wait for it
+    QList<QStringList> phraseWords;
+    for (const SearchTerm &term : terms) {
+        if (term.isExact) {
+            phraseWords.append(extractWords(term.word));
+            phraseWords.last().removeDuplicates();
+            if (phraseWords.last().isEmpty()) {
+                return false; // stop words only, which are not indexed
+            }
+        }
     }
     
-    QString normalized = normalizeText(partialQuery);
-    QSet<QString> uniqueSuggestions;
+    QReadLocker locker(&m_indexLock);
+    if (!m_indexReady || m_ranking != Ranking::Bm25) {
+        return false;
+    }
     
-    // Get all conversations and their messages to build suggestions
-    ConversationList conversations = m_conversationStore->getAllConversations();
+    // BM25 over the statistics of all layers. Document frequency is the length of a
+    // term's posting lists, which count masked documents until a merge drops them;
+    // document lengths are counted in terms.
+    double documentCount = static_cast<double>(m_index.documentIds.size());
+    double totalTerms = static_cast<double>(m_index.totalTerms);
+    for (const SegmentLayer &layer : m_segments) {
+        documentCount += layer.segment->documentCount() - layer.deletedCount;
+        totalTerms += static_cast<double>(layer.segment->totalTerms() - layer.deletedTerms);
+    }
+    const double averageLength = documentCount > 0.0 ? totalTerms / documentCount : 1.0;
     
-    for (const Conversation &conv : conversations) {
-        // Check conversation title
-        QStringList titleWords = extractWords(conv.title);
-        for (const QString &word : titleWords) {
-            if (word.startsWith(normalized, Qt::CaseInsensitive) && word.length() > normalized.length()) {
-                uniqueSuggestions.insert(word);
-            }
+    // Documents are keyed by layer and number; the memtable is layer 0, segment i layer i + 1
+    const auto termScores = [&](const QString &term, double weight, QHash<qint64, double> &scores, QHash<qint64, int> *found) {
+        const auto memtable = m_index.postings.constFind(term);
+        const QByteArray key = term.toUtf8();
+        QVarLengthArray<IndexSegment::PostingList, 8> lists;
+        qsizetype postingCount = memtable != m_index.postings.constEnd() ? memtable->size() : 0;
+        for (const SegmentLayer &layer : m_segments) {
+            lists.append(layer.segment->postings(key));
+            postingCount += lists.last().size();
+        }
+        if (postingCount == 0) {
+            return false;
         }
         
-        // Check message content (limited to avoid performance issues)
-        MessageList recentMessages = m_conversationStore->getMessagesForConversation(conv.id);
-        // Limit to recent messages for performance
-        if (recentMessages.size() > 10) {
-            recentMessages = recentMessages.mid(recentMessages.size() - 10);
-        }
-        for (const Message &message : recentMessages) {
-            QStringList messageWords = extractWords(message.text);
-            for (const QString &word : messageWords) {
-                if (word.startsWith(normalized, Qt::CaseInsensitive) && word.length() > normalized.length()) {
-                    uniqueSuggestions.insert(word);
-                    if (uniqueSuggestions.size() >= limit * 2) { // Get extra to have variety
-                        break;
-                    }
+        const double documentFrequency = static_cast<double>(postingCount);
+        const double idf = std::log(1.0 + (documentCount - documentFrequency + 0.5) / (documentFrequency + 0.5));
+        const auto score = [&](qint64 document, int frequency, double length) {
+            const double saturation = m_k1 * (1.0 - m_b + m_b * length / std::max(averageLength, 1.0));
+            scores[document] += weight * idf * frequency * (m_k1 + 1.0) / (frequency + saturation);
+            if (found) {
+                ++(*found)[document];
+            }
+        };
+        if (memtable != m_index.postings.constEnd()) {
+            for (const TermIndex::Posting &posting : *memtable) {
+                score(posting.document, posting.frequency, m_index.documents.at(posting.document).termCount);
+            }
+        }
+        for (int i = 0; i < lists.size(); ++i) {
+            const SegmentLayer &layer = m_segments.at(i);
+            const qint64 base = qint64(i + 1) << 32;
+            for (int p = 0; p < lists.at(i).size(); ++p) {
+                const IndexSegment::Posting posting = lists.at(i).at(p);
+                if (posting.document < 0 || posting.document >= layer.deleted.size() || layer.deleted.testBit(posting.document)) {
+                    continue;
                 }
+                score(base | posting.document, posting.frequency, layer.segment->documentTermCount(posting.document));
             }
-            if (uniqueSuggestions.size() >= limit * 2) {
-                break;
+        }
+        return true;
+    };
+    
+    QHash<qint64, double> scores;
+    QList<QHash<qint64, double>> phraseScores;
+    int phrase = 0;
+    for (const SearchTerm &term : terms) {
+        if (term.isExact) {
+            // Messages holding every word of the phrase; adjacency is checked on the text
+            const QStringList &words = phraseWords.at(phrase++);
+            QHash<qint64, double> wordScores;
+            QHash<qint64, int> wordsFound;
+            for (const QString &word : words) {
+                if (!termScores(word, term.weight, wordScores, &wordsFound)) {
+                    wordScores.clear();
+                    break;
+                }
+            }
+            QHash<qint64, double> complete;
+            for (auto it = wordScores.cbegin(); it != wordScores.cend(); ++it) {
+                if (wordsFound.value(it.key()) == words.size()) {
+                    complete.insert(it.key(), it.value());
+                    scores[it.key()] += it.value();
+                }
             }
+            phraseScores.append(complete);
+        } else {
+            termScores(term.word, term.weight, scores, nullptr);
         }
     }
     
-    suggestions = uniqueSuggestions.values();
+    QHash<QString, int> conversationSizes;
+    matches.reserve(scores.size());
+    for (auto it = scores.cbegin(); it != scores.cend(); ++it) {
+        const int layer = static_cast<int>(it.key() >> 32);
+        const int number = static_cast<int>(it.key() & 0xffffffff);
+        IndexMatch match;
+        if (layer == 0) {
+            const TermIndex::Document &document = m_index.documents.at(number);
+            match.messageId = document.messageId;
+            match.conversationId = document.conversationId;
+            match.createdAt = document.createdAt;
+        } else {
+            const IndexSegment::Document document = m_segments.at(layer - 1).segment->document(number);
+            match.messageId = document.messageId;
+            match.conversationId = document.conversationId;
+            match.createdAt = document.createdAt;
+        }
+        match.score = it.value();
+        auto size = conversationSizes.constFind(match.conversationId);
+        if (size == conversationSizes.constEnd()) {
+            size = conversationSizes.insert(match.conversationId, liveMessageCount(match.conversationId));
+        }
+        match.conversationSize = size.value();
+        if (!phraseScores.isEmpty()) {
+            match.phraseScores.reserve(phraseScores.size());
+            for (const QHash<qint64, double> &complete : std::as_const(phraseScores)) {
+                match.phraseScores.append(complete.value(it.key()));
+            }
+        }
+        matches.append(match);
+    }
+    return true;
+}
+
+SearchResultList SearchEngine::scanMessages(const StoreSnapshot &snapshot, const QList<SearchTerm> &terms) const
+{
+    SearchResultList results;
     
-    // Sort by length (shorter first) and then alphabetically
-    std::sort(suggestions.begin(), suggestions.end(), [](const QString &a, const QString &b) {
-        if (a.length() != b.length()) {
-            return a.length() < b.length();
+    // Get all conversations to search through
+    ConversationList conversations = snapshot.conversations();
+    
+    for (const Conversation &conv : conversations) {
+        MessageList messages = snapshot.messages(conv.id);
+        
+        for (const Message &message : messages) {
+            double relevance = calculateRelevance(message.text, terms);
+            
+            if (relevance > 0.0) {
+                SearchResult result;
+                result.messageId = message.id;
+                result.conversationId = message.conversationId;
+                result.snippet = extractSnippet(message.text, terms);
+                result.relevance = relevance;
+                result.timestamp = message.createdAt;
+                
+                results.append(result);
+            }
         }
-        return a < b;
-    });
+    }
+    
+    return results;
+}
+
+QHash<QString, double> SearchEngine::scanContentRelevance(const StoreSnapshot &snapshot, const QList<SearchTerm> &terms) const
+{
+    QHash<QString, double> relevance;
+    ConversationList allConversations = snapshot.conversations();
+    
+    for (const Conversation &conv : allConversations) {
+        double contentRelevance = 0.0;
+        
+        // Search through conversation messages
+        MessageList messages = snapshot.messages(conv.id);
+        for (const Message &message : messages) {
+            contentRelevance += calculateRelevance(message.text, terms);
+        }
+        
+        // Average content relevance
+        if (contentRelevance > 0.0) {
+            relevance.insert(conv.id, contentRelevance / messages.size());
+        }
+    }
     
-    // Apply limit
-    if (suggestions.size() > limit) {
-        suggestions = suggestions.mid(0, limit);
+    return relevance;
+}
+
+QStringList SearchEngine::getSearchSuggestions(const QString &partialQuery, int limit) const
+{
+    if (partialQuery.length() < 2) {
+        return QStringList();
     }
     
-    return suggestions;
+    // The whole query is completed as one term, as the index stores them
+    const QString prefix = normalizeText(partialQuery).toLower();
+    
+    QReadLocker locker(&m_indexLock);
+    return m_suggestions.complete(prefix, limit);
 }
 
 void SearchEngine::indexMessage(const Message &message)
 {
-    // For now, we do live searching rather than maintaining a separate index
-    // In a production system, you might want to maintain an inverted index
-    qDebug() << "Message indexed for search:" << message.id;
+    if (m_rebuilding) {
+        m_deletedMessages.remove(message.id);
+        m_staleMessages.insert(message.id);
+        return;
+    }
+    const QStringList words = extractWords(message.text);
+    {
+        QWriteLocker locker(&m_indexLock);
+        QStringList changedTerms;
+        removeIndexed(message.id, changedTerms);
+        const QSet<QString> distinct(words.cbegin(), words.cend());
+        const QStringList newTerms = missingFrom(m_index, distinct.values());
+        m_index.add(message, words);
+        countMemtableTerms(newTerms, 1);
+        changedTerms += m_index.termsOf(message.id);
+        refreshSuggestions(changedTerms);
+    }
+    maybeFlush();
 }
 
 void SearchEngine::removeMessage(const QString &messageId)
 {
-    // For live searching, no action needed
-    qDebug() << "Message removed from search index:" << messageId;
+    unindexMessage(messageId);
+}
+
+bool SearchEngine::openIndex(const QString &directory)
+{
+    if (!m_conversationStore) {
+        return false;
+    }
+    
+    m_indexDirectory = directory;
+    if (!QDir().mkpath(directory)) {
+        qWarning() << "Cannot create search index directory, keeping the index in memory:" << directory;
+        m_indexDirectory.clear();
+        return rebuildIndex();
+    }
+    
+    if (!loadManifest()) {
+        qDebug() << "No usable search index in" << directory << "- rebuilding";
+        removeStraySegments();
+        return rebuildIndex();
+    }
+    removeStraySegments();
+    if (m_segmentTerms < 0) {
+        countSegmentTerms();
+    }
+    
+    {
+        QWriteLocker locker(&m_indexLock);
+        m_indexReady = true;
+    }
+    qDebug() << "Search index opened:" << m_segments.size() << "segments";
+    
+    buildSuggestionsInBackground();
+    catchUp();
+    return true;
 }
 
 bool SearchEngine::rebuildIndex()
 {
-    // For live searching, no action needed
-    qDebug() << "Search index rebuild completed (live search mode)";
+    return startRebuild(QStringList());
+}
+
+bool SearchEngine::startRebuild(const QStringList &conversationIds)
+{
+    if (!m_conversationStore) {
+        return false;
+    }
+    
+    // Whatever changes after the snapshot is taken is replayed onto the result
+    if (m_rebuilding) {
+        m_cancelRebuild->store(true);
+        m_rebuildWatcher.cancel();
+    }
+    m_cancelRebuild = std::make_shared<std::atomic_bool>(false);
+    m_rebuilding = true;
+    m_partialRebuild = !conversationIds.isEmpty();
+    m_staleMessages.clear();
+    m_deletedMessages.clear();
+    m_staleConversations.clear();
+    
+    std::shared_ptr<const StoreSnapshot> snapshot = m_conversationStore->snapshot();
+    std::shared_ptr<std::atomic_bool> cancelled = m_cancelRebuild;
+    
+    ConversationList conversations = snapshot->conversations();
+    if (m_partialRebuild) {
+        const QSet<QString> wanted(conversationIds.cbegin(), conversationIds.cend());
+        conversations.erase(std::remove_if(conversations.begin(), conversations.end(), [&wanted](const Conversation &conversation) {
+            return !wanted.contains(conversation.id);
+        }), conversations.end());
+    }
+    
+    // Several chunks per thread, dealt round robin, so a few long conversations do not
+    // leave the other threads idle at the end
+    const int chunkCount = std::max(1, std::min(static_cast<int>(conversations.size()), m_indexPool.maxThreadCount() * 8));
+    QVector<ConversationList> chunks(chunkCount);
+    for (int i = 0; i < conversations.size(); ++i) {
+        chunks[i % chunkCount].append(conversations.at(i));
+    }
+    
+    auto tokenize = [this, snapshot, cancelled](const ConversationList &chunk) {
+        TermIndex partial;
+        for (const Conversation &conversation : chunk) {
+            if (cancelled->load()) {
+                break;
+            }
+            const MessageList messages = snapshot->messages(conversation.id);
+            for (const Message &message : messages) {
+                partial.add(message, extractWords(message.text));
+            }
+        }
+        return partial;
+    };
+    
+    // Reductions run one at a time and in chunk order; the last one of a full rebuild
+    // also builds the suggestions, while a partial one refreshes them in finishRebuild()
+    auto merged = std::make_shared<int>(0);
+    const bool full = !m_partialRebuild;
+    auto merge = [merged, chunkCount, full](RebuildResult &result, const TermIndex &partial) {
+        result.index.merge(partial);
+        if (++*merged == chunkCount && full) {
+            result.suggestions.build(result.index.documentFrequencies());
+        }
+    };
+    
+    m_rebuildWatcher.setFuture(QtConcurrent::mappedReduced<RebuildResult>(&m_indexPool, chunks, tokenize, merge,
+                                                                          QtConcurrent::OrderedReduce));
     return true;
 }
 
-SearchEngine::SearchStats SearchEngine::getSearchStats() const
+void SearchEngine::cancelRebuild()
 {
-    SearchStats stats;
-    stats.totalIndexedMessages = 0;
-    stats.totalUniqueWords = 0;
-    stats.indexSize = 0;
+    if (!m_rebuilding) {
+        return;
+    }
     
-    if (!m_conversationStore) {
-        return stats;
+    m_cancelRebuild->store(true);
+    m_rebuildWatcher.cancel();
+    m_rebuilding = false;
+    m_partialRebuild = false;
+    
+    // The index kept in use missed whatever changed meanwhile
+    if (m_indexReady) {
+        applyStaleChanges();
+    } else {
+        m_staleMessages.clear();
+        m_deletedMessages.clear();
+        m_staleConversations.clear();
+    }
+}
+
+void SearchEngine::setMaxRebuildThreads(int threads)
+{
+    m_indexPool.setMaxThreadCount(threads > 0 ? threads : QThread::idealThreadCount());
+}
+
+void SearchEngine::setRanking(Ranking ranking)
+{
+    QWriteLocker locker(&m_indexLock);
+    m_ranking = ranking;
+}
+
+SearchEngine::Ranking SearchEngine::ranking() const
+{
+    QReadLocker locker(&m_indexLock);
+    return m_ranking;
+}
+
+void SearchEngine::setBm25Parameters(double k1, double b)
+{
+    QWriteLocker locker(&m_indexLock);
+    m_k1 = std::max(0.0, k1);
+    m_b = std::clamp(b, 0.0, 1.0);
+}
+
+bool SearchEngine::isIndexReady() const
+{
+    QReadLocker locker(&m_indexLock);
+    return m_indexReady;
+}
+
+void SearchEngine::finishRebuild()
+{
+    QFuture<RebuildResult> future = m_rebuildWatcher.future();
+    if (!m_rebuilding || future.isCanceled() || !future.isFinished() || future.resultCount() == 0) {
+        return; // abandoned, or superseded by a later rebuild
     }
     
-    ConversationList conversations = m_conversationStore->getAllConversations();
-    QSet<QString> uniqueWords;
+    RebuildResult result = future.takeResult();
+    const qsizetype indexed = result.index.documentIds.size();
+    if (std::exchange(m_partialRebuild, false)) {
+        // The stale conversations were masked in every layer before the rebuild started
+        QWriteLocker locker(&m_indexLock);
+        const QStringList newTerms = missingFrom(m_index, result.index.postings.keys());
+        m_index.merge(result.index);
+        countMemtableTerms(newTerms, 1);
+        refreshSuggestions(result.index.postings.keys());
+    } else {
+        // The segments describe the old index; the new one is written out by the flush below
+        QVector<SegmentLayer> retired;
+        {
+            QWriteLocker locker(&m_indexLock);
+            std::swap(m_index, result.index);
+            m_suggestions = std::move(result.suggestions);
+            retired = std::exchange(m_segments, QVector<SegmentLayer>());
+            m_segmentTerms = 0;
+            m_memtableTerms = static_cast<int>(m_index.postings.size());
+            m_indexReady = true;
+        }
+        m_persisted.clear();
+        ++m_segmentEpoch;
+        ++m_termCountVersion;
+        m_countingTerms = false;
+        if (!m_indexDirectory.isEmpty()) {
+            writeManifest();
+        }
+        for (const SegmentLayer &layer : std::as_const(retired)) {
+            layer.segment->removeWhenClosed();
+        }
+    }
+    m_rebuilding = false;
+    applyStaleChanges();
     
-    for (const Conversation &conv : conversations) {
-        MessageList messages = m_conversationStore->getMessagesForConversation(conv.id);
-        stats.totalIndexedMessages += messages.size();
+    qDebug() << "Search index rebuilt:" << indexed << "messages indexed";
+    flushMemtable();
+    emit indexRebuilt();
+}
+
+void SearchEngine::applyStaleChanges()
+{
+    // Messages are looked up again, so their order relative to conversation deletes does not matter
+    const QSet<QString> staleMessages = std::exchange(m_staleMessages, QSet<QString>());
+    const QSet<QString> deletedMessages = std::exchange(m_deletedMessages, QSet<QString>());
+    const QSet<QString> staleConversations = std::exchange(m_staleConversations, QSet<QString>());
+    for (const QString &messageId : staleMessages) {
+        reindexMessage(messageId);
+    }
+    for (const QString &messageId : deletedMessages) {
+        unindexMessage(messageId);
+    }
+    for (const QString &conversationId : staleConversations) {
+        unindexConversation(conversationId);
+    }
+}
+
+void SearchEngine::reindexMessage(const QString &messageId)
+{
+    if (m_rebuilding) {
+        m_deletedMessages.remove(messageId);
+        m_staleMessages.insert(messageId);
+        return;
+    }
+    
+    // A failed lookup is no proof of deletion; only the store's delete signals unindex
+    const Message message = m_conversationStore->getMessage(messageId);
+    if (message.isValid()) {
+        indexMessage(message);
+    }
+}
+
+void SearchEngine::unindexMessage(const QString &messageId)
+{
+    if (m_rebuilding) {
+        m_staleMessages.remove(messageId);
+        m_deletedMessages.insert(messageId);
+        return;
+    }
+    QWriteLocker locker(&m_indexLock);
+    QStringList changedTerms;
+    removeIndexed(messageId, changedTerms);
+    refreshSuggestions(changedTerms);
+}
+
+void SearchEngine::unindexConversation(const QString &conversationId)
+{
+    // The store drops the messages with their conversation without a signal for each
+    if (m_rebuilding) {
+        m_staleConversations.insert(conversationId);
+        return;
+    }
+    QWriteLocker locker(&m_indexLock);
+    QStringList changedTerms;
+    removeIndexedConversation(conversationId, changedTerms);
+    refreshSuggestions(changedTerms);
+}
+
+void SearchEngine::applyChanges(const ChangeSet &changes)
+{
+    for (const QString &messageId : changes.createdMessages) {
+        reindexMessage(messageId);
+    }
+    for (const QString &messageId : changes.updatedMessages) {
+        reindexMessage(messageId);
+    }
+    for (const QString &messageId : changes.deletedMessages) {
+        unindexMessage(messageId);
+    }
+    for (const QString &conversationId : changes.deletedConversations) {
+        unindexConversation(conversationId);
+    }
+}
+
+void SearchEngine::removeIndexed(const QString &messageId, QStringList &changedTerms)
+{
+    // Segment documents only get masked, which leaves document frequencies as they are
+    const QStringList terms = m_index.termsOf(messageId);
+    changedTerms += terms;
+    m_index.remove(messageId);
+    countMemtableTerms(missingFrom(m_index, terms), -1);
+    for (SegmentLayer &layer : m_segments) {
+        const int document = layer.segment->findMessage(messageId);
+        if (document >= 0) {
+            removeSegmentDocument(layer, document);
+        }
+    }
+}
+
+void SearchEngine::removeIndexedConversation(const QString &conversationId, QStringList &changedTerms)
+{
+    const QSet<QString> messageIds = m_index.conversationMessages.value(conversationId);
+    QSet<QString> terms;
+    for (const QString &messageId : messageIds) {
+        const QStringList messageTerms = m_index.termsOf(messageId);
+        changedTerms += messageTerms;
+        terms.unite(QSet<QString>(messageTerms.cbegin(), messageTerms.cend()));
+    }
+    m_index.removeConversation(conversationId);
+    countMemtableTerms(missingFrom(m_index, terms.values()), -1);
+    for (SegmentLayer &layer : m_segments) {
+        int first = 0;
+        int count = 0;
+        if (layer.segment->findConversation(conversationId, first, count)) {
+            for (int document = first; document < first + count; ++document) {
+                removeSegmentDocument(layer, document);
+            }
+        }
+    }
+}
+
+void SearchEngine::removeSegmentDocument(SegmentLayer &layer, int document)
+{
+    if (!layer.remove(document)) {
+        return;
+    }
+    
+    const IndexSegment::Document removed = layer.segment->document(document);
+    auto stats = m_persisted.find(removed.conversationId);
+    if (stats != m_persisted.end()) {
+        stats->messageCount -= 1;
+        stats->textBytes -= removed.bytes;
+        if (stats->messageCount <= 0) {
+            m_persisted.erase(stats);
+        }
+    }
+    m_manifestDirty = true;
+}
+
+bool SearchEngine::SegmentLayer::remove(int document)
+{
+    if (document < 0 || document >= deleted.size() || deleted.testBit(document)) {
+        return false;
+    }
+    deleted.setBit(document);
+    ++deletedCount;
+    deletedTerms += segment->documentTermCount(document);
+    deletedChars += segment->documentLength(document);
+    return true;
+}
+
+void SearchEngine::refreshSuggestions(const QStringList &terms)
+{
+    QSet<QString> refreshed;
+    for (const QString &term : terms) {
+        if (!refreshed.contains(term)) {
+            refreshed.insert(term);
+            m_suggestions.setWeight(term, documentFrequency(term));
+        }
+    }
+}
+
+int SearchEngine::documentFrequency(const QString &term) const
+{
+    const QByteArray key = term.toUtf8();
+    qsizetype frequency = m_index.postings.value(term).size();
+    for (const SegmentLayer &layer : m_segments) {
+        frequency += layer.segment->postings(key).size();
+    }
+    return static_cast<int>(frequency);
+}
+
+bool SearchEngine::inSegments(const QString &term) const
+{
+    const QByteArray utf8 = term.toUtf8();
+    return std::any_of(m_segments.cbegin(), m_segments.cend(), [&utf8](const SegmentLayer &layer) {
+        return layer.segment->postings(utf8).size() > 0;
+    });
+}
+
+void SearchEngine::countMemtableTerms(const QStringList &terms, int delta)
+{
+    // Terms that entered or left the memtable; those in a segment are counted there
+    for (const QString &term : terms) {
+        if (!inSegments(term)) {
+            m_memtableTerms += delta;
+        }
+    }
+}
+
+void SearchEngine::recountMemtableTerms()
+{
+    m_memtableTerms = 0;
+    for (auto list = m_index.postings.cbegin(); list != m_index.postings.cend(); ++list) {
+        if (!inSegments(list.key())) {
+            ++m_memtableTerms;
+        }
+    }
+}
+
+int SearchEngine::liveMessageCount(const QString &conversationId) const
+{
+    int count = static_cast<int>(m_index.conversationMessages.value(conversationId).size());
+    for (const SegmentLayer &layer : m_segments) {
+        int first = 0;
+        int size = 0;
+        if (layer.segment->findConversation(conversationId, first, size)) {
+            for (int document = first; document < first + size; ++document) {
+                count += layer.deleted.testBit(document) ? 0 : 1;
+            }
+        }
+    }
+    return count;
+}
+
+bool SearchEngine::loadManifest()
+{
+    QFile file(QDir(m_indexDirectory).filePath(kManifestFile));
+    if (!file.open(QIODevice::ReadOnly)) {
+        return false;
+    }
+    const QByteArray data = file.readAll();
+    file.close();
+    
+    // [version, next segment, distinct segment terms or -1, [[file, documents, deleted bits]...],
+    //  [[conversation, messages, text bytes]...]]
+    QCborStreamReader reader(data);
+    qint64 version = 0;
+    qint64 nextSegment = 0;
+    qint64 segmentTerms = 0;
+    if (!reader.isArray() || !reader.enterContainer() || !readInteger(reader, version) || version != kManifestVersion
+        || !readInteger(reader, nextSegment) || !readInteger(reader, segmentTerms) || !reader.isArray()
+        || !reader.enterContainer()) {
+        qWarning() << "Damaged search index manifest:" << file.fileName();
+        return false;
+    }
+    
+    QVector<SegmentLayer> segments;
+    while (reader.hasNext()) {
+        if (!reader.isArray() || !reader.enterContainer()) {
+            return false;
+        }
+        const QString name = StorageCodec::readText(reader);
+        qint64 documents = 0;
+        if (!readInteger(reader, documents) || !reader.isByteArray()) {
+            return false;
+        }
+        const QByteArray bits = readBytes(reader);
+        if (!reader.leaveContainer() || name.isEmpty() || QFileInfo(name).fileName() != name) {
+            return false;
+        }
         
-        for (const Message &message : messages) {
-            QStringList words = extractWords(message.text);
-            for (const QString &word : words) {
-                uniqueWords.insert(word);
+        SegmentLayer layer;
+        layer.segment = std::make_shared<IndexSegment>();
+        if (!layer.segment->open(QDir(m_indexDirectory).filePath(name)) || layer.segment->documentCount() != documents
+            || bits.size() * 8 < documents) {
+            return false;
+        }
+        const QBitArray deleted = QBitArray::fromBits(bits.constData(), documents);
+        layer.deleted = QBitArray(deleted.size());
+        for (int document = 0; document < deleted.size(); ++document) {
+            if (deleted.testBit(document)) {
+                layer.remove(document);
+            }
+        }
+        segments.append(layer);
+    }
+    if (!reader.leaveContainer() || !reader.isArray() || !reader.enterContainer()) {
+        return false;
+    }
+    
+    QHash<QString, ConversationStats> persisted;
+    while (reader.hasNext()) {
+        ConversationStats stats;
+        qint64 messageCount = 0;
+        if (!reader.isArray() || !reader.enterContainer()) {
+            return false;
+        }
+        const QString conversationId = StorageCodec::readId(reader);
+        if (!readInteger(reader, messageCount) || !readInteger(reader, stats.textBytes) || !reader.leaveContainer()) {
+            return false;
+        }
+        stats.messageCount = static_cast<int>(messageCount);
+        persisted.insert(conversationId, stats);
+    }
+    if (!reader.leaveContainer() || reader.lastError() != QCborError::NoError) {
+        return false;
+    }
+    
+    {
+        QWriteLocker locker(&m_indexLock);
+        m_segments = segments;
+        m_segmentTerms = static_cast<int>(std::max<qint64>(segmentTerms, -1));
+    }
+    m_persisted = persisted;
+    m_nextSegment = static_cast<int>(nextSegment);
+    return true;
+}
+
+bool SearchEngine::writeManifest()
+{
+    QByteArray data;
+    QCborStreamWriter writer(&data);
+    writer.startArray(5);
+    writer.append(qint64(kManifestVersion));
+    writer.append(qint64(m_nextSegment));
+    writer.append(qint64(m_countingTerms ? -1 : m_segmentTerms)); // counted again at the next start
+    writer.startArray(quint64(m_segments.size()));
+    for (const SegmentLayer &layer : std::as_const(m_segments)) {
+        writer.startArray(3);
+        writer.append(QFileInfo(layer.segment->path()).fileName());
+        writer.append(qint64(layer.deleted.size()));
+        writer.append(QByteArray(layer.deleted.bits(), (layer.deleted.size() + 7) / 8));
+        writer.endArray();
+    }
+    writer.endArray();
+    writer.startArray(quint64(m_persisted.size()));
+    for (auto it = m_persisted.cbegin(); it != m_persisted.cend(); ++it) {
+        writer.startArray(3);
+        StorageCodec::writeId(writer, it.key());
+        writer.append(qint64(it->messageCount));
+        writer.append(it->textBytes);
+        writer.endArray();
+    }
+    writer.endArray();
+    writer.endArray();
+    
+    QSaveFile file(QDir(m_indexDirectory).filePath(kManifestFile));
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size() || !file.commit()) {
+        qWarning() << "Failed to write search index manifest:" << file.fileName();
+        return false;
+    }
+    m_manifestDirty = false;
+    return true;
+}
+
+void SearchEngine::removeStraySegments() const
+{
+    // Written by a flush or merge that never made it into the manifest
+    QSet<QString> live;
+    for (const SegmentLayer &layer : m_segments) {
+        live.insert(QFileInfo(layer.segment->path()).fileName());
+    }
+    const QDir directory(m_indexDirectory);
+    const QStringList files = directory.entryList({QString("%1*%2").arg(kSegmentPrefix, kSegmentSuffix)}, QDir::Files);
+    for (const QString &file : files) {
+        if (!live.contains(file)) {
+            QFile::remove(directory.filePath(file));
+        }
+    }
+}
+
+QString SearchEngine::nextSegmentPath()
+{
+    const QString name = QString("%1%2%3").arg(kSegmentPrefix).arg(m_nextSegment++, 6, 10, QChar('0')).arg(kSegmentSuffix);
+    return QDir(m_indexDirectory).filePath(name);
+}
+
+void SearchEngine::catchUp()
+{
+    // The store keeps these counters current, so finding the conversations that changed
+    // since their segments were written reads no messages
+    const ConversationList conversations = m_conversationStore->getAllConversations();
+    QSet<QString> current;
+    QStringList stale;
+    for (const Conversation &conversation : conversations) {
+        current.insert(conversation.id);
+        const ConversationStats stats = m_conversationStore->getConversationStats(conversation.id);
+        const ConversationStats indexed = m_persisted.value(conversation.id);
+        if (stats.messageCount != indexed.messageCount || stats.textBytes != indexed.textBytes) {
+            stale.append(conversation.id);
+        }
+    }
+    QStringList removed;
+    for (auto it = m_persisted.cbegin(); it != m_persisted.cend(); ++it) {
+        if (!current.contains(it.key())) {
+            removed.append(it.key());
+        }
+    }
+    if (stale.isEmpty() && removed.isEmpty()) {
+        return;
+    }
+    
+    {
+        QWriteLocker locker(&m_indexLock);
+        QStringList changedTerms; // the memtable is still empty
+        for (const QString &conversationId : std::as_const(stale) + removed) {
+            removeIndexedConversation(conversationId, changedTerms);
+            m_persisted.remove(conversationId);
+        }
+    }
+    writeManifest();
+    
+    qDebug() << "Search index behind the store:" << stale.size() << "conversations changed," << removed.size() << "removed";
+    if (!stale.isEmpty()) {
+        startRebuild(stale);
+    }
+}
+
+void SearchEngine::buildSuggestionsInBackground()
+{
+    // Reading every dictionary costs far more than mapping the segments, so suggestions
+    // come shortly after the index is ready. Terms indexed into the memtable meanwhile get
+    // their weights refreshed when the result is swapped in.
+    QVector<std::shared_ptr<IndexSegment>> segments;
+    for (const SegmentLayer &layer : std::as_const(m_segments)) {
+        segments.append(layer.segment);
+    }
+    const quint64 epoch = m_segmentEpoch;
+    m_indexPool.start([this, segments, epoch]() {
+        QHash<QString, int> frequencies;
+        for (const std::shared_ptr<IndexSegment> &segment : segments) {
+            for (int term = 0; term < segment->termCount(); ++term) {
+                frequencies[segment->term(term)] += segment->postingsAt(term).size();
+            }
+        }
+        auto suggestions = std::make_shared<SuggestionTrie>();
+        suggestions->build(frequencies);
+        
+        QMetaObject::invokeMethod(this, [this, suggestions, epoch]() {
+            if (epoch != m_segmentEpoch) {
+                return; // a full rebuild brought suggestions of its own
+            }
+            QWriteLocker locker(&m_indexLock);
+            m_suggestions = std::move(*suggestions);
+            refreshSuggestions(m_index.postings.keys());
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SearchEngine::maybeFlush()
+{
+    if (m_index.documentIds.size() >= kMemtableDocuments) {
+        flushMemtable();
+    }
+}
+
+void SearchEngine::flushMemtable()
+{
+    if (m_indexDirectory.isEmpty() || m_rebuilding || m_flushing || m_index.documentIds.isEmpty()) {
+        return;
+    }
+    
+    // The segment is written from a copy, which shares its data with the memtable until
+    // that changes. Positions must stay put meanwhile, so that finishFlush() can tell
+    // which of the copied messages were changed or removed since.
+    m_flushing = true;
+    const TermIndex frozen = m_index;
+    m_index.compacting = false;
+    const QString path = nextSegmentPath();
+    const quint64 epoch = m_segmentEpoch;
+    const quint64 termVersion = m_termCountVersion;
+    QVector<std::shared_ptr<IndexSegment>> segments;
+    for (const SegmentLayer &layer : std::as_const(m_segments)) {
+        segments.append(layer.segment);
+    }
+    m_indexPool.start([this, path, frozen, segments, epoch, termVersion]() {
+        const bool written = IndexSegment::write(path, frozen);
+        
+        // What the new segment adds to the distinct terms of the ones it joins
+        int newTerms = 0;
+        for (auto list = frozen.postings.cbegin(); written && list != frozen.postings.cend(); ++list) {
+            const QByteArray utf8 = list.key().toUtf8();
+            if (std::none_of(segments.cbegin(), segments.cend(), [&utf8](const std::shared_ptr<IndexSegment> &segment) {
+                    return segment->postings(utf8).size() > 0;
+                })) {
+                ++newTerms;
+            }
+        }
+        QMetaObject::invokeMethod(this, [this, path, frozen, epoch, written, newTerms, termVersion]() {
+            finishFlush(epoch, path, frozen, written, newTerms, termVersion);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SearchEngine::finishFlush(quint64 epoch, const QString &path, const TermIndex &frozen, bool written, int newTerms,
+                               quint64 termVersion)
+{
+    m_flushing = false;
+    auto segment = std::make_shared<IndexSegment>();
+    if (epoch != m_segmentEpoch || !written || !segment->open(path)) {
+        if (epoch == m_segmentEpoch) {
+            qWarning() << "Search index segment not written, recent messages stay in memory:" << path;
+            m_index.compacting = true;
+        }
+        segment.reset();
+        QFile::remove(path);
+        return;
+    }
+    
+    SegmentLayer layer;
+    layer.segment = segment;
+    layer.deleted = QBitArray(segment->documentCount());
+    const int frozenCount = static_cast<int>(frozen.documents.size());
+    // The new terms were found against the segments the flush started with
+    const bool recount = m_countingTerms || termVersion != m_termCountVersion || m_segmentTerms < 0;
+    {
+        QWriteLocker locker(&m_indexLock);
+        for (int position = 0; position < frozenCount; ++position) {
+            const TermIndex::Document &document = frozen.documents.at(position);
+            if (document.messageId.isEmpty()) {
+                continue;
+            }
+            if (m_index.documents.at(position).messageId.isEmpty()) {
+                layer.remove(segment->findMessage(document.messageId)); // changed or removed since
+            } else {
+                ConversationStats &stats = m_persisted[document.conversationId];
+                stats.messageCount += 1;
+                stats.textBytes += document.bytes;
+            }
+        }
+        m_index.dropBefore(frozenCount);
+        m_index.compacting = true;
+        m_segments.append(layer);
+        if (!recount) {
+            m_segmentTerms += newTerms;
+        }
+        recountMemtableTerms();
+    }
+    if (recount) {
+        countSegmentTerms();
+    }
+    
+    qDebug() << "Search index segment written:" << QFileInfo(path).fileName() << segment->documentCount() << "messages";
+    writeManifest();
+    maybeMerge();
+    maybeFlush();
+}
+
+void SearchEngine::flushOnExit()
+{
+    // Nothing runs in the background any more, so the memtable is written as it is. Flushes
+    // and merges that finished without being applied leave stray files, removed at the next start.
+    if (m_indexDirectory.isEmpty() || !m_indexReady) {
+        return;
+    }
+    
+    if (!m_index.documentIds.isEmpty()) {
+        const QString path = nextSegmentPath();
+        SegmentLayer layer;
+        layer.segment = std::make_shared<IndexSegment>();
+        if (IndexSegment::write(path, m_index) && layer.segment->open(path)) {
+            layer.deleted = QBitArray(layer.segment->documentCount());
+            m_segments.append(layer);
+            if (m_segmentTerms >= 0) {
+                m_segmentTerms += m_memtableTerms;
+            }
+            m_memtableTerms = 0;
+            for (const TermIndex::Document &document : std::as_const(m_index.documents)) {
+                if (!document.messageId.isEmpty()) {
+                    ConversationStats &stats = m_persisted[document.conversationId];
+                    stats.messageCount += 1;
+                    stats.textBytes += document.bytes;
+                }
+            }
+            m_manifestDirty = true;
+        }
+    }
+    if (m_manifestDirty) {
+        writeManifest();
+    }
+}
+
+void SearchEngine::maybeMerge()
+{
+    if (m_merging || m_rebuilding || m_segments.size() <= kMaxSegments) {
+        return;
+    }
+    
+    // Size-tiered: the smallest segments are merged, so a message is rewritten a number of
+    // times logarithmic in the size of the index. Masked documents are dropped on the way.
+    QVector<SegmentLayer> inputs = m_segments;
+    std::sort(inputs.begin(), inputs.end(), [](const SegmentLayer &a, const SegmentLayer &b) {
+        return a.segment->documentCount() - a.deletedCount < b.segment->documentCount() - b.deletedCount;
+    });
+    inputs.resize(kMergeWidth);
+    
+    m_merging = true;
+    const QString path = nextSegmentPath();
+    const quint64 epoch = m_segmentEpoch;
+    m_indexPool.start([this, path, inputs, epoch]() {
+        TermIndex merged;
+        for (const SegmentLayer &input : inputs) {
+            merged.appendSegment(*input.segment, input.deleted);
+        }
+        const bool written = IndexSegment::write(path, merged);
+        QMetaObject::invokeMethod(this, [this, path, inputs, epoch, written]() {
+            finishMerge(epoch, path, inputs, written);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void SearchEngine::finishMerge(quint64 epoch, const QString &path, const QVector<SegmentLayer> &inputs, bool written)
+{
+    m_merging = false;
+    auto segment = std::make_shared<IndexSegment>();
+    if (epoch != m_segmentEpoch || !written || !segment->open(path)) {
+        if (epoch == m_segmentEpoch) {
+            qWarning() << "Search index segments not merged:" << path;
+        }
+        segment.reset();
+        QFile::remove(path);
+        return;
+    }
+    
+    SegmentLayer merged;
+    merged.segment = segment;
+    merged.deleted = QBitArray(segment->documentCount());
+    {
+        QWriteLocker locker(&m_indexLock);
+        for (const SegmentLayer &input : inputs) {
+            auto current = std::find_if(m_segments.begin(), m_segments.end(), [&input](const SegmentLayer &layer) {
+                return layer.segment == input.segment;
+            });
+            if (current == m_segments.end()) {
+                continue;
             }
-            stats.indexSize += message.text.length();
+            // Messages changed or removed while the merge ran
+            for (int document = 0; document < current->deleted.size(); ++document) {
+                if (current->deleted.testBit(document) && !input.deleted.testBit(document)) {
+                    merged.remove(segment->findMessage(current->segment->messageId(document)));
+                }
+            }
+            m_segments.erase(current);
         }
+        m_segments.append(merged);
+        recountMemtableTerms();
     }
     
-    stats.totalUniqueWords = uniqueWords.size();
+    // Masked documents took the terms only they held with them
+    countSegmentTerms();
+    
+    // The inputs are deleted once the last reader lets go of them, after the manifest no longer lists them
+    writeManifest();
+    for (const SegmentLayer &input : inputs) {
+        input.segment->removeWhenClosed();
+    }
+    qDebug() << "Search index segments merged:" << inputs.size() << "into" << QFileInfo(path).fileName();
+    maybeMerge();
+}
+
+void SearchEngine::countSegmentTerms()
+{
+    // Until the count lands, the last one stands in for it
+    QVector<std::shared_ptr<IndexSegment>> segments;
+    for (const SegmentLayer &layer : std::as_const(m_segments)) {
+        segments.append(layer.segment);
+    }
+    const quint64 version = ++m_termCountVersion;
+    m_countingTerms = true;
+    m_indexPool.start([this, segments, version]() {
+        const int terms = IndexSegment::countDistinctTerms(segments);
+        QMetaObject::invokeMethod(this, [this, terms, version]() {
+            if (version != m_termCountVersion) {
+                return; // the segments changed again meanwhile
+            }
+            m_countingTerms = false;
+            {
+                QWriteLocker locker(&m_indexLock);
+                m_segmentTerms = terms;
+            }
+            m_manifestDirty = true;
+        }, Qt::QueuedConnection);
+    });
+}
+
+SearchEngine::SearchStats SearchEngine::getSearchStats() const
+{
+    QReadLocker locker(&m_indexLock);
+    SearchStats stats;
+    stats.totalIndexedMessages = static_cast<int>(m_index.documentIds.size());
+    stats.totalUniqueWords = std::max(0, m_segmentTerms) + m_memtableTerms;
+    stats.indexSize = m_index.indexedChars;
+    for (const SegmentLayer &layer : m_segments) {
+        stats.totalIndexedMessages += layer.segment->documentCount() - layer.deletedCount;
+        stats.indexSize += layer.segment->indexedChars() - layer.deletedChars;
+    }
     return stats;
 }
 
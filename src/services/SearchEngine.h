@@ -3,21 +3,58 @@
 #include <QObject>
 #include <QString>
 #include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QDateTime>
+#include <QBitArray>
+#include <QReadWriteLock>
+#include <QThreadPool>
+#include <QFutureWatcher>
+#include <atomic>
+#include <memory>
 #include "data/Models.h"
+#include "TermIndex.h"
+#include "SuggestionTrie.h"
 
 namespace DesktopApp {
 
-class JsonStore;
+class ConversationRepository;
+class StoreSnapshot;
+struct ChangeSet;
+class IndexSegment;
 
 /**
  * @brief Full-text search engine for messages
+ *
+ * An inverted index (term -> messages containing it, with term frequencies)
+ * is built by rebuildIndex() and then kept current from the store's change
+ * signals. Messages are ranked by BM25 from the index's statistics alone, so
+ * a query reads only the postings of its own terms and then the text of the
+ * results for their snippets. Until the index is ready, searches fall back
+ * to scanning every message.
+ *
+ * With openIndex() the index is also kept on disk, LSM style: recent
+ * messages go to an in-memory index, which is written out as an immutable,
+ * memory-mapped IndexSegment once it grows, and small segments are merged
+ * into larger ones in the background. Messages changed or removed after
+ * their segment was written are masked until the next merge. At startup the
+ * segments are mapped and searched as they are; only conversations that
+ * changed since they were written are tokenized again.
+ *
+ * The overloads taking a StoreSnapshot only read the snapshot, the index
+ * (under a read lock) and this object's immutable configuration, so they may
+ * run on worker threads while the store keeps changing on its own thread.
+ * The index follows the store, so messages created or deleted after the
+ * snapshot was taken may be missing from the results.
  */
 class SearchEngine : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit SearchEngine(JsonStore *conversationStore, QObject *parent = nullptr);
+    explicit SearchEngine(ConversationRepository *conversationStore, QObject *parent = nullptr);
+    ~SearchEngine() override;
 
     /**
      * @brief Search for messages containing the query
@@ -26,6 +63,7 @@ public:
      * @return List of search results ordered by relevance
      */
     SearchResultList searchMessages(const QString &query, int limit = 50) const;
+    SearchResultList searchMessages(const StoreSnapshot &snapshot, const QString &query, int limit = 50) const;
 
     /**
      * @brief Search conversations by title or content
@@ -34,15 +72,41 @@ public:
      * @return List of conversations containing the search terms
      */
     ConversationList searchConversations(const QString &query, int limit = 20) const;
+    ConversationList searchConversations(const StoreSnapshot &snapshot, const QString &query, int limit = 20) const;
 
     /**
      * @brief Get search suggestions based on partial query
+     *
+     * Completions of the indexed vocabulary, most widely used terms first,
+     * from a prefix tree kept with the index; empty until the index is ready.
      * @param partialQuery Partial search term
      * @param limit Maximum number of suggestions
      * @return List of suggested search terms
      */
     QStringList getSearchSuggestions(const QString &partialQuery, int limit = 10) const;
 
+    /**
+     * @brief How message results are ranked
+     *
+     * Bm25 scores from the index. TermFrequency is the earlier scorer: log term
+     * frequency with a boost for early matches and no IDF, computed from the
+     * text of every message; it is kept for comparison and also used while the
+     * index is not ready.
+     */
+    enum class Ranking {
+        Bm25,
+        TermFrequency
+    };
+    void setRanking(Ranking ranking);
+    Ranking ranking() const;
+
+    /**
+     * @brief Tune BM25
+     * @param k1 Term frequency saturation, >= 0; 0 ignores repeats
+     * @param b Length normalization, 0 (none) to 1 (full)
+     */
+    void setBm25Parameters(double k1, double b);
+
     /**
      * @brief Index a new message for searching
      * @param message The message to index
@@ -55,22 +119,132 @@ public:
      */
     void removeMessage(const QString &messageId);
 
+    /**
+     * @brief Use and maintain the index persisted in @p directory
+     *
+     * Maps the segments listed there and makes the index ready at once; the
+     * conversations that changed since it was written are indexed again in
+     * the background. Without a usable index in @p directory, starts a
+     * rebuild whose result is persisted there.
+     * @return false if there is no store to index
+     */
+    bool openIndex(const QString &directory);
+
     /**
      * @brief Rebuild the entire search index
+     *
+     * Tokenizes a snapshot of the store on all cores and returns immediately:
+     * conversations are split into chunks indexed in parallel, and the partial
+     * indexes are merged as they finish. indexRebuildProgress() reports the
+     * chunks done; changes made meanwhile are applied once it finishes, then
+     * indexRebuilt() is emitted. A rebuild already running is abandoned.
+     * A persisted index has its segments replaced by the result.
+     * @return false if there is no store to index
      */
     bool rebuildIndex();
 
+    /**
+     * @brief Abandon a running rebuild; the previous index, if any, stays in use
+     */
+    void cancelRebuild();
+
+    /**
+     * @brief Threads used by rebuilds; 0 for one per core (the default)
+     */
+    void setMaxRebuildThreads(int threads);
+
+    bool isIndexReady() const;
+
     /**
      * @brief Get search statistics
+     *
+     * Counters of the index, read without visiting its entries; all zero
+     * until the index is ready.
      */
     struct SearchStats {
         int totalIndexedMessages;
-        int totalUniqueWords;
-        qint64 indexSize;
+        int totalUniqueWords;     // distinct terms across every layer of the index
+        qint64 indexSize;         // characters of indexed message text
     };
     SearchStats getSearchStats() const;
 
+signals:
+    void indexRebuildProgress(int done, int total);
+    void indexRebuilt();
+
 private:
+    /**
+     * @brief Message found through the index, with its BM25 score
+     */
+    struct IndexMatch {
+        QString messageId;
+        QString conversationId;
+        QDateTime createdAt;
+        double score;
+        int conversationSize;        // indexed messages in the conversation
+        QVector<double> phraseScores; // share of score per quoted phrase, in query order; unverified
+    };
+
+    /**
+     * @brief Segment of the persisted index, with the documents masked since it was written
+     */
+    struct SegmentLayer {
+        std::shared_ptr<IndexSegment> segment;
+        QBitArray deleted;
+        int deletedCount = 0;
+        qint64 deletedTerms = 0;
+        qint64 deletedChars = 0;
+
+        /**
+         * @brief Mask @p document; false if it already was
+         */
+        bool remove(int document);
+    };
+
+    /**
+     * @brief Outcome of a rebuild; a partial one covers the stale conversations only
+     */
+    struct RebuildResult {
+        TermIndex index;
+        SuggestionTrie suggestions;   // built by full rebuilds only
+    };
+
+    // Index maintenance from the store's signals; deferred while a rebuild runs
+    void reindexMessage(const QString &messageId);
+    void unindexMessage(const QString &messageId);
+    void unindexConversation(const QString &conversationId);
+    void applyChanges(const ChangeSet &changes);
+    bool startRebuild(const QStringList &conversationIds);
+    void finishRebuild();
+    void applyStaleChanges();
+
+    // Across every layer of the index; callers hold the lock, for writing where they change it
+    void removeIndexed(const QString &messageId, QStringList &changedTerms);
+    void removeIndexedConversation(const QString &conversationId, QStringList &changedTerms);
+    void removeSegmentDocument(SegmentLayer &layer, int document);
+    void refreshSuggestions(const QStringList &terms);
+    int documentFrequency(const QString &term) const;
+    int liveMessageCount(const QString &conversationId) const;
+    bool inSegments(const QString &term) const;
+    void countMemtableTerms(const QStringList &terms, int delta);
+    void recountMemtableTerms();
+
+    // Persistence, on this object's thread; segments are written and merged on m_indexPool
+    bool loadManifest();
+    bool writeManifest();
+    void removeStraySegments() const;
+    QString nextSegmentPath();
+    void catchUp();
+    void buildSuggestionsInBackground();
+    void maybeFlush();
+    void flushMemtable();
+    void finishFlush(quint64 epoch, const QString &path, const TermIndex &frozen, bool written, int newTerms,
+                     quint64 termVersion);
+    void flushOnExit();
+    void maybeMerge();
+    void finishMerge(quint64 epoch, const QString &path, const QVector<SegmentLayer> &inputs, bool written);
+    void countSegmentTerms();
+
     struct SearchTerm {
         QString word;
         double weight;
@@ -78,14 +252,63 @@ private:
     };
 
     QList<SearchTerm> parseQuery(const QString &query) const;
+
+    // Without a snapshot they run on the store's thread and read the store itself; only a
+    // scan takes a snapshot then
+    SearchResultList findMessages(const StoreSnapshot *snapshot, const QString &query, int limit) const;
+    ConversationList findConversations(const StoreSnapshot *snapshot, const QString &query, int limit) const;
+
+    /**
+     * @brief Messages containing any of the terms, from the postings
+     * @return false if the index cannot answer: not built yet, TermFrequency ranking, or a
+     *         phrase of stop words only
+     */
+    bool matchIndex(const QList<SearchTerm> &terms, QVector<IndexMatch> &matches) const;
+    SearchResultList scanMessages(const StoreSnapshot &snapshot, const QList<SearchTerm> &terms) const;
+    QHash<QString, double> scanContentRelevance(const StoreSnapshot &snapshot, const QList<SearchTerm> &terms) const;
+
     double calculateRelevance(const QString &text, const QList<SearchTerm> &terms) const;
     QString extractSnippet(const QString &text, const QList<SearchTerm> &terms, int maxLength = 150) const;
     QStringList extractWords(const QString &text) const;
     QString normalizeText(const QString &text) const;
     bool isStopWord(const QString &word) const;
 
-    JsonStore *m_conversationStore;
+    ConversationRepository *m_conversationStore;
     QStringList m_stopWords;
+
+    // Written on this object's thread only; searches on other threads take the read lock
+    mutable QReadWriteLock m_indexLock;
+    TermIndex m_index;                               // recent messages, not yet in a segment
+    QVector<SegmentLayer> m_segments;
+    SuggestionTrie m_suggestions;                    // terms weighted by document frequency
+    bool m_indexReady = false;
+    Ranking m_ranking = Ranking::Bm25;
+    double m_k1 = 1.2;
+    double m_b = 0.75;
+
+    bool m_rebuilding = false;
+    std::shared_ptr<std::atomic_bool> m_cancelRebuild; // stops the chunks of the running rebuild
+    bool m_partialRebuild = false;                   // the running rebuild adds to the index
+    QFutureWatcher<RebuildResult> m_rebuildWatcher;
+    QSet<QString> m_staleMessages;                   // created or changed while a rebuild runs
+    QSet<QString> m_deletedMessages;                 // deleted while a rebuild runs
+    QSet<QString> m_staleConversations;              // deleted while a rebuild runs
+    QThreadPool m_indexPool;
+
+    QString m_indexDirectory;                        // empty: the index is not persisted
+    int m_nextSegment = 0;
+    quint64 m_segmentEpoch = 0;                      // bumped when a full rebuild replaces the segments
+    bool m_flushing = false;
+    bool m_merging = false;
+    bool m_manifestDirty = false;
+    QHash<QString, ConversationStats> m_persisted;   // conversationId -> messages in live segment documents
+
+    // Distinct terms: the segment dictionaries are counted in the background when merges
+    // change them, memtable terms as they come and go
+    int m_segmentTerms = 0;                          // -1 until counted
+    int m_memtableTerms = 0;                         // memtable terms in no segment
+    quint64 m_termCountVersion = 0;                  // bumped by each count of the segments
+    bool m_countingTerms = false;
 };
 
 } // namespace DesktopApp
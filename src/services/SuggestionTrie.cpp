@@ -0,0 +1,219 @@
+#include "SuggestionTrie.h"
+#include <algorithm>
+
+namespace DesktopApp {
+
+void SuggestionTrie::build(const QHash<QString, int> &weights)
+{
+    clear();
+    m_terms.reserve(weights.size());
+    for (auto it = weights.constBegin(); it != weights.constEnd(); ++it) {
+        if (it.value() <= 0 || it.key().length() > MaxTermLength) {
+            continue;
+        }
+        const int node = insertPath(it.key());
+        m_nodes[node].term = static_cast<int>(m_terms.size());
+        m_terms.append({it.key(), it.value()});
+        ++m_liveTerms;
+    }
+
+    // Children are created after their parents, so going backwards fills every
+    // child's list before its parent reads it
+    for (int node = static_cast<int>(m_nodes.size()) - 1; node >= 0; --node) {
+        refresh(node);
+    }
+}
+
+void SuggestionTrie::setWeight(const QString &term, int weight)
+{
+    if (term.isEmpty() || term.length() > MaxTermLength) {
+        return;
+    }
+    weight = std::max(0, weight);
+
+    int node = 0;
+    if (weight > 0) {
+        node = insertPath(term);
+    } else {
+        for (int i = 0; i < term.length() && node >= 0; ++i) {
+            node = m_nodes.isEmpty() ? -1 : child(node, term.at(i).unicode());
+        }
+        if (node < 0 || m_nodes.at(node).term < 0) {
+            return; // never added
+        }
+    }
+
+    Node &end = m_nodes[node];
+    if (end.term < 0) {
+        end.term = static_cast<int>(m_terms.size());
+        m_terms.append({term, 0});
+    }
+    Term &entry = m_terms[end.term];
+    if (entry.weight == weight) {
+        return;
+    }
+    m_liveTerms += (weight > 0 ? 1 : 0) - (entry.weight > 0 ? 1 : 0);
+    entry.weight = weight;
+
+    for (; node >= 0; node = m_nodes.at(node).parent) {
+        refresh(node);
+    }
+}
+
+QStringList SuggestionTrie::complete(const QString &prefix, int limit) const
+{
+    QStringList completions;
+    if (limit <= 0 || m_nodes.isEmpty()) {
+        return completions;
+    }
+
+    int node = 0;
+    for (int i = 0; i < prefix.length() && node >= 0; ++i) {
+        node = child(node, prefix.at(i).unicode());
+    }
+    if (node < 0) {
+        return completions;
+    }
+
+    // The term equal to the prefix is not a completion, so the cache must hold one more then;
+    // a cache that is not full holds the whole subtree
+    const Node &start = m_nodes.at(node);
+    QVector<int> terms;
+    bestTerms(node, terms);
+    const qsizetype needed = limit + (terms.contains(start.term) ? 1 : 0);
+    if (needed > terms.size() && terms.size() >= CachedCompletions) {
+        terms.clear();
+        collect(node, terms);
+        std::sort(terms.begin(), terms.end(), [this](int a, int b) { return ranksBefore(a, b); });
+    }
+
+    for (int term : std::as_const(terms)) {
+        if (completions.size() >= limit) {
+            break;
+        }
+        if (term != start.term) {
+            completions.append(m_terms.at(term).text);
+        }
+    }
+    return completions;
+}
+
+void SuggestionTrie::clear()
+{
+    m_nodes.clear();
+    m_terms.clear();
+    m_best.clear();
+    m_liveTerms = 0;
+}
+
+int SuggestionTrie::child(int node, char16_t character) const
+{
+    for (int c = m_nodes.at(node).firstChild; c >= 0; c = m_nodes.at(c).nextSibling) {
+        if (m_nodes.at(c).character == character) {
+            return c;
+        }
+    }
+    return -1;
+}
+
+int SuggestionTrie::insertPath(const QString &text)
+{
+    if (m_nodes.isEmpty()) {
+        m_nodes.append(Node());
+    }
+
+    int node = 0;
+    for (QChar character : text) {
+        int next = child(node, character.unicode());
+        if (next < 0) {
+            next = static_cast<int>(m_nodes.size());
+            Node created;
+            created.character = character.unicode();
+            created.parent = node;
+            created.nextSibling = m_nodes.at(node).firstChild;
+            m_nodes.append(created);
+            m_nodes[node].firstChild = next;
+        }
+        node = next;
+    }
+    return node;
+}
+
+void SuggestionTrie::refresh(int node)
+{
+    // Leaves and chains keep no list of their own; see bestTerms()
+    const Node &current = m_nodes.at(node);
+    if (current.firstChild < 0 || (current.term < 0 && m_nodes.at(current.firstChild).nextSibling < 0)) {
+        return;
+    }
+
+    QVector<int> candidates;
+    if (current.term >= 0 && m_terms.at(current.term).weight > 0) {
+        candidates.append(current.term);
+    }
+    for (int c = current.firstChild; c >= 0; c = m_nodes.at(c).nextSibling) {
+        bestTerms(c, candidates);
+    }
+
+    const auto order = [this](int a, int b) { return ranksBefore(a, b); };
+    if (candidates.size() > CachedCompletions) {
+        std::partial_sort(candidates.begin(), candidates.begin() + CachedCompletions, candidates.end(), order);
+        candidates.resize(CachedCompletions);
+    } else {
+        std::sort(candidates.begin(), candidates.end(), order);
+    }
+
+    // A node keeps its slots once it has them, since it never loses children or its term
+    if (m_nodes.at(node).best < 0) {
+        m_nodes[node].best = static_cast<int>(m_best.size());
+        m_best.append(QVector<int>(CachedCompletions, -1));
+    }
+    const int first = m_nodes.at(node).best;
+    for (int i = 0; i < CachedCompletions; ++i) {
+        m_best[first + i] = i < candidates.size() ? candidates.at(i) : -1;
+    }
+}
+
+void SuggestionTrie::bestTerms(int node, QVector<int> &terms) const
+{
+    while (m_nodes.at(node).best < 0 && m_nodes.at(node).term < 0 && m_nodes.at(node).firstChild >= 0) {
+        node = m_nodes.at(node).firstChild;
+    }
+    const Node &current = m_nodes.at(node);
+    if (current.best >= 0) {
+        for (int i = current.best; i < current.best + CachedCompletions && m_best.at(i) >= 0; ++i) {
+            terms.append(m_best.at(i));
+        }
+    } else if (current.term >= 0 && m_terms.at(current.term).weight > 0) {
+        terms.append(current.term);
+    }
+}
+
+bool SuggestionTrie::ranksBefore(int a, int b) const
+{
+    const Term &first = m_terms.at(a);
+    const Term &second = m_terms.at(b);
+    if (first.weight != second.weight) {
+        return first.weight > second.weight;
+    }
+    if (first.text.length() != second.text.length()) {
+        return first.text.length() < second.text.length();
+    }
+    return first.text < second.text;
+}
+
+void SuggestionTrie::collect(int node, QVector<int> &terms) const
+{
+    QVector<int> pending = {node};
+    while (!pending.isEmpty()) {
+        const Node &current = m_nodes.at(pending.takeLast());
+        if (current.term >= 0 && m_terms.at(current.term).weight > 0) {
+            terms.append(current.term);
+        }
+        for (int c = current.firstChild; c >= 0; c = m_nodes.at(c).nextSibling) {
+            pending.append(c);
+        }
+    }
+}
+
+} // namespace DesktopApp
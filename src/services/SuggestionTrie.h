@@ -0,0 +1,85 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QHash>
+
+namespace DesktopApp {
+
+/**
+ * @brief Prefix tree of search terms for weighted completion
+ *
+ * The best few terms below a node are cached in one shared pool, so the top
+ * completions of a prefix cost a walk down the prefix and a copy, however
+ * large the vocabulary. Only nodes that branch or end a term inside the
+ * subtree get a list; a chain of single children reads the list of the node
+ * it leads to, and a leaf's list is its own term. Changing a weight
+ * refreshes those lists along the term's path only. Nodes are never freed;
+ * a term whose weight drops to zero stays as a tombstone until the trie is
+ * rebuilt.
+ *
+ * Not thread-safe; the owner serializes access.
+ */
+class SuggestionTrie
+{
+public:
+    /**
+     * @brief Best terms cached per node; longer completion lists walk the subtree
+     */
+    static constexpr int CachedCompletions = 10;
+
+    /**
+     * @brief Longer terms (hashes, URLs, pasted blobs) are not offered as completions
+     */
+    static constexpr int MaxTermLength = 32;
+
+    /**
+     * @brief Replace the contents with @p weights in one pass
+     */
+    void build(const QHash<QString, int> &weights);
+
+    /**
+     * @brief Set the weight of @p term; 0 removes it from completions
+     */
+    void setWeight(const QString &term, int weight);
+
+    /**
+     * @brief Terms starting with @p prefix and longer than it, highest weight first
+     *
+     * Equal weights put shorter terms first, then sort alphabetically.
+     */
+    QStringList complete(const QString &prefix, int limit) const;
+
+    void clear();
+    int size() const { return m_liveTerms; }
+
+private:
+    struct Term {
+        QString text;
+        int weight = 0;
+    };
+
+    struct Node {
+        char16_t character = 0;
+        int parent = -1;
+        int firstChild = -1;
+        int nextSibling = -1;
+        int term = -1;             // index in m_terms ending here, or -1
+        int best = -1;             // start of this subtree's best terms in m_best, or -1
+    };
+
+    int child(int node, char16_t character) const;
+    int insertPath(const QString &text);
+    void refresh(int node);
+    void bestTerms(int node, QVector<int> &terms) const;
+    bool ranksBefore(int a, int b) const;
+    void collect(int node, QVector<int> &terms) const;
+
+    QVector<Node> m_nodes;
+    QVector<Term> m_terms;
+    QVector<int> m_best;           // CachedCompletions slots per list, -1 past its end
+    int m_liveTerms = 0;
+};
+
+} // namespace DesktopApp
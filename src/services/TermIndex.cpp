@@ -0,0 +1,236 @@
+#include "TermIndex.h"
+#include "IndexSegment.h"
+#include <algorithm>
+#include <utility>
+
+namespace DesktopApp {
+
+void TermIndex::add(const Message &message, const QStringList &words)
+{
+    remove(message.id);
+    
+    QHash<QString, int> frequencies;
+    for (const QString &word : words) {
+        ++frequencies[word];
+    }
+    
+    const int position = static_cast<int>(documents.size());
+    Document document;
+    document.termCount = static_cast<int>(words.size());
+    document.messageId = message.id;
+    document.conversationId = message.conversationId;
+    document.createdAt = message.createdAt;
+    document.length = static_cast<int>(message.text.length());
+    document.bytes = static_cast<int>(message.text.toUtf8().size());
+    document.terms.reserve(frequencies.size());
+    for (auto it = frequencies.cbegin(); it != frequencies.cend(); ++it) {
+        auto list = postings.find(it.key());
+        if (list == postings.end()) {
+            list = postings.insert(it.key(), QVector<Posting>());
+        }
+        list->append({position, it.value()});
+        document.terms.append(list.key());
+    }
+    
+    conversationMessages[document.conversationId].insert(message.id);
+    documentIds.insert(message.id, position);
+    indexedChars += document.length;
+    totalTerms += document.termCount;
+    documents.append(document);
+}
+
+void TermIndex::remove(const QString &messageId)
+{
+    auto id = documentIds.find(messageId);
+    if (id == documentIds.end()) {
+        return;
+    }
+    const int position = id.value();
+    documentIds.erase(id);
+    
+    Document &document = documents[position];
+    for (const QString &term : std::as_const(document.terms)) {
+        auto list = postings.find(term);
+        if (list == postings.end()) {
+            continue;
+        }
+        auto posting = std::lower_bound(list->begin(), list->end(), position, [](const Posting &p, int d) {
+            return p.document < d;
+        });
+        if (posting != list->end() && posting->document == position) {
+            list->erase(posting);
+        }
+        if (list->isEmpty()) {
+            postings.erase(list);
+        }
+    }
+    auto messages = conversationMessages.find(document.conversationId);
+    if (messages != conversationMessages.end()) {
+        messages->remove(messageId);
+        if (messages->isEmpty()) {
+            conversationMessages.erase(messages);
+        }
+    }
+    indexedChars -= document.length;
+    totalTerms -= document.termCount;
+    document = Document();
+    
+    if (compacting && documents.size() > 1024 && documentIds.size() < documents.size() / 2) {
+        compact();
+    }
+}
+
+void TermIndex::merge(const TermIndex &part)
+{
+    // The part's documents go after the ones here, so the posting lists stay sorted
+    const int offset = static_cast<int>(documents.size());
+    documents.append(part.documents);
+    for (auto id = part.documentIds.cbegin(); id != part.documentIds.cend(); ++id) {
+        documentIds.insert(id.key(), id.value() + offset);
+    }
+    for (auto list = part.postings.cbegin(); list != part.postings.cend(); ++list) {
+        QVector<Posting> &target = postings[list.key()];
+        target.reserve(target.size() + list->size());
+        for (const Posting &posting : *list) {
+            target.append({posting.document + offset, posting.frequency});
+        }
+    }
+    for (auto messages = part.conversationMessages.cbegin(); messages != part.conversationMessages.cend(); ++messages) {
+        conversationMessages[messages.key()].unite(messages.value());
+    }
+    indexedChars += part.indexedChars;
+    totalTerms += part.totalTerms;
+}
+
+QStringList TermIndex::termsOf(const QString &messageId) const
+{
+    const int position = documentIds.value(messageId, -1);
+    return position >= 0 ? documents.at(position).terms : QStringList();
+}
+
+QHash<QString, int> TermIndex::documentFrequencies() const
+{
+    QHash<QString, int> frequencies;
+    frequencies.reserve(postings.size());
+    for (auto list = postings.cbegin(); list != postings.cend(); ++list) {
+        frequencies.insert(list.key(), static_cast<int>(list->size()));
+    }
+    return frequencies;
+}
+
+void TermIndex::dropBefore(int position)
+{
+    // Renumbered by the same offset, so the posting lists stay sorted
+    TermIndex rest;
+    rest.compacting = compacting;
+    rest.documents = documents.mid(position);
+    for (auto id = documentIds.cbegin(); id != documentIds.cend(); ++id) {
+        if (id.value() >= position) {
+            rest.documentIds.insert(id.key(), id.value() - position);
+        }
+    }
+    for (auto list = postings.cbegin(); list != postings.cend(); ++list) {
+        auto first = std::lower_bound(list->cbegin(), list->cend(), position, [](const Posting &p, int d) {
+            return p.document < d;
+        });
+        if (first == list->cend()) {
+            continue;
+        }
+        QVector<Posting> &target = rest.postings[list.key()];
+        target.reserve(list->cend() - first);
+        for (auto posting = first; posting != list->cend(); ++posting) {
+            target.append({posting->document - position, posting->frequency});
+        }
+    }
+    for (const Document &document : std::as_const(rest.documents)) {
+        if (!document.messageId.isEmpty()) {
+            rest.conversationMessages[document.conversationId].insert(document.messageId);
+            rest.indexedChars += document.length;
+            rest.totalTerms += document.termCount;
+        }
+    }
+    *this = std::move(rest);
+}
+
+void TermIndex::appendSegment(const IndexSegment &segment, const QBitArray &deleted)
+{
+    // Segment documents keep their order, so the posting lists stay sorted
+    const int count = segment.documentCount();
+    QVector<int> positions(count, -1);
+    for (int number = 0; number < count; ++number) {
+        if (number < deleted.size() && deleted.testBit(number)) {
+            continue;
+        }
+        const IndexSegment::Document source = segment.document(number);
+        Document document;
+        document.messageId = source.messageId;
+        document.conversationId = source.conversationId;
+        document.createdAt = source.createdAt;
+        document.termCount = source.termCount;
+        document.length = source.length;
+        document.bytes = source.bytes;
+        
+        positions[number] = static_cast<int>(documents.size());
+        conversationMessages[document.conversationId].insert(document.messageId);
+        documentIds.insert(document.messageId, positions[number]);
+        indexedChars += document.length;
+        totalTerms += document.termCount;
+        documents.append(document);
+    }
+    
+    for (int term = 0; term < segment.termCount(); ++term) {
+        const IndexSegment::PostingList list = segment.postingsAt(term);
+        QVector<Posting> *target = nullptr;
+        QString text;
+        for (int i = 0; i < list.size(); ++i) {
+            const IndexSegment::Posting posting = list.at(i);
+            const int position = posting.document < count ? positions.at(posting.document) : -1;
+            if (position < 0) {
+                continue;
+            }
+            if (!target) {
+                auto inserted = postings.find(segment.term(term));
+                if (inserted == postings.end()) {
+                    inserted = postings.insert(segment.term(term), QVector<Posting>());
+                }
+                target = &inserted.value();
+                text = inserted.key();
+            }
+            target->append({position, posting.frequency});
+            documents[position].terms.append(text);
+        }
+    }
+}
+
+void TermIndex::compact()
+{
+    // Renumbering keeps the relative order, so the posting lists stay sorted
+    QVector<int> renumbered(documents.size(), -1);
+    QVector<Document> live;
+    live.reserve(documentIds.size());
+    for (int i = 0; i < documents.size(); ++i) {
+        if (!documents[i].messageId.isEmpty()) {
+            renumbered[i] = static_cast<int>(live.size());
+            live.append(std::move(documents[i]));
+        }
+    }
+    for (auto list = postings.begin(); list != postings.end(); ++list) {
+        for (Posting &posting : *list) {
+            posting.document = renumbered.at(posting.document);
+        }
+    }
+    for (auto id = documentIds.begin(); id != documentIds.end(); ++id) {
+        id.value() = renumbered.at(id.value());
+    }
+    documents = std::move(live);
+}
+
+void TermIndex::removeConversation(const QString &conversationId)
+{
+    const QSet<QString> messageIds = conversationMessages.value(conversationId);
+    for (const QString &messageId : messageIds) {
+        remove(messageId);
+    }
+}
+
+} // namespace DesktopApp
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QSet>
+#include <QVector>
+#include <QDateTime>
+#include <QBitArray>
+#include "data/Models.h"
+
+namespace DesktopApp {
+
+class IndexSegment;
+
+/**
+ * @brief In-memory inverted index of message terms
+ *
+ * Documents are numbered in the order they are added, so every posting
+ * list stays sorted by document; a re-indexed message gets a new number
+ * and its old slot is left empty until enough of them pile up to compact.
+ *
+ * SearchEngine keeps recent messages in one of these and writes it out as
+ * an IndexSegment when it grows; rebuilds and segment merges also assemble
+ * their results here. Not thread-safe.
+ */
+struct TermIndex {
+    struct Posting {
+        int document;         // position in documents
+        int frequency;        // occurrences of the term in the message
+    };
+
+    struct Document {
+        QString messageId;    // empty once the message was removed
+        QString conversationId;
+        QDateTime createdAt;
+        QStringList terms;    // distinct, sharing the postings' keys
+        int termCount = 0;    // indexed words, repeats included
+        int length = 0;       // characters of the message text
+        int bytes = 0;        // message text as UTF-8, as the store counts it
+    };
+
+    QVector<Document> documents;
+    QHash<QString, int> documentIds;                    // messageId -> position in documents
+    QHash<QString, QVector<Posting>> postings;          // term -> postings ordered by document
+    QHash<QString, QSet<QString>> conversationMessages; // conversationId -> messageIds
+    qint64 indexedChars = 0;
+    qint64 totalTerms = 0;                              // sum of termCount
+    bool compacting = true;                             // off while positions must stay put
+
+    /**
+     * @brief Index @p message, replacing any earlier version of it
+     * @param words Terms of the message text in order, repeats included
+     */
+    void add(const Message &message, const QStringList &words);
+    void remove(const QString &messageId);
+    void removeConversation(const QString &conversationId);
+
+    /**
+     * @brief Append the documents of @p part, an index built over other conversations
+     */
+    void merge(const TermIndex &part);
+
+    /**
+     * @brief Append the documents of @p segment not marked in @p deleted
+     */
+    void appendSegment(const IndexSegment &segment, const QBitArray &deleted);
+
+    /**
+     * @brief Drop every document before @p position and renumber the rest from 0
+     */
+    void dropBefore(int position);
+
+    /**
+     * @brief Distinct terms of an indexed message; empty if it is not here
+     */
+    QStringList termsOf(const QString &messageId) const;
+
+    /**
+     * @brief Messages containing each term
+     */
+    QHash<QString, int> documentFrequencies() const;
+
+private:
+    void compact();
+};
+
+} // namespace DesktopApp
@@ -1,6 +1,6 @@
 #include "ConversationListWidget.h"
 #include "core/Application.h"
-#include "data/JsonStore.h"
+#include "data/ConversationRepository.h"
 #include "theme/ThemeManager.h"
 #include "theme/IconRegistry.h"
 
@@ -19,7 +19,10 @@
 #include <QTimer>
 #include <QApplication>
 #include "services/SearchEngine.h"
+#include "data/StoreSnapshot.h"
 #include <QTimer>
+#include <QThreadPool>
+#include <QPointer>
 
 namespace DesktopApp {
 
@@ -125,28 +128,53 @@ void ConversationListWidget::connectSignals()
     // Database updates
     auto *app = Application::instance();
     auto *store = app->conversationStore();
-    connect(store, &JsonStore::conversationCreated,
+    connect(store, &ConversationRepository::conversationCreated,
             this, [this](const QString &) { refreshConversations(); });
-    connect(store, &JsonStore::conversationUpdated,
+    connect(store, &ConversationRepository::conversationUpdated,
             this, [this](const QString &) { refreshConversations(); });
-    connect(store, &JsonStore::conversationDeleted,
+    connect(store, &ConversationRepository::conversationDeleted,
             this, [this](const QString &) { refreshConversations(); });
+    connect(store, &ConversationRepository::changesCommitted,
+            this, [this](const ChangeSet &changes) {
+                if (changes.hasConversationChanges()) {
+                    refreshConversations();
+                }
+            });
 }
 
 void ConversationListWidget::refreshConversations()
 {
     auto *app = Application::instance();
     auto *store = app->conversationStore();
-    m_conversationsList->clear();
-
-    // Get all active conversations (non-archived, non-deleted)
-    ConversationList conversations = store->getRecentConversations(100);
     
-    // Apply search filter if active
-    if (!m_currentFilter.isEmpty()) {
-        auto *searchEngine = app->searchEngine();
-        conversations = searchEngine->searchConversations(m_currentFilter, 50);
+    // Any search still running is for an older filter or older data
+    const quint64 generation = ++m_searchGeneration;
+    
+    if (m_currentFilter.isEmpty()) {
+        // Get all active conversations (non-archived, non-deleted)
+        showConversations(store->getRecentConversations(100));
+        return;
     }
+    
+    // Search a snapshot on a worker thread so typing never waits on it;
+    // the list keeps its current contents until the results arrive
+    std::shared_ptr<const StoreSnapshot> snapshot = store->snapshot();
+    SearchEngine *searchEngine = app->searchEngine();
+    const QString filter = m_currentFilter;
+    QPointer<ConversationListWidget> self(this);
+    QThreadPool::globalInstance()->start([snapshot, searchEngine, filter, generation, self]() {
+        ConversationList results = searchEngine->searchConversations(*snapshot, filter, 50);
+        QMetaObject::invokeMethod(qApp, [results, generation, self]() {
+            if (self && self->m_searchGeneration == generation) {
+                self->showConversations(results);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ConversationListWidget::showConversations(const ConversationList &conversations)
+{
+    m_conversationsList->clear();
 
     // Add conversations to list
     for (const auto &conversation : conversations) {
@@ -80,6 +80,7 @@ private:
     void updateHoverActionsPosition();
     void connectSignals();
     void populateConversations(const ConversationList &conversations);
+    void showConversations(const ConversationList &conversations);
     void updateConversationItem(QListWidgetItem *item, const Conversation &conversation);
     Conversation getConversationFromItem(QListWidgetItem *item) const;
     void showRenameDialog(const QString &conversationId);
@@ -109,6 +110,7 @@ private:
 
     // Current state
     QString m_currentFilter;
+    quint64 m_searchGeneration = 0;     // results of older searches are dropped
     QListWidgetItem *m_contextMenuItem;
     QString m_pendingSoftDeleteId;
 };
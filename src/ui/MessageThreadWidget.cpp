@@ -1,7 +1,7 @@
 #include "MessageThreadWidget.h"
 #include "SimpleMessageWidget.h"
 #include "core/Application.h"
-#include "data/JsonStore.h"
+#include "data/ConversationRepository.h"
 #include "theme/ThemeManager.h"
 #include "theme/IconRegistry.h"
 #include "providers/ProviderManager.h"
@@ -31,6 +31,11 @@
 
 namespace DesktopApp {
 
+namespace {
+const int kMessagePageSize = 50;          // Messages materialized per page
+const int kLoadOlderThresholdPx = 48;     // Fetch older messages this close to the top
+}
+
 MessageThreadWidget::MessageThreadWidget(QWidget *parent)
     : QWidget(parent)
     , m_mainLayout(nullptr)
@@ -111,6 +116,16 @@ void MessageThreadWidget::setupUI()
     m_scrollTimer->setSingleShot(true);
     m_scrollTimer->setInterval(50);
     connect(m_scrollTimer, &QTimer::timeout, this, &MessageThreadWidget::onScrollToBottom);
+    
+    // Older pages are fetched when the user scrolls near the top
+    connect(m_scrollArea->verticalScrollBar(), &QScrollBar::valueChanged,
+            this, &MessageThreadWidget::onScrollValueChanged);
+    connect(m_scrollArea->verticalScrollBar(), &QScrollBar::rangeChanged, this, [this](int, int max) {
+        // A page too short to scroll can never reach the top by scrolling
+        if (max == 0 && m_hasOlderMessages) {
+            loadOlderMessages();
+        }
+    });
 }
 
 void MessageThreadWidget::connectSignals()
@@ -123,6 +138,10 @@ void MessageThreadWidget::connectSignals()
         connect(m_providerManager, &ProviderManager::messageChunk,
                 this, [this](const QString &convId, const QString &msgId, const QString &chunk) {
                     Q_UNUSED(msgId)
+                    // The store buffers the draft; it is persisted at intervals, not per chunk
+                    if (!m_currentAssistantMessageId.isEmpty()) {
+                        Application::instance()->conversationStore()->appendDraftText(m_currentAssistantMessageId, chunk);
+                    }
                     if (convId == m_currentConversationId && m_streamingMessageWidget) {
                         // Update content immediately without animation - accumulate chunks
                         QString current = m_streamingMessageWidget->message().text + chunk;
@@ -134,17 +153,18 @@ void MessageThreadWidget::connectSignals()
     connect(m_providerManager, &ProviderManager::messageCompleted,
         this, [this](const QString &convId, const QString &msgId, const Message &message) {
             Q_UNUSED(msgId)
+                    finishAssistantDraft(message.text, MessageDeliveryState::Sent);
                     if (convId == m_currentConversationId && m_streamingMessageWidget) {
                         m_streamingMessageWidget->updateContent(message.text);
                         m_streamingMessageWidget->setStreaming(false);
                         m_streamingMessageWidget->setGenerating(false);
                         m_streamingMessageWidget = nullptr;
-                        m_currentAssistantMessageId.clear();
                         emit conversationUpdated(convId);
                     }
                 });
         connect(m_providerManager, &ProviderManager::messageFailed,
                 this, [this](const QString &convId, const QString &, const QString &error) {
+                    finishAssistantDraft("Error: " + error, MessageDeliveryState::Failed);
                     if (convId == m_currentConversationId && m_streamingMessageWidget) {
                         m_streamingMessageWidget->updateContent("Error: " + error);
                         m_streamingMessageWidget->setStreaming(false);
@@ -478,10 +498,50 @@ void MessageThreadWidget::loadConversation(const QString &conversationId)
     auto *app = Application::instance();
     auto *store = app->conversationStore();
     
-    MessageList messages = store->getMessagesForConversation(conversationId);
-    populateMessages(messages);
+    // Only the newest page is materialized; older ones load on demand
+    MessagePage page = store->getMessagesBefore(conversationId, MessageCursor(), kMessagePageSize);
+    populateMessages(page.messages);
+    m_hasOlderMessages = page.hasMoreBefore;
+    if (!page.messages.isEmpty()) {
+        m_oldestLoadedMessage = MessageCursor(page.messages.first());
+    }
+
+    qDebug() << "Loaded conversation" << conversationId << "showing" << page.messages.size()
+             << "of" << page.totalCount << "messages";
+}
+
+void MessageThreadWidget::loadOlderMessages()
+{
+    if (!m_hasOlderMessages || m_currentConversationId.isEmpty()) {
+        return;
+    }
+
+    auto *store = Application::instance()->conversationStore();
+    MessagePage page = store->getMessagesBefore(m_currentConversationId, m_oldestLoadedMessage, kMessagePageSize);
+    m_hasOlderMessages = page.hasMoreBefore;
+    if (page.messages.isEmpty()) {
+        return;
+    }
+    m_oldestLoadedMessage = MessageCursor(page.messages.first());
+
+    // Keep the message under the viewport still while content grows above it
+    QScrollBar *scrollBar = m_scrollArea->verticalScrollBar();
+    const int distanceFromBottom = scrollBar->maximum() - scrollBar->value();
+
+    for (int i = 0; i < page.messages.size(); ++i) {
+        insertMessageWidget(i, page.messages.at(i));
+    }
+
+    QTimer::singleShot(0, this, [scrollBar, distanceFromBottom]() {
+        scrollBar->setValue(scrollBar->maximum() - distanceFromBottom);
+    });
+}
 
-    qDebug() << "Loaded conversation" << conversationId << "with" << messages.size() << "messages";
+void MessageThreadWidget::onScrollValueChanged(int value)
+{
+    if (m_hasOlderMessages && value <= kLoadOlderThresholdPx) {
+        loadOlderMessages();
+    }
 }
 
 void MessageThreadWidget::addUserMessage(const QString &text, const AttachmentList &attachments)
@@ -563,6 +623,8 @@ void MessageThreadWidget::clearMessages()
     }
     
     m_streamingMessageWidget = nullptr;
+    m_oldestLoadedMessage = MessageCursor();
+    m_hasOlderMessages = false;
 }
 
 void MessageThreadWidget::populateMessages(const MessageList &messages)
@@ -576,19 +638,24 @@ void MessageThreadWidget::populateMessages(const MessageList &messages)
     }
 }
 
-void MessageThreadWidget::addMessageWidget(const Message &message)
+SimpleMessageWidget *MessageThreadWidget::insertMessageWidget(int index, const Message &message)
 {
     // Create SimpleMessageWidget for all messages consistently
     auto *messageWidget = new SimpleMessageWidget(message, this);
-    
-    // Add messages at the end - they'll stack top to bottom naturally
-    m_messagesLayout->addWidget(messageWidget);
+    m_messagesLayout->insertWidget(index, messageWidget);
     
     // Connect message actions
     connect(messageWidget, &SimpleMessageWidget::copyRequested,
             [](const QString &text) {
                 QApplication::clipboard()->setText(text);
             });
+    return messageWidget;
+}
+
+void MessageThreadWidget::addMessageWidget(const Message &message)
+{
+    // Add messages at the end - they'll stack top to bottom naturally
+    insertMessageWidget(-1, message);
     
     // Auto-scroll to show new message
     QTimer::singleShot(50, this, &MessageThreadWidget::scrollToBottom);
@@ -764,6 +831,24 @@ void MessageThreadWidget::generateResponse(const QString &userMessage)
     }
 }
 
+void MessageThreadWidget::finishAssistantDraft(const QString &text, MessageDeliveryState state)
+{
+    if (m_currentAssistantMessageId.isEmpty()) {
+        return;
+    }
+    
+    auto *store = Application::instance()->conversationStore();
+    Message message = store->getMessage(m_currentAssistantMessageId);
+    m_currentAssistantMessageId.clear();
+    if (!message.isValid()) {
+        return;
+    }
+    
+    message.text = text;
+    message.deliveryState = state;
+    store->finishDraft(message);
+}
+
 void MessageThreadWidget::ensureAutoTitle(const QString &firstUserText)
 {
     auto *app = Application::instance();
@@ -69,6 +69,7 @@ signals:
 
 private slots:
     void onScrollToBottom();
+    void onScrollValueChanged(int value);
 
 protected:
     void resizeEvent(QResizeEvent *event) override;
@@ -78,9 +79,12 @@ private:
     void connectSignals();
     void populateMessages(const MessageList &messages);
     void addMessageWidget(const Message &message);
+    SimpleMessageWidget *insertMessageWidget(int index, const Message &message);
+    void loadOlderMessages(); // Prepend the page before the oldest loaded message
     void showEmptyState();
     void hideEmptyState();
     void generateResponse(const QString &userMessage);
+    void finishAssistantDraft(const QString &text, MessageDeliveryState state); // Persist the streamed reply
     void updateFadeOverlays();
     void ensureAutoTitle(const QString &firstUserText);
     QString generateConversationTitle(const QString &userText);
@@ -110,6 +114,8 @@ private:
     QString m_currentConversationId;
     QString m_currentAssistantMessageId;
     SimpleMessageWidget *m_streamingMessageWidget;
+    MessageCursor m_oldestLoadedMessage; // Keyset cursor for fetching older pages
+    bool m_hasOlderMessages {false};
 
 public:
     QLabel *m_liveRegion; // ARIA live region for screen readers - public for MessageWidget access
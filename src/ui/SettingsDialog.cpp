@@ -2,6 +2,9 @@
 #include "core/Application.h"
 #include "services/SettingsStore.h"
 #include "services/AuthenticationService.h"
+#include "services/HistoryArchive.h"
+#include "services/FileVault.h"
+#include "data/ConversationRepository.h"
 #include "providers/ProviderManager.h"
 #include "providers/EchoProvider.h"
 #include "providers/ProviderSDK.h"
@@ -29,6 +32,7 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QProgressBar>
+#include <QProgressDialog>
 #include <QDialogButtonBox>
 #include <QSplitter>
 #include <QTextEdit>
@@ -37,6 +41,7 @@
 #include <QDesktopServices>
 #include <QUrl>
 #include <QDebug>
+#include <QLocale>
 #include <QTimer>
 #include <QThread>
 
@@ -601,6 +606,19 @@ PrivacySettingsWidget::PrivacySettingsWidget(QWidget *parent)
 {
     setupUI();
     loadSettings();
+    
+    // The stores keep their totals current, so the label can follow every change
+    auto *app = Application::instance();
+    if (auto *store = app->conversationStore()) {
+        connect(store, &ConversationRepository::messageCreated, this, &PrivacySettingsWidget::updateStorageUsage);
+        connect(store, &ConversationRepository::messageDeleted, this, &PrivacySettingsWidget::updateStorageUsage);
+        connect(store, &ConversationRepository::conversationDeleted, this, &PrivacySettingsWidget::updateStorageUsage);
+        connect(store, &ConversationRepository::changesCommitted, this, &PrivacySettingsWidget::updateStorageUsage);
+    }
+    if (auto *vault = app->fileVault()) {
+        connect(vault, &FileVault::fileStored, this, &PrivacySettingsWidget::updateStorageUsage);
+        connect(vault, &FileVault::fileRemoved, this, &PrivacySettingsWidget::updateStorageUsage);
+    }
 }
 
 void PrivacySettingsWidget::setupUI()
@@ -645,6 +663,7 @@ void PrivacySettingsWidget::setupUI()
     auto *managementLayout = new QVBoxLayout(managementGroup);
     
     m_storageUsageLabel = new QLabel("Storage used: Calculating...");
+    m_storageUsageLabel->setWordWrap(true);
     managementLayout->addWidget(m_storageUsageLabel);
     
     auto *buttonLayout = new QHBoxLayout();
@@ -702,12 +721,36 @@ void PrivacySettingsWidget::onExportData()
 {
     QString fileName = QFileDialog::getSaveFileName(this,
                                                     "Export Data",
-                                                    QString("DesktopApp_Export_%1.json").arg(QDate::currentDate().toString("yyyy-MM-dd")),
-                                                    "JSON Files (*.json)");
+                                                    QString("DesktopApp_Export_%1.jsonl").arg(QDate::currentDate().toString("yyyy-MM-dd")),
+                                                    "JSON Lines Files (*.jsonl)");
     
     if (!fileName.isEmpty()) {
-        // TODO: Implement data export
-        QMessageBox::information(this, "Export Complete", "Data exported successfully to:\n" + fileName);
+        auto *app = Application::instance();
+        bool includeAttachments = QMessageBox::question(this, "Export Data",
+                                                        "Include attachment files in the export?",
+                                                        QMessageBox::Yes | QMessageBox::No,
+                                                        QMessageBox::No) == QMessageBox::Yes;
+        
+        HistoryArchive archive(app->conversationStore(), app->fileVault());
+        QProgressDialog progress("Exporting conversations...", "Cancel", 0, 0, this);
+        progress.setWindowModality(Qt::WindowModal);
+        progress.setMinimumDuration(500);
+        connect(&archive, &HistoryArchive::progress, &progress, [&progress](qint64 done, qint64 total) {
+            progress.setMaximum(static_cast<int>(total));
+            progress.setValue(static_cast<int>(done));
+        });
+        connect(&progress, &QProgressDialog::canceled, &archive, &HistoryArchive::cancel);
+        
+        bool ok = archive.exportTo(fileName, includeAttachments);
+        progress.reset();
+        if (ok) {
+            HistoryArchive::Summary summary = archive.summary();
+            QMessageBox::information(this, "Export Complete",
+                                     QString("Exported %1 conversations and %2 messages to:\n%3")
+                                         .arg(summary.conversations).arg(summary.messages).arg(fileName));
+        } else {
+            QMessageBox::warning(this, "Export Failed", archive.errorString());
+        }
     }
 }
 
@@ -716,18 +759,41 @@ void PrivacySettingsWidget::onImportData()
     QString fileName = QFileDialog::getOpenFileName(this,
                                                     "Import Data",
                                                     QString(),
-                                                    "JSON Files (*.json)");
+                                                    "JSON Lines Files (*.jsonl)");
     
     if (!fileName.isEmpty()) {
         int ret = QMessageBox::question(this, "Import Data",
                                         "Importing data will merge with existing data. "
-                                        "Duplicate conversations may be created.\n\nContinue with import?",
+                                        "Conversations that already exist are replaced by the imported copy.\n\nContinue with import?",
                                         QMessageBox::Yes | QMessageBox::No,
                                         QMessageBox::No);
         
         if (ret == QMessageBox::Yes) {
-            // TODO: Implement data import
-            QMessageBox::information(this, "Import Complete", "Data imported successfully from:\n" + fileName);
+            auto *app = Application::instance();
+            HistoryArchive archive(app->conversationStore(), app->fileVault());
+            
+            // Archive bytes, scaled to fit the dialog's int range; updating a
+            // modal dialog also lets the store checkpoint between batches
+            QProgressDialog progress("Importing conversations...", "Cancel", 0, 1000, this);
+            progress.setWindowModality(Qt::WindowModal);
+            progress.setMinimumDuration(500);
+            connect(&archive, &HistoryArchive::progress, &progress, [&progress](qint64 done, qint64 total) {
+                progress.setValue(total > 0 ? static_cast<int>(done * 1000 / total) : 0);
+            });
+            connect(&progress, &QProgressDialog::canceled, &archive, &HistoryArchive::cancel);
+            
+            bool ok = archive.importFrom(fileName);
+            progress.reset();
+            HistoryArchive::Summary summary = archive.summary();
+            if (ok) {
+                QMessageBox::information(this, "Import Complete",
+                                         QString("Imported %1 conversations and %2 messages from:\n%3")
+                                             .arg(summary.conversations).arg(summary.messages).arg(fileName));
+            } else {
+                QMessageBox::warning(this, "Import Incomplete",
+                                     QString("%1\n\n%2 conversations and %3 messages were imported.")
+                                         .arg(archive.errorString()).arg(summary.conversations).arg(summary.messages));
+            }
             emit settingsChanged();
         }
     }
@@ -795,8 +861,29 @@ void PrivacySettingsWidget::loadSettings()
     m_encryptDataCheck->setChecked(settings->get("privacy/encryptData", true).toBool());
     m_shareAnalyticsCheck->setChecked(settings->get("privacy/shareAnalytics", false).toBool());
     
-    // TODO: Calculate and display actual storage usage
-    m_storageUsageLabel->setText("Storage used: ~2.5 MB");
+    updateStorageUsage();
+}
+
+void PrivacySettingsWidget::updateStorageUsage()
+{
+    auto *app = Application::instance();
+    const QLocale locale;
+    StorageStats stats;
+    if (app->conversationStore()) {
+        stats = app->conversationStore()->getStorageStats();
+    }
+    FileVault::VaultStats vault = {};
+    if (app->fileVault()) {
+        vault = app->fileVault()->getStats();
+    }
+    
+    m_storageUsageLabel->setText(QString("Storage used: %1 of message text in %2 messages (%3 conversations), "
+                                         "%4 of attachments in %5 files")
+                                     .arg(locale.formattedDataSize(stats.textBytes))
+                                     .arg(stats.messageCount)
+                                     .arg(stats.conversationCount)
+                                     .arg(locale.formattedDataSize(vault.totalSize))
+                                     .arg(vault.totalFiles));
 }
 
 void PrivacySettingsWidget::saveSettings()
@@ -158,6 +158,7 @@ private slots:
     void onExportData();
     void onImportData();
     void onSignOut();
+    void updateStorageUsage();
 
 private:
     void setupUI();